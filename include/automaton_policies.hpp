@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+#include <diffusion.hpp>
+#include <grid.hpp>
+#include <simd.hpp>
+
+// Compile-time variation points of BasicCellularAutomata. Policies are
+// stateless types whose static members the inner loops call directly, so
+// every combination is specialised like hand-written code.
+
+
+// Neighbourhoods: the cells a nutrient averages over and a daughter may take
+
+// The 4 side neighbours: top, left, bottom, right
+struct VonNeumann
+{
+    static constexpr int COUNT = 4;
+    static constexpr int DI[COUNT] = { -1, 0, 1, 0 };
+    static constexpr int DJ[COUNT] = { 0, -1, 0, 1 };
+    // Low bits of a division claim key that hold the direction
+    static constexpr uint32_t DIRECTION_BITS = 2;
+
+    static DiffusionKernel kernel(SimdLevel level) { return diffusionKernel(level); }
+    static DiffusionRowKernel rowKernel(SimdLevel level) { return diffusionRowKernel(level); }
+};
+
+// The 4 side neighbours, then the 4 corners clockwise from the top left
+struct Moore
+{
+    static constexpr int COUNT = 8;
+    static constexpr int DI[COUNT] = { -1, 0, 1, 0, -1, -1, 1, 1 };
+    static constexpr int DJ[COUNT] = { 0, -1, 0, 1, -1, 1, 1, -1 };
+    static constexpr uint32_t DIRECTION_BITS = 3;
+
+    static DiffusionKernel kernel(SimdLevel level) { return mooreDiffusionKernel(level); }
+    static DiffusionRowKernel rowKernel(SimdLevel level) { return mooreDiffusionRowKernel(level); }
+};
+
+
+// Boundary conditions. The outer ring of the grid is a ghost layer that is
+// never updated: the diffusion kernels write MAX_NUTRIENT into it, and
+// prepare() rewrites it before every diffusion step when the condition asks
+// for something else, on float or packed nutrient grids alike. mapCell()
+// moves a daughter's position onto the grid, or returns false when the
+// position cannot take a cell.
+
+// Ring held at MAX_NUTRIENT, nutrients flow in from every side
+struct DirichletSource
+{
+    static constexpr bool PERIODIC = false;
+
+    template <typename T>
+    static void prepare(Grid<T>&) {}
+    static bool mapCell(int&, int&, int, int) { return true; }
+};
+
+// Ring mirrors the inner cell next to it, so nothing flows across the border
+struct NoFlux
+{
+    static constexpr bool PERIODIC = false;
+
+    template <typename T>
+    static void prepare(Grid<T>& grid)
+    {
+        const size_t width = grid.getWidth(), height = grid.getHeight();
+        for (size_t i = 1; i < height - 1; i++)
+        {
+            grid[i][0] = grid[i][1];
+            grid[i][width - 1] = grid[i][width - 2];
+        }
+        // Whole rows, so the corners take the diagonal inner cell
+        std::copy_n(grid[1], width, grid[0]);
+        std::copy_n(grid[height - 2], width, grid[height - 1]);
+    }
+
+    static bool mapCell(int& i, int& j, int height, int width)
+    {
+        return i > 0 && j > 0 && i < height - 1 && j < width - 1;
+    }
+};
+
+// Ring copies the inner cells on the opposite side: the inner grid is a torus
+struct Periodic
+{
+    static constexpr bool PERIODIC = true;
+
+    template <typename T>
+    static void prepare(Grid<T>& grid)
+    {
+        const size_t width = grid.getWidth(), height = grid.getHeight();
+        for (size_t i = 1; i < height - 1; i++)
+        {
+            grid[i][0] = grid[i][width - 2];
+            grid[i][width - 1] = grid[i][1];
+        }
+        std::copy_n(grid[height - 2], width, grid[0]);
+        std::copy_n(grid[1], width, grid[height - 1]);
+    }
+
+    static bool mapCell(int& i, int& j, int height, int width)
+    {
+        if (i == 0) i = height - 2;
+        else if (i == height - 1) i = 1;
+        if (j == 0) j = width - 2;
+        else if (j == width - 1) j = 1;
+        return true;
+    }
+};
+
+
+// Division rules: which of the count empty neighbours takes the daughter.
+// choose() returns an index in [0, count); draw(n) is a uniform integer in
+// [0, n) from the division mode's generator, nutrientOf(k) the nutrient of
+// candidate k. Rules should only draw when they need to, since every draw
+// advances the sequential generator.
+
+// Any empty neighbour, uniformly
+struct RandomNeighbor
+{
+    template <typename Draw, typename NutrientOf>
+    static int choose(int count, Draw&& draw, NutrientOf&&)
+    {
+        return draw(count);
+    }
+};
+
+// The empty neighbour with the most nutrient, ties broken uniformly
+struct RichestNeighbor
+{
+    template <typename Draw, typename NutrientOf>
+    static int choose(int count, Draw&& draw, NutrientOf&& nutrientOf)
+    {
+        int ties[8];
+        int tieCount = 0;
+        float best = -std::numeric_limits<float>::infinity();
+        for (int k = 0; k < count; k++)
+        {
+            float nutrient = nutrientOf(k);
+            if (nutrient > best)
+            {
+                best = nutrient;
+                tieCount = 0;
+            }
+            if (nutrient == best)
+                ties[tieCount++] = k;
+        }
+        return tieCount == 1 ? ties[0] : ties[draw(tieCount)];
+    }
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <simd.hpp>
+
+enum class CellState : uint8_t;
+
+// Cells per living or dead state left after an update
+struct StateTally
+{
+    size_t alive = 0;
+    size_t quiescent = 0;
+    size_t necrotic = 0;
+};
+
+// Applies the state rules to columns [jBegin, jEnd) of one row, in place.
+// Cells that are Alive afterwards are appended to aliveCells in column order
+// when their exposure (Empty neighbour count) is nonzero, or all of them when
+// exposure is null. Every state left is added to tally. Every variant
+// produces the same states, list and tally as the scalar one.
+using CellUpdateKernel = void (*)(
+    CellState* states,
+    const float* nutrients,
+    const uint8_t* exposure,
+    size_t jBegin,
+    size_t jEnd,
+    int row,
+    float divideThreshold,
+    float deathThreshold,
+    std::vector<std::pair<int, int>>& aliveCells,
+    StateTally& tally
+);
+
+CellUpdateKernel cellUpdateKernel(SimdLevel level);
+
+// Metabolic consumption over columns [jBegin, jEnd) of one row: living
+// (Alive and Quiescent) cells draw rate from their nutrient, which stops at
+// MIN_NUTRIENT. Branch free, so the compiler vectorises it.
+void consumeRow(const CellState* states, float* nutrients, size_t jBegin, size_t jEnd, float rate);
@@ -1,27 +1,34 @@
+#pragma once
+
 #include <iostream>
 #include <array>
 #include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
 #include <vector>
 #include <utility>
 #include <random>
-#include <MiniFB.h>
 
-constexpr size_t GRID_SIZE = 512;
-constexpr float MAX_NUTRIENT = 1.0f;
-constexpr float MIN_NUTRIENT = 0.0f;
+#include <automaton_policies.hpp>
+#include <counter_rng.hpp>
+#include <grid.hpp>
+#include <simd.hpp>
+#include <diffusion.hpp>
+#include <nutrient_solver.hpp>
+#include <nutrient_storage.hpp>
+#include <cell_update.hpp>
+#include <thread_pool.hpp>
+#include <tiling.hpp>
 
-constexpr uint32_t WIDTH  = GRID_SIZE;
-constexpr uint32_t HEIGHT = GRID_SIZE;
+class HaloTransport;
 
-enum class Neighbor
-{
-    TOP,   
-    LEFT,
-    BOTTOM,
-    RIGHT, 
-};
+constexpr size_t DEFAULT_GRID_SIZE = 512;
+constexpr float MAX_NUTRIENT = 1.0f;
+constexpr float MIN_NUTRIENT = 0.0f;
 
-enum class CellState
+// One byte per cell
+enum class CellState : uint8_t
 {
     Empty,      // no cell
     Alive,      // healthy, dividing
@@ -29,61 +36,331 @@ enum class CellState
     Necrotic,   // dead tissue
 };
 
-class CellularAutomata
+enum class DivisionMode
+{
+    Sequential,     // row order, one shared mt19937, daughters visible to later parents
+    Deterministic,  // per-cell counter RNG, conflicts resolved by priority, any thread count
+};
+
+struct CellCounts
+{
+    size_t alive = 0;
+    size_t quiescent = 0;
+    size_t necrotic = 0;
+};
+
+// What happened in one step, see EngineOptions::instrumentation
+struct StepStats
+{
+    uint64_t epoch = 0;             // epoch completed by the step
+    double diffuseSeconds = 0.0;    // fused steps: diffusion and update
+    double updateSeconds = 0.0;     // fused steps: 0
+    double divideSeconds = 0.0;
+    CellCounts counts;              // after the update phase, inner cells
+    size_t divisions = 0;           // daughters placed
+    size_t blockedDivisions = 0;    // Alive parents that did not divide
+    float nutrientMin = 0.0f;       // after diffusion
+    float nutrientMean = 0.0f;
+    float nutrientMax = 0.0f;
+    size_t solverCycles = 0;        // multigrid V-cycles, implicit and steady solvers
+    float solverChange = 0.0f;      // largest update of the last V-cycle
+};
+
+// A band of rows of a larger grid whose other bands are run by other
+// processes (see domain.hpp). The local grids hold the band plus one halo
+// row on each side that has a neighbour, refreshed through the transport.
+struct Subdomain
+{
+    size_t rowOrigin = 0;           // global row of local row 0
+    size_t globalHeight = 0;
+    HaloTransport* transport = nullptr;
+};
+
+// How a simulation is executed. None of these change the results, except
+// a positive activeTolerance and Fixed16 nutrients, which trade accuracy
+// for skipped work and memory traffic.
+struct EngineOptions
+{
+    SimdLevel simdLevel = SimdLevel::Scalar;
+    size_t threads = 1;                 // 0 = one per hardware thread
+    size_t tileSize = DEFAULT_TILE_SIZE;
+    // Skip tiles whose nutrients moved by at most this much in the last step
+    // and that hold no living cells. Unset = exact full sweeps, 0 = skip only
+    // tiles that are exactly steady.
+    std::optional<float> activeTolerance;
+    // Per-phase timers and per-step statistics (getStepStats()). The counts
+    // come out of the regular passes; off, only the branches remain.
+    bool instrumentation = false;
+    // Run one band of a decomposed grid. Needs deterministic division and
+    // the explicit nutrient step, and no active-region tracking.
+    std::optional<Subdomain> subdomain;
+    // step() diffuses, consumes and updates each tile in one pass while it
+    // is in cache, instead of one sweep over the grid per phase. Applies to
+    // the explicit nutrient step without active-region tracking.
+    bool fusedStep = true;
+    // Storage of the nutrient field. Fixed16 halves the bytes every sweep
+    // moves; it needs the explicit nutrient step, no active-region tracking
+    // and no subdomain.
+    NutrientPrecision nutrientPrecision = NutrientPrecision::Float32;
+};
+
+// The simulation engine. Neighborhood (VonNeumann, Moore), Boundary
+// (DirichletSource, NoFlux, Periodic) and DivisionRule (RandomNeighbor,
+// RichestNeighbor) are policies from automaton_policies.hpp. Every
+// combination is instantiated in cellular_automata.cpp; the implicit and
+// steady solvers, active regions and subdomains need the default stencil
+// and boundary (periodic boundaries rule out subdomains only).
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+class BasicCellularAutomata
 {
 private:
-    // RNG
-    std::random_device rd;
+    // RNG, replaced by restart()
+    uint64_t seed;
     std::mt19937 gen;
+    Philox4x32 counterRng;
 
-    // Simulation parameters
-    const float diffusionSpeed;
-    const float deathThreshold;
-    const float divideThreshold;
-    const float divideCost;
+    // Simulation parameters, all but the solver replaced by restart()
+    float diffusionSpeed;
+    float deathThreshold;
+    float divideThreshold;
+    float divideCost;
+    float consumptionRate;
+    DivisionMode divisionMode;
+    const NutrientSolverOptions nutrientSolver;
+
+    // Execution
+    const EngineOptions engine;
+    const DiffusionKernel diffuseRows;
+    const CellUpdateKernel updateRow;
 
     // Grids
-    std::array<std::array<CellState, GRID_SIZE>, GRID_SIZE> cellGrid;
-    std::array<std::array<float, GRID_SIZE>, GRID_SIZE> nutrientGrid;
-    std::vector<std::pair<int, int>> aliveCells;
-    
-    // Framebuffer
-    std::vector<uint32_t> framebuffer = std::vector<uint32_t>(WIDTH * HEIGHT, 0xff000000);
+    size_t width;
+    size_t height;
+    Grid<CellState> cellGrid;
+    Grid<float> nutrientGrid;
+    Grid<float> nextNutrientGrid; // diffusion target, swapped with nutrientGrid
+    // Empty cells among the neighbours of every inner cell. Updates never
+    // create or remove Empty cells, so only placed daughters change it.
+    Grid<uint8_t> exposure;
+    // The proliferating front: Alive cells with an Empty neighbour, the only
+    // ones that can divide. Row-major, for the sequential division.
+    std::vector<std::pair<int, int>> frontCells;
+    std::unique_ptr<MultigridSolver> multigrid; // implicit and steady solvers
+    // First-order uptake of every cell for the solvers, consumptionRate on
+    // living cells and 0 elsewhere; only allocated with consumption
+    Grid<float> uptake;
+
+    // Fixed16 nutrients: the packed field and its back buffer stand in for
+    // the float grids. Every pass unpacks the rows it works on into scratch
+    // rows, 4 per worker; getNutrientGrid() unpacks the whole field into
+    // unpackedNutrients when it is out of date.
+    bool packed = false;
+    const DiffusionRowKernel diffusePackedRow;
+    const NutrientPackKernel packNutrients;
+    const NutrientUnpackKernel unpackNutrients;
+    Grid<uint16_t> packedNutrients;
+    Grid<uint16_t> nextPackedNutrients;
+    Grid<float> scratchRows;
+    mutable Grid<float> unpackedNutrients;
+    mutable bool unpackedCurrent = false;
+
+    // Tiles are the unit of work handed to the thread pool
+    Tiling tiling;
+    std::unique_ptr<ThreadPool> pool;
+    std::vector<std::vector<std::pair<int, int>>> tileFrontCells; // row-major within the tile
+
+    // Deterministic division: the winning claim key of every target cell,
+    // and the claims each tile made in the current step
+    struct DivisionClaim
+    {
+        int i, j;       // parent
+        int ti, tj;     // target
+        uint64_t key;
+    };
+    Grid<uint64_t> divisionClaims;
+    std::vector<std::vector<DivisionClaim>> tileClaims;
+
+    // Active-region tracking, one entry per tile
+    struct TileActivity
+    {
+        uint8_t live;        // may hold Alive or Quiescent cells
+        uint8_t changed;     // nutrients changed in the last step
+        uint8_t nextChanged; // same, for the step being diffused
+        uint8_t settled;     // both nutrient buffers hold the same values
+        uint8_t diffused;    // diffused in the current step
+    };
+    std::vector<TileActivity> tileActivity;
+    size_t activeTiles = 0;
+
+    // Instrumentation: per-tile results of the last passes, and their totals
+    std::vector<StateTally> tileTallies;
+    std::vector<NutrientSummary> tileNutrients;
+    std::vector<size_t> tileDivisions;  // deterministic division
+    size_t divisions = 0;               // sequential division
+    StepStats stepStats;
+
+    // Subdomain: which local rows are halos, and the daughters this band
+    // placed in them during the current step
+    size_t rowOrigin = 0;
+    bool haloAbove = false;
+    bool haloBelow = false;
+    std::vector<uint8_t> daughtersAbove;
+    std::vector<uint8_t> daughtersBelow;
+    std::vector<uint64_t> receivedClaims;
+    std::vector<uint8_t> receivedDaughters;
+
+    // Completed steps
+    uint64_t epoch = 0;
+
+    // Per-run state from the grids: exposure, activity, claims, RNG, epoch 0
+    void startRun();
+    void diffuseActiveTile(size_t index);
+    void solveNutrients();
+    void summarizeNutrientStats();
+    void diffuseAndUpdateCells();
+    void diffusePackedTile(size_t index, size_t worker);
+    template <typename T>
+    void updateTile(size_t index, Grid<T>& nutrients, size_t worker);
+    void summarizeCellStats();
+    friend class Checkpoint;
+    void gatherFrontCells();
+    void computeExposure(size_t rowBegin, size_t rowEnd, size_t colBegin, size_t colEnd);
+    void coverCell(int i, int j, bool concurrent);
+    float nutrientAt(int i, int j) const;
+    void spendNutrient(int i, int j);
+    void divideCellsSequential();
+    void claimDivisions(size_t index);
+    void commitDivisions(size_t index);
+    void exchangeHalos();
+    void exchangeClaims();
+    void exchangeDaughters();
 public:
-    CellularAutomata(
-        std::array<std::array<CellState, GRID_SIZE>, GRID_SIZE>& cellGrid,
-        std::array<std::array<float, GRID_SIZE>, GRID_SIZE>& nutrientGrid,
+    // Grids passed as rvalues are adopted without copying
+    BasicCellularAutomata(
+        Grid<CellState> cellGrid,
+        Grid<float> nutrientGrid,
         float diffusionSpeed,
         float deathThreshold,
         float divideThreshold,
-        float divideCost
+        float divideCost,
+        float consumptionRate,
+        DivisionMode divisionMode,
+        uint64_t seed,
+        const NutrientSolverOptions& nutrientSolver = {},
+        const EngineOptions& engine = {}
+    );
+    // Starts a new run in place, on the same grid size and engine options:
+    // initialize() rewrites both grids, then the parameters and the seed
+    // are replaced and the epoch goes back to 0. Every buffer, the tiling
+    // and the thread pool are kept, so repeated runs do not allocate. Not
+    // for subdomains.
+    void restart(
+        const std::function<void(Grid<CellState>& cells, Grid<float>& nutrients)>& initialize,
+        float diffusionSpeed,
+        float deathThreshold,
+        float divideThreshold,
+        float divideCost,
+        float consumptionRate,
+        DivisionMode divisionMode,
+        uint64_t seed
     );
     void diffuseNutrients();
     void updateCells();
+    // Also advances the epoch
     void divideCells();
+    // Same result as diffuseNutrients(), updateCells(), divideCells(), see
+    // EngineOptions::fusedStep
     void step();
-    void render();
+
+    size_t getWidth() const;
+    size_t getHeight() const;
+    uint64_t getEpoch() const;
+    uint64_t getSeed() const;
+    float getDiffusionSpeed() const;
+    float getDeathThreshold() const;
+    float getDivideThreshold() const;
+    float getDivisionCost() const;
+    float getConsumptionRate() const;
+    DivisionMode getDivisionMode() const;
+    const NutrientSolverOptions& getNutrientSolver() const;
+    SimdLevel getSimdLevel() const;
+    size_t getThreadCount() const;
+    // Tiles diffused in the last step (all of them without active-region tracking)
+    size_t getActiveTileCount() const;
+    bool isInstrumented() const;
+    // Last step, only filled in with instrumentation on
+    const StepStats& getStepStats() const;
+    NutrientPrecision getNutrientPrecision() const;
+    const Grid<CellState>& getCellGrid() const;
+    // Fixed16: unpacked on the first call after a phase, so not to be
+    // called concurrently with another call
+    const Grid<float>& getNutrientGrid() const;
+
+    // Full sweep, meant for summaries rather than per-step use
+    CellCounts countCells() const;
+    // Subdomain: local rows [begin, end) owned by this band, the others are halos
+    size_t getOwnedRowBegin() const;
+    size_t getOwnedRowEnd() const;
+
+    // Moves the grids out, e.g. to reuse their memory for the next run.
+    // The simulation must not be stepped afterwards.
+    void releaseGrids(Grid<CellState>& cellGrid, Grid<float>& nutrientGrid);
 };
 
+// The original model: 4-neighbour stencil, nutrient source on the border,
+// daughters on a random empty side. Checkpoints, the viewer, export and
+// domain decomposition work with this one.
+using CellularAutomata = BasicCellularAutomata<VonNeumann, DirichletSource, RandomNeighbor>;
+
+// Cells per state over a whole grid
+CellCounts countCells(const Grid<CellState>& cellGrid);
+
 class SimulationBuilder
 {
-    std::array<std::array<CellState, GRID_SIZE>, GRID_SIZE>& cellGrid;
-    std::array<std::array<float, GRID_SIZE>, GRID_SIZE>& nutrientGrid;
+    // Grids the builder owns, see the constructors
+    struct OwnedGrids
+    {
+        Grid<CellState> cells;
+        Grid<float> nutrients;
+    };
+    std::shared_ptr<OwnedGrids> owned;
+    // The grids to start from, borrowed or owned
+    const Grid<CellState>* cellGrid;
+    const Grid<float>* nutrientGrid;
     float diffusionSpeed = 0.06f;
     float initNutrient = 0.65f;
     float deathThreshold = 0.20f;
     float divideThreshold = 0.60f;
     float divideCost = 0.12f;
+    float consumptionRate = 0.0f;
+    DivisionMode divisionMode = DivisionMode::Sequential;
+    NutrientSolverOptions nutrientSolver;
+    std::optional<uint64_t> seed; // drawn from std::random_device when unset
+    EngineOptions engine; // SIMD level defaults to the best supported one
 
-    // Error check
-    bool hasCellGrid = false;
-    bool hasNutrientGrid = false;
+    void checkGrids() const;
+    template <typename Neighborhood, typename Boundary, typename DivisionRule>
+    BasicCellularAutomata<Neighborhood, Boundary, DivisionRule> buildFrom(Grid<CellState>&& cells, Grid<float>&& nutrients) const;
 public:
-    // Constructor
+    // Fills both grids of a builder in place
+    using GridInitializer = std::function<void(Grid<CellState>& cells, Grid<float>& nutrients)>;
+
+    // Borrows the grids, every build() copies them
+    SimulationBuilder(
+        const Grid<CellState>& cellGrid,
+        const Grid<float>& nutrientGrid
+    );
+    // Takes the grids over. Copies of the builder share them, and build()
+    // on an rvalue builder (std::move(builder).build()) that is their only
+    // owner moves them into the simulation without a copy, after which it
+    // cannot build again.
     SimulationBuilder(
-        std::array<std::array<CellState, GRID_SIZE>, GRID_SIZE>& cellGrid,
-        std::array<std::array<float, GRID_SIZE>, GRID_SIZE>& nutrientGrid
+        Grid<CellState>&& cellGrid,
+        Grid<float>&& nutrientGrid
     );
+    // Allocates width x height grids and lets initialize() write the initial
+    // state straight into them, then owns them like the constructor above
+    SimulationBuilder(size_t width, size_t height, const GridInitializer& initialize);
 
     // Options
     SimulationBuilder& setDiffusionSpeed(float diffusionSpeed);    
@@ -91,7 +368,34 @@ public:
     SimulationBuilder& setDeathThreshold(float deathThreshold);
     SimulationBuilder& setDivideThreshold(float divideThreshold);
     SimulationBuilder& setDivisionCost(float divideCost);
+    // Nutrient every Alive or Quiescent cell draws per step, after diffusion
+    SimulationBuilder& setConsumptionRate(float consumptionRate);
+    SimulationBuilder& setDivisionMode(DivisionMode divisionMode);
+    // Implicit or steady-state nutrients instead of one explicit step per epoch
+    SimulationBuilder& setNutrientSolver(const NutrientSolverOptions& nutrientSolver);
+    SimulationBuilder& setSeed(uint64_t seed);
+    SimulationBuilder& setSimdLevel(SimdLevel simdLevel);
+    SimulationBuilder& setThreads(size_t threads);
+    SimulationBuilder& setTileSize(size_t tileSize);
+    SimulationBuilder& setActiveRegionTolerance(float tolerance);
+    SimulationBuilder& setInstrumentation(bool enabled);
+    // Off runs step() as three separate phases, for comparison
+    SimulationBuilder& setFusedStep(bool enabled);
+    SimulationBuilder& setNutrientPrecision(NutrientPrecision precision);
+    std::optional<uint64_t> getSeed() const;
+    // Of the cell grid
+    size_t getWidth() const;
+    size_t getHeight() const;
 
-    // Builder
-    CellularAutomata build() const;
+    // Builder, e.g. build<Moore, Periodic>() for other policies. Copies
+    // the grids and leaves the builder as it is.
+    template <typename Neighborhood = VonNeumann, typename Boundary = DirichletSource, typename DivisionRule = RandomNeighbor>
+    BasicCellularAutomata<Neighborhood, Boundary, DivisionRule> build() const &;
+    // Same, moving owned grids in when no copy of the builder shares them
+    template <typename Neighborhood = VonNeumann, typename Boundary = DirichletSource, typename DivisionRule = RandomNeighbor>
+    BasicCellularAutomata<Neighborhood, Boundary, DivisionRule> build() &&;
+    // Rows [rowBegin, rowEnd) of the grids as one band of a decomposed run
+    // (see domain.hpp), with halo rows copied in. Needs a seed, so that
+    // every band draws the same random numbers.
+    CellularAutomata buildSubdomain(size_t rowBegin, size_t rowEnd, HaloTransport& transport) const;
 };
\ No newline at end of file
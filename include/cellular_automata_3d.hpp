@@ -0,0 +1,155 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <cellular_automata.hpp>
+#include <grid3d.hpp>
+
+// 3D variant of CellularAutomata: the same state rules on a volume, with
+// nutrients diffusing over the 6 face neighbours (von Neumann) and daughters
+// placed on one of them. The outer faces are refilled with MAX_NUTRIENT and
+// never updated, like the border of a 2D grid. Work is handed to the thread
+// pool one Grid3D brick at a time.
+class CellularAutomata3D
+{
+private:
+    // RNG
+    const uint64_t seed;
+    std::mt19937 gen;
+    const Philox4x32 counterRng;
+
+    // Simulation parameters
+    const float diffusionSpeed;
+    const float deathThreshold;
+    const float divideThreshold;
+    const float divideCost;
+    const DivisionMode divisionMode;
+
+    // Execution
+    const SimdLevel simdLevel;
+    const DiffusionRowKernel3D diffuseRow;
+    const CellUpdateKernel updateRow;
+    std::unique_ptr<ThreadPool> pool;
+
+    // Grids
+    size_t width;
+    size_t height;
+    size_t depth;
+    Grid3D<CellState> cellGrid;
+    Grid3D<float> nutrientGrid;
+    Grid3D<float> nextNutrientGrid; // diffusion target, swapped with nutrientGrid
+
+    // Cells left Alive by the update, per brick and, for the sequential
+    // division, over the whole volume. Stored as (z * height + y, x).
+    std::vector<std::vector<std::pair<int, int>>> brickAliveCells;
+    std::vector<std::pair<int, int>> aliveCells;
+
+    // Deterministic division, as in CellularAutomata
+    struct DivisionClaim
+    {
+        int x, y, z;        // parent
+        int tx, ty, tz;     // target
+        uint64_t key;
+    };
+    Grid3D<uint64_t> divisionClaims;
+    std::vector<std::vector<DivisionClaim>> brickClaims;
+
+    // Completed steps
+    uint64_t epoch = 0;
+
+    void diffuseBrick(size_t index);
+    void updateBrick(size_t index);
+    void gatherAliveCells();
+    void divideCellsSequential();
+    void claimDivisions(size_t index);
+    void commitDivisions(size_t index);
+public:
+    // Grids passed as rvalues are adopted without copying. Only the SIMD
+    // level and thread count of engine apply to volumes.
+    CellularAutomata3D(
+        Grid3D<CellState> cellGrid,
+        Grid3D<float> nutrientGrid,
+        float diffusionSpeed,
+        float deathThreshold,
+        float divideThreshold,
+        float divideCost,
+        DivisionMode divisionMode,
+        uint64_t seed,
+        const EngineOptions& engine = {}
+    );
+    void diffuseNutrients();
+    void updateCells();
+    // Also advances the epoch
+    void divideCells();
+    // diffuseNutrients(), updateCells(), divideCells()
+    void step();
+
+    size_t getWidth() const;
+    size_t getHeight() const;
+    size_t getDepth() const;
+    uint64_t getEpoch() const;
+    uint64_t getSeed() const;
+    DivisionMode getDivisionMode() const;
+    SimdLevel getSimdLevel() const;
+    size_t getThreadCount() const;
+    const Grid3D<CellState>& getCellGrid() const;
+    const Grid3D<float>& getNutrientGrid() const;
+
+    // Full sweep, meant for summaries rather than per-step use
+    CellCounts countCells() const;
+};
+
+class SimulationBuilder3D
+{
+    // Grids the builder owns, as in SimulationBuilder
+    struct OwnedGrids
+    {
+        Grid3D<CellState> cells;
+        Grid3D<float> nutrients;
+    };
+    std::shared_ptr<OwnedGrids> owned;
+    const Grid3D<CellState>* cellGrid;
+    const Grid3D<float>* nutrientGrid;
+    float diffusionSpeed = 0.06f;
+    float deathThreshold = 0.20f;
+    float divideThreshold = 0.60f;
+    float divideCost = 0.12f;
+    DivisionMode divisionMode = DivisionMode::Sequential;
+    std::optional<uint64_t> seed; // drawn from std::random_device when unset
+    EngineOptions engine; // SIMD level defaults to the best supported one
+
+    void checkGrids() const;
+    CellularAutomata3D buildFrom(Grid3D<CellState>&& cells, Grid3D<float>&& nutrients) const;
+public:
+    // Borrows the grids, every build() copies them
+    SimulationBuilder3D(
+        const Grid3D<CellState>& cellGrid,
+        const Grid3D<float>& nutrientGrid
+    );
+    // Takes the grids over, shared by copies of the builder and moved
+    // into the simulation as in SimulationBuilder
+    SimulationBuilder3D(
+        Grid3D<CellState>&& cellGrid,
+        Grid3D<float>&& nutrientGrid
+    );
+
+    // Options
+    SimulationBuilder3D& setDiffusionSpeed(float diffusionSpeed);
+    SimulationBuilder3D& setDeathThreshold(float deathThreshold);
+    SimulationBuilder3D& setDivideThreshold(float divideThreshold);
+    SimulationBuilder3D& setDivisionCost(float divideCost);
+    SimulationBuilder3D& setDivisionMode(DivisionMode divisionMode);
+    SimulationBuilder3D& setSeed(uint64_t seed);
+    SimulationBuilder3D& setSimdLevel(SimdLevel simdLevel);
+    SimulationBuilder3D& setThreads(size_t threads);
+
+    // Builder, copies the grids
+    CellularAutomata3D build() const &;
+    // Moves owned grids in when no copy of the builder shares them
+    CellularAutomata3D build() &&;
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#include <cellular_automata.hpp>
+
+constexpr uint32_t CHECKPOINT_VERSION = 4;
+
+// Grid payloads start on page boundaries so they can be mapped in place:
+// 64 KiB covers the 4K, 16K and 64K pages of x86-64, arm64 and ppc64le.
+// Version 3 and older files are aligned to 4 KiB.
+constexpr uint64_t CHECKPOINT_PAYLOAD_ALIGNMENT = 65536;
+constexpr uint64_t CHECKPOINT_V3_PAYLOAD_ALIGNMENT = 4096;
+
+// On-disk header, followed by the RNG state and the two grid payloads at
+// the given offsets. Grid payloads are raw Grid storage, row padding included.
+struct CheckpointHeader
+{
+    char magic[8];          // "CASNAP\0\0"
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t width;
+    uint64_t height;
+    uint64_t epoch;
+    uint64_t seed;
+    float diffusionSpeed;
+    float deathThreshold;
+    float divideThreshold;
+    float divideCost;
+    uint32_t divisionMode;
+    uint32_t cellStateSize;
+    uint64_t rngOffset;
+    uint64_t rngSize;
+    uint64_t cellOffset;
+    uint64_t cellSize;
+    uint64_t nutrientOffset;
+    uint64_t nutrientSize;
+    // Version 2
+    uint32_t nutrientSolver;
+    uint32_t solverMaxCycles;
+    float solverTimeStep;
+    float solverTolerance;
+    // Version 3
+    float consumptionRate;
+    // Version 4, was zero padding before
+    uint32_t nutrientPrecision;
+};
+
+// Versioned binary snapshot of a whole simulation
+class Checkpoint
+{
+private:
+    std::string path;
+    CheckpointHeader header;
+    std::string rngState;
+public:
+    // Writes a snapshot of sim to path. The file is written next to path
+    // and renamed into place, so a crash never leaves a truncated snapshot.
+    static void save(const CellularAutomata& sim, const std::string& path);
+
+    // Reads and validates the header, throws std::runtime_error on bad files
+    explicit Checkpoint(const std::string& path);
+
+    const CheckpointHeader& getHeader() const;
+
+    // Grids backed by a private copy-on-write mapping of the file: nothing
+    // is read until it is touched, and writes never reach the file. Where
+    // the payloads are not on page boundaries they are read instead.
+    Grid<CellState> mapCellGrid() const;
+    Grid<float> mapNutrientGrid() const;
+
+    // Continues the saved run exactly. Each call maps the grids again, so
+    // many independent experiments can be forked from one snapshot; a new
+    // seed gives each fork its own random stream. The nutrient precision
+    // is the stored one, whatever engine asks for.
+    CellularAutomata restore(const EngineOptions& engine = {}, std::optional<uint64_t> seed = {}) const;
+};
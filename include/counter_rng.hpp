@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+// Philox4x32-10 counter-based generator (Salmon et al., SC'11). The output is
+// a pure function of (key, counter), so every cell can draw its own random
+// numbers in any order, on any thread, and get the same values.
+class Philox4x32
+{
+public:
+    using Counter = std::array<uint32_t, 4>;
+
+private:
+    static constexpr uint32_t MULTIPLIER_0 = 0xD2511F53u;
+    static constexpr uint32_t MULTIPLIER_1 = 0xCD9E8D57u;
+    static constexpr uint32_t WEYL_0 = 0x9E3779B9u;
+    static constexpr uint32_t WEYL_1 = 0xBB67AE85u;
+
+    uint32_t key0;
+    uint32_t key1;
+
+public:
+    explicit Philox4x32(uint64_t seed)
+        : key0(uint32_t(seed)),
+          key1(uint32_t(seed >> 32))
+    {}
+
+    Counter operator()(Counter counter) const
+    {
+        uint32_t k0 = key0, k1 = key1;
+        for (int round = 0; round < 10; round++)
+        {
+            uint64_t product0 = uint64_t(MULTIPLIER_0) * counter[0];
+            uint64_t product1 = uint64_t(MULTIPLIER_1) * counter[2];
+            counter = {
+                uint32_t(product1 >> 32) ^ counter[1] ^ k0,
+                uint32_t(product1),
+                uint32_t(product0 >> 32) ^ counter[3] ^ k1,
+                uint32_t(product0),
+            };
+            k0 += WEYL_0;
+            k1 += WEYL_1;
+        }
+        return counter;
+    }
+
+    // Random numbers of cell (i, j) at a given epoch
+    Counter operator()(uint64_t epoch, uint32_t i, uint32_t j) const
+    {
+        return (*this)(Counter{ uint32_t(epoch), uint32_t(epoch >> 32), i, j });
+    }
+
+    // Random numbers of voxel (x, y, z) at a given epoch. Only the low 32
+    // bits of the epoch count, so the stream repeats after 2^32 epochs.
+    Counter operator()(uint64_t epoch, uint32_t x, uint32_t y, uint32_t z) const
+    {
+        return (*this)(Counter{ uint32_t(epoch), x, y, z });
+    }
+
+    // Maps a 32-bit draw onto [0, n)
+    static uint32_t below(uint32_t draw, uint32_t n)
+    {
+        return uint32_t((uint64_t(draw) * n) >> 32);
+    }
+};
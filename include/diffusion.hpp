@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+
+#include <grid.hpp>
+#include <simd.hpp>
+
+// Computes the block [rowBegin, rowEnd) x [colBegin, colEnd) of the next
+// nutrient field from src into dst. Border cells inside the block are refilled
+// with MAX_NUTRIENT in the same pass. Every variant produces bit-identical
+// results to the scalar one.
+using DiffusionKernel = void (*)(
+    const Grid<float>& src,
+    Grid<float>& dst,
+    float diffusionSpeed,
+    size_t rowBegin,
+    size_t rowEnd,
+    size_t colBegin,
+    size_t colEnd
+);
+
+DiffusionKernel diffusionKernel(SimdLevel level);
+
+// Same contract, averaging the 8 neighbours (Moore) instead of the 4 sides
+DiffusionKernel mooreDiffusionKernel(SimdLevel level);
+
+// The stencil of the kernels above for inner columns [jBegin, jEnd) of one
+// row, from the row and the rows above and below it into out. Indexed like
+// the grid rows, so out may be a scratch row as wide as the grid.
+using DiffusionRowKernel = void (*)(
+    const float* up,
+    const float* row,
+    const float* down,
+    float* out,
+    size_t jBegin,
+    size_t jEnd,
+    float diffusionSpeed
+);
+
+DiffusionRowKernel diffusionRowKernel(SimdLevel level);
+DiffusionRowKernel mooreDiffusionRowKernel(SimdLevel level);
+
+// 3D counterpart for one inner row: columns [1, width - 1) of out from the
+// row and its four neighbour rows along y (north, south) and z (below,
+// above). The two end columns are left to the caller. Same bit-identical
+// guarantee as above.
+using DiffusionRowKernel3D = void (*)(
+    const float* row,
+    const float* north,
+    const float* south,
+    const float* below,
+    const float* above,
+    float* out,
+    size_t width,
+    float diffusionSpeed
+);
+
+DiffusionRowKernel3D diffusionRowKernel3D(SimdLevel level);
+
+// Whether |a - b| exceeds tolerance anywhere in a block, used to tell settled tiles apart
+bool exceedsTolerance(const Grid<float>& a, const Grid<float>& b, float tolerance, size_t rowBegin, size_t rowEnd, size_t colBegin, size_t colEnd);
+
+struct NutrientSummary
+{
+    float min;
+    float max;
+    double sum;
+};
+
+// Minimum, maximum and sum of a block, cheap enough to run right after the block is diffused
+NutrientSummary summarizeNutrients(const Grid<float>& grid, size_t rowBegin, size_t rowEnd, size_t colBegin, size_t colEnd);
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <cellular_automata.hpp>
+#include <halo_transport.hpp>
+
+// Rows [rowBegin, rowEnd) of the global grid, run by one process
+struct Band
+{
+    size_t rowBegin = 0;
+    size_t rowEnd = 0;
+};
+
+// processes bands covering height rows, top to bottom, whose heights
+// differ by at most one row
+std::vector<Band> splitRows(size_t height, size_t processes);
+
+struct DomainOptions
+{
+    size_t processes = 2;
+    HaloTransportKind transport = HaloTransportKind::SharedMemory;
+};
+
+// The global grids once every band has finished
+struct DomainResult
+{
+    Grid<CellState> cells;
+    Grid<float> nutrients;
+    uint64_t epoch = 0;
+    uint64_t seed = 0;
+    double seconds = 0.0;       // wall time, forking and gathering included
+};
+
+// Runs the builder's simulation for epochs steps with the grid split into
+// row bands, one forked process per band, exchanging halo rows with its
+// neighbours every step. Each process runs the builder's thread count.
+// The result is identical to a single-process run with the same seed,
+// which is drawn here when the builder has none. Needs deterministic
+// division, the explicit nutrient step and no active-region tracking.
+// Forks, so call it before the calling process starts any thread.
+DomainResult runDecomposed(const SimulationBuilder& builder, uint64_t epochs, const DomainOptions& options);
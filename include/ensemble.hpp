@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <cellular_automata.hpp>
+#include <scenarios.hpp>
+#include <thread_pool.hpp>
+
+// One independent run of a sweep
+struct EnsembleJob
+{
+    int scenario = 1;
+    size_t width = 128;
+    size_t height = 128;
+    ScenarioParameters parameters;
+    DivisionMode divisionMode = DivisionMode::Sequential;
+    uint64_t seed = 1;
+    uint64_t epochs = 1000;
+};
+
+// Summary of a finished run
+struct EnsembleResult
+{
+    CellCounts counts;          // final grid
+    size_t divisions = 0;       // over the whole run
+    float nutrientMean = 0.0f;  // after the last diffusion
+    double seconds = 0.0;
+};
+
+// Cartesian product of parameter lists, read from a text file with one
+// "key = values" line per parameter. Values are comma separated, numeric
+// ones may also be given as an inclusive range "start:stop[:step]":
+//
+//   scenario = 1, 2
+//   size = 128            (or 256x128)
+//   epochs = 2000
+//   division = deterministic
+//   diffusion_speed = 0.03:0.09:0.02
+//   death_threshold = 0.18
+//   divide_threshold = 0.5, 0.55, 0.6
+//   division_cost = 0.18
+//   seed = 1:100
+struct SweepSpec
+{
+    std::vector<int> scenarios = { 1 };
+    std::vector<std::pair<size_t, size_t>> sizes = { { 128, 128 } };
+    std::vector<float> diffusionSpeeds = { ScenarioParameters().diffusionSpeed };
+    std::vector<float> deathThresholds = { ScenarioParameters().deathThreshold };
+    std::vector<float> divideThresholds = { ScenarioParameters().divideThreshold };
+    std::vector<float> divisionCosts = { ScenarioParameters().divisionCost };
+    std::vector<uint64_t> seeds = { 1 };
+    uint64_t epochs = 1000;
+    DivisionMode divisionMode = DivisionMode::Sequential;
+
+    static SweepSpec load(const std::string& path);
+
+    // Seeds vary fastest, scenarios slowest
+    std::vector<EnsembleJob> expand() const;
+};
+
+// Runs many small simulations at once, one per worker thread, each of them
+// single threaded. Every worker keeps one engine and restarts it for each
+// job (CellularAutomata::restart()), so a sweep does not allocate per run
+// once the workers have seen each grid size.
+class Ensemble
+{
+private:
+    struct Workspace
+    {
+        std::unique_ptr<CellularAutomata> sim;
+        std::unique_ptr<ThreadPool> scenarioPool;   // one thread, for generate_scenario()
+    };
+
+    const SimdLevel simdLevel;
+    ThreadPool pool;
+    std::vector<Workspace> workspaces;
+
+    EnsembleResult runJob(const EnsembleJob& job, Workspace& workspace);
+public:
+    // 0 threads means one per hardware thread
+    explicit Ensemble(size_t threads = 0, SimdLevel simdLevel = detectSimdLevel());
+
+    size_t getThreadCount() const;
+
+    // results[i] belongs to jobs[i]. onResult sees every run as it finishes,
+    // one call at a time, in completion order.
+    std::vector<EnsembleResult> run(
+        const std::vector<EnsembleJob>& jobs,
+        const std::function<void(size_t index, const EnsembleResult& result)>& onResult = {}
+    );
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+
+#include <cellular_automata.hpp>
+
+// Colour of a cell state, as 0xAARRGGBB
+uint32_t cellColor(CellState state);
+
+// Colour of an empty cell under the nutrient overlay: a dark grey ramp,
+// dim enough for the cell colours to stay readable on top of it
+uint32_t nutrientColor(float nutrient);
+
+// Colour the cell grid into a row-major width * height pixel buffer
+void renderFrame(const Grid<CellState>& cellGrid, uint32_t* pixels);
+
+struct RenderOptions
+{
+    size_t maxWidth = 1280;     // larger grids are downscaled to fit
+    size_t maxHeight = 960;
+    bool nutrients = false;     // nutrient overlay under the empty cells
+};
+
+// Incremental version of renderFrame() for a viewer. Grids larger than
+// maxWidth x maxHeight are shrunk by an integer factor, each pixel averaging
+// the colours of its block. compose() only recolours the pixel rows whose
+// source rows changed since the previous call, so it keeps a copy of the
+// grids it last drew.
+class FrameComposer
+{
+private:
+    size_t gridWidth;
+    size_t gridHeight;
+    size_t scale;
+    size_t width;
+    size_t height;
+
+    Grid<CellState> drawnCells;
+    Grid<float> drawnNutrients;
+    bool drawn = false;
+    bool drawnOverlay = false;
+
+    void composeRow(size_t y, const Grid<CellState>& cells, const Grid<float>* nutrients, uint32_t* pixels) const;
+public:
+    FrameComposer(size_t gridWidth, size_t gridHeight, size_t maxWidth, size_t maxHeight);
+
+    // Size of the pixel buffer
+    size_t getWidth() const { return width; }
+    size_t getHeight() const { return height; }
+    // Cells per pixel along each axis
+    size_t getScale() const { return scale; }
+
+    // nutrients, when given, are drawn under the empty cells. Returns the
+    // number of pixel rows recoloured.
+    size_t compose(const Grid<CellState>& cells, const Grid<float>* nutrients, uint32_t* pixels);
+};
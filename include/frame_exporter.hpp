@@ -0,0 +1,86 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <cellular_automata.hpp>
+
+enum class ExportFormat
+{
+    PPM,    // image sequence: cells as PPM, nutrients as 16-bit PGM
+    PNG,    // image sequence: cells as RGB PNG, nutrients as 16-bit grey PNG
+    Raw,    // one streaming container with raw states and float nutrients
+};
+
+ExportFormat parseExportFormat(const std::string& name);
+
+struct ExportOptions
+{
+    std::string prefix = "frame";   // file name prefix, may include a directory
+    ExportFormat format = ExportFormat::PPM;
+    bool cells = true;
+    bool nutrients = false;
+    size_t queueDepth = 4;          // snapshots waiting for the writer
+    bool dropWhenFull = false;      // drop instead of waiting when the queue is full
+};
+
+struct ExportStats
+{
+    uint64_t written = 0;
+    uint64_t dropped = 0;           // queue full, snapshot discarded
+    uint64_t delayed = 0;           // queue full, step() waited for the writer
+    double delaySeconds = 0.0;      // total time step() spent waiting
+};
+
+// Records frames without stalling the simulation: submit() copies the grids
+// into a recycled buffer and hands it to a background writer thread. It only
+// blocks (or drops, see ExportOptions) when queueDepth snapshots are pending.
+class FrameExporter
+{
+private:
+    struct Snapshot
+    {
+        uint64_t epoch = 0;
+        Grid<CellState> cells;
+        Grid<float> nutrients;
+    };
+
+    const ExportOptions options;
+    std::vector<std::unique_ptr<Snapshot>> pool;
+    std::vector<Snapshot*> freeSnapshots;
+    std::deque<Snapshot*> pending;
+    Snapshot* writing = nullptr;
+
+    mutable std::mutex mutex;
+    std::condition_variable snapshotReady;
+    std::condition_variable snapshotFree;
+    bool stopping = false;
+    std::exception_ptr failure;     // first writer error, rethrown by submit()/flush()
+    ExportStats stats;
+
+    std::ofstream stream;           // Raw format only
+    std::thread writer;
+
+    void writerLoop();
+    void write(const Snapshot& snapshot);
+public:
+    FrameExporter(size_t width, size_t height, const ExportOptions& options);
+    // Writes everything still queued
+    ~FrameExporter();
+
+    FrameExporter(const FrameExporter&) = delete;
+    FrameExporter& operator=(const FrameExporter&) = delete;
+
+    void submit(const CellularAutomata& sim);
+    // Waits until every submitted snapshot has been written
+    void flush();
+    ExportStats getStats() const;
+};
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Every row starts on a cache line boundary
+constexpr std::size_t GRID_ALIGNMENT = 64;
+
+// Runtime-sized 2D grid stored in one contiguous, aligned heap allocation.
+// Rows are padded to GRID_ALIGNMENT bytes, so use getStride() (in elements)
+// when walking the raw storage. A grid can also adopt storage it does not
+// allocate itself (e.g. a memory-mapped snapshot), see adopt().
+template <typename T>
+class Grid
+{
+    static_assert(std::is_trivially_copyable_v<T>, "Grid cells must be trivially copyable");
+    static_assert(GRID_ALIGNMENT % sizeof(T) == 0, "Grid cells must evenly divide the row alignment");
+
+    struct AlignedDelete
+    {
+        void operator()(T* ptr) const
+        {
+            ::operator delete[](static_cast<void*>(ptr), std::align_val_t(GRID_ALIGNMENT));
+        }
+    };
+
+    std::size_t width = 0;
+    std::size_t height = 0;
+    std::size_t stride = 0;
+    // Owns (or keeps alive) the storage; always unique to this grid
+    std::shared_ptr<T> cells;
+
+    static std::size_t paddedStride(std::size_t width)
+    {
+        constexpr std::size_t perLine = GRID_ALIGNMENT / sizeof(T);
+        return (width + perLine - 1) / perLine * perLine;
+    }
+
+public:
+    Grid() = default;
+
+    Grid(std::size_t width, std::size_t height)
+        : width(width),
+          height(height),
+          stride(paddedStride(width))
+    {
+        if (stride * height == 0)
+            return;
+
+        void* raw = ::operator new[](stride * height * sizeof(T), std::align_val_t(GRID_ALIGNMENT));
+        cells.reset(static_cast<T*>(raw), AlignedDelete());
+        std::memset(raw, 0, stride * height * sizeof(T));
+    }
+
+    // Wraps storage laid out like a Grid (padded stride, aligned rows) without
+    // copying it. owner keeps the storage alive and is released with the grid;
+    // no other grid may use the same storage.
+    static Grid adopt(std::size_t width, std::size_t height, T* storage, std::shared_ptr<void> owner)
+    {
+        Grid grid;
+        grid.width = width;
+        grid.height = height;
+        grid.stride = paddedStride(width);
+        grid.cells = std::shared_ptr<T>(std::move(owner), storage);
+        return grid;
+    }
+
+    static std::size_t strideFor(std::size_t width)
+    {
+        return paddedStride(width);
+    }
+
+    Grid(std::size_t width, std::size_t height, const T& value)
+        : Grid(width, height)
+    {
+        fill(value);
+    }
+
+    Grid(const Grid& other)
+        : Grid(other.width, other.height)
+    {
+        if (cells)
+            std::memcpy(cells.get(), other.cells.get(), stride * height * sizeof(T));
+    }
+
+    Grid& operator=(const Grid& other)
+    {
+        if (this != &other)
+        {
+            if (width != other.width || height != other.height)
+                *this = Grid(other.width, other.height);
+            if (cells)
+                std::memcpy(cells.get(), other.cells.get(), stride * height * sizeof(T));
+        }
+        return *this;
+    }
+
+    Grid(Grid&& other) noexcept
+        : width(std::exchange(other.width, 0)),
+          height(std::exchange(other.height, 0)),
+          stride(std::exchange(other.stride, 0)),
+          cells(std::move(other.cells))
+    {}
+
+    Grid& operator=(Grid&& other) noexcept
+    {
+        width = std::exchange(other.width, 0);
+        height = std::exchange(other.height, 0);
+        stride = std::exchange(other.stride, 0);
+        cells = std::move(other.cells);
+        return *this;
+    }
+
+    std::size_t getWidth() const { return width; }
+    std::size_t getHeight() const { return height; }
+    std::size_t getStride() const { return stride; }
+    bool empty() const { return cells == nullptr; }
+
+    T* data() { return cells.get(); }
+    const T* data() const { return cells.get(); }
+
+    // Row access, so cells can be addressed as grid[i][j]
+    T* operator[](std::size_t row) { return cells.get() + row * stride; }
+    const T* operator[](std::size_t row) const { return cells.get() + row * stride; }
+
+    void fill(const T& value)
+    {
+        for (std::size_t i = 0; i < height; ++i)
+            std::fill_n((*this)[i], width, value);
+    }
+
+    void swap(Grid& other) noexcept
+    {
+        std::swap(width, other.width);
+        std::swap(height, other.height);
+        std::swap(stride, other.stride);
+        std::swap(cells, other.cells);
+    }
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+
+#include <grid.hpp>
+
+// Rows along each edge of a brick, see Grid3D
+constexpr std::size_t BRICK_EDGE = 8;
+
+// Runtime-sized 3D grid of width x height x depth cells. Rows along x are
+// contiguous and padded like Grid rows, but they are grouped into bricks of
+// BRICK_EDGE x BRICK_EDGE rows (y, z) stored back to back: a brick and the
+// rows around it stay in cache while a 6-neighbour stencil sweeps it, where
+// plain z-major planes would be evicted between the z - 1 and z + 1 reads.
+// Bricks are ordered z-major, and so are the rows inside a brick.
+template <typename T>
+class Grid3D
+{
+    std::size_t width = 0;
+    std::size_t height = 0;
+    std::size_t depth = 0;
+    std::size_t bricksY = 0;
+    std::size_t bricksZ = 0;
+    // One Grid row per brick row, bricks rounded up to whole bricks
+    Grid<T> rows;
+
+    static std::size_t bricksFor(std::size_t cells)
+    {
+        return (cells + BRICK_EDGE - 1) / BRICK_EDGE;
+    }
+
+    std::size_t rowIndex(std::size_t y, std::size_t z) const
+    {
+        const std::size_t brick = (z / BRICK_EDGE) * bricksY + y / BRICK_EDGE;
+        return brick * BRICK_EDGE * BRICK_EDGE + (z % BRICK_EDGE) * BRICK_EDGE + y % BRICK_EDGE;
+    }
+
+public:
+    // Rows [yBegin, yEnd) x [zBegin, zEnd) of one brick, clipped to the grid
+    struct Brick
+    {
+        std::size_t yBegin;
+        std::size_t yEnd;
+        std::size_t zBegin;
+        std::size_t zEnd;
+    };
+
+    Grid3D() = default;
+
+    Grid3D(std::size_t width, std::size_t height, std::size_t depth)
+        : width(width),
+          height(height),
+          depth(depth),
+          bricksY(bricksFor(height)),
+          bricksZ(bricksFor(depth)),
+          rows(width, bricksY * bricksZ * BRICK_EDGE * BRICK_EDGE)
+    {}
+
+    Grid3D(std::size_t width, std::size_t height, std::size_t depth, const T& value)
+        : Grid3D(width, height, depth)
+    {
+        fill(value);
+    }
+
+    std::size_t getWidth() const { return width; }
+    std::size_t getHeight() const { return height; }
+    std::size_t getDepth() const { return depth; }
+    bool empty() const { return rows.empty(); }
+
+    // Row (y, z), width cells along x
+    T* row(std::size_t y, std::size_t z) { return rows[rowIndex(y, z)]; }
+    const T* row(std::size_t y, std::size_t z) const { return rows[rowIndex(y, z)]; }
+
+    T& at(std::size_t x, std::size_t y, std::size_t z) { return row(y, z)[x]; }
+    const T& at(std::size_t x, std::size_t y, std::size_t z) const { return row(y, z)[x]; }
+
+    // Bricks in storage order, the unit of work of a sweep
+    std::size_t getBrickCount() const { return bricksY * bricksZ; }
+    std::size_t getBricksY() const { return bricksY; }
+    std::size_t getBricksZ() const { return bricksZ; }
+
+    Brick brick(std::size_t index) const
+    {
+        const std::size_t by = index % bricksY, bz = index / bricksY;
+        return {
+            by * BRICK_EDGE, std::min(height, (by + 1) * BRICK_EDGE),
+            bz * BRICK_EDGE, std::min(depth, (bz + 1) * BRICK_EDGE)
+        };
+    }
+
+    void fill(const T& value)
+    {
+        rows.fill(value);
+    }
+
+    void swap(Grid3D& other) noexcept
+    {
+        std::swap(width, other.width);
+        std::swap(height, other.height);
+        std::swap(depth, other.depth);
+        std::swap(bricksY, other.bricksY);
+        std::swap(bricksZ, other.bricksZ);
+        rows.swap(other.rows);
+    }
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+enum class HaloSide
+{
+    Up,     // the band above (lower global rows)
+    Down,   // the band below
+};
+
+enum class HaloTransportKind
+{
+    SharedMemory,   // one shared mapping, a mailbox per direction of every link
+    Socket,         // a Unix domain socket pair per link
+};
+
+// "shm" or "socket"
+HaloTransportKind parseHaloTransport(const std::string& name);
+const char* haloTransportName(HaloTransportKind kind);
+
+// One process's ends of the links to the bands above and below it
+class HaloTransport
+{
+public:
+    virtual ~HaloTransport() = default;
+
+    // Sends size bytes to the neighbour on side and receives as many from
+    // it. Both processes call it with the same size; blocks until done.
+    virtual void exchange(HaloSide side, const void* send, void* receive, size_t size) = 0;
+};
+
+// The links between every pair of adjacent bands. Made before forking, so
+// every process inherits them, then each process attaches to its own ends.
+class HaloLinks
+{
+public:
+    virtual ~HaloLinks() = default;
+
+    // In the process running band rank, after forking
+    virtual std::unique_ptr<HaloTransport> attach(size_t rank) = 0;
+};
+
+// maxMessage bounds the size of a single exchange
+std::unique_ptr<HaloLinks> makeHaloLinks(HaloTransportKind kind, size_t processes, size_t maxMessage);
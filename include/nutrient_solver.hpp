@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <grid.hpp>
+#include <thread_pool.hpp>
+
+enum class NutrientSolver
+{
+    Explicit,       // one explicit diffusion step per epoch (the classic model)
+    Implicit,       // one backward Euler step covering timeStep epochs
+    SteadyState,    // equilibrium of the field for the current cells
+};
+
+// "explicit", "implicit" or "steady"
+NutrientSolver parseNutrientSolver(const std::string& name);
+const char* nutrientSolverName(NutrientSolver solver);
+
+struct NutrientSolverOptions
+{
+    NutrientSolver solver = NutrientSolver::Explicit;
+    float timeStep = 100.0f;    // Implicit: epochs covered by each step
+    float tolerance = 1e-5f;    // stop once a V-cycle changes no cell by more, in nutrient units
+    size_t maxCycles = 30;      // multigrid V-cycles per step
+};
+
+// Geometric multigrid for the implicit and steady-state nutrient field.
+// Solves, for the inner cells of u (the border stays at MAX_NUTRIENT),
+//
+//   (shift + uptake) u - alpha * (sum of the 4 neighbours - 4 u) = shift * previous
+//
+// where alpha = diffusionSpeed / 4 is the per-epoch coupling of the explicit
+// model, shift = 1 / timeStep (0 for the steady state) and uptake is an
+// optional per-cell first-order consumption rate. Red-black Gauss-Seidel
+// smoothing, full-weighting restriction, bilinear prolongation; coarse
+// levels are rediscretised on their actual point positions, so any grid
+// size works. The matrix is an M-matrix, so the exact solution stays within
+// [0, 1]; the iterate stops at the tolerance and may leave it by as much.
+class MultigridSolver
+{
+private:
+    struct Level
+    {
+        size_t width;
+        size_t height;
+        // Coupling to each neighbour per column / row, 1 / spacing^2 in fine
+        // cells; only the last interval of a coarse level may be shorter
+        std::vector<float> west, east, north, south;
+        Grid<float> u;          // unused on the finest level (the caller's grid)
+        Grid<float> f;
+        Grid<float> r;
+        const Grid<float>* uptake = nullptr;
+        Grid<float> coarseUptake;   // restricted from the finer level
+    };
+
+    std::vector<Level> levels;
+    Grid<float> iterate;    // the fine field before the current V-cycle
+    ThreadPool* pool = nullptr;
+    float alpha = 0.0f;
+    float shift = 0.0f;
+
+    void smooth(Level& level, Grid<float>& u, size_t sweeps);
+    // Residual into level.r, returns the largest |residual / diagonal|
+    float residual(Level& level, const Grid<float>& u);
+    void restrictResidual(const Level& fine, Level& coarse);
+    void prolongate(const Level& coarse, Level& fine, Grid<float>& u);
+    void cycle(size_t depth, Grid<float>& u);
+    // rows(begin, end, chunk) over the inner rows, in parallel chunks
+    void forRows(const Level& level, const std::function<void(size_t, size_t, size_t)>& rows);
+public:
+    MultigridSolver(size_t width, size_t height);
+
+    // Solves in place, starting from the values already in u. previous is only
+    // read with shift > 0 and may alias u. Returns the V-cycles used, 0 when u
+    // already met the tolerance. change receives the largest update made by
+    // the last V-cycle (or the largest Jacobi correction when none ran).
+    size_t solve(
+        Grid<float>& u,
+        const Grid<float>& previous,
+        const Grid<float>* uptake,
+        float diffusionSpeed,
+        const NutrientSolverOptions& options,
+        ThreadPool& pool,
+        float& change
+    );
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <diffusion.hpp>
+#include <grid.hpp>
+#include <simd.hpp>
+
+// How the nutrient field is stored between passes. Arithmetic is always
+// done in float, only the grids in memory are narrowed.
+enum class NutrientPrecision
+{
+    Float32,    // one float per cell
+    Fixed16,    // Q1.15 fixed point, half the memory traffic
+};
+
+// "float32" or "fixed16"
+NutrientPrecision parseNutrientPrecision(const std::string& name);
+const char* nutrientPrecisionName(NutrientPrecision precision);
+
+// Fixed16 stores value * FIXED16_ONE. A power of two, so unpacking is exact
+// and 0 and MAX_NUTRIENT round-trip; the step is about 3e-5.
+constexpr float FIXED16_ONE = 32768.0f;
+
+// Nearest fixed-point value of value clamped to [0, 1], NaN gives 0
+inline uint16_t packNutrient(float value)
+{
+    if (!(value > 0.0f)) value = 0.0f;
+    if (value > 1.0f) value = 1.0f;
+    return uint16_t(int32_t(value * FIXED16_ONE + 0.5f));
+}
+
+inline float unpackNutrient(uint16_t packed)
+{
+    return float(packed) * (1.0f / FIXED16_ONE);
+}
+
+// Converts count consecutive cells. Every variant gives the same bits as
+// packNutrient() and unpackNutrient().
+using NutrientPackKernel = void (*)(const float* values, uint16_t* packed, size_t count);
+using NutrientUnpackKernel = void (*)(const uint16_t* packed, float* values, size_t count);
+
+NutrientPackKernel nutrientPackKernel(SimdLevel level);
+NutrientUnpackKernel nutrientUnpackKernel(SimdLevel level);
+
+// summarizeNutrients() of a packed block, in exact integer arithmetic
+NutrientSummary summarizePackedNutrients(const Grid<uint16_t>& grid, size_t rowBegin, size_t rowEnd, size_t colBegin, size_t colEnd);
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include <cellular_automata.hpp>
+#include <frame.hpp>
+
+struct mfb_window;
+
+struct RenderStats
+{
+    uint64_t frames = 0;        // snapshots drawn
+    uint64_t skipped = 0;       // publish() calls made while the window was busy
+    uint64_t redrawnRows = 0;   // pixel rows recoloured over all frames
+};
+
+// MiniFB window showing the cell grid. Kept out of the simulation core
+// so headless builds do not need MiniFB at all.
+//
+// The window stays on the thread that creates it, which has to be the main
+// thread (Cocoa only accepts windows and events there), and run() moves the
+// simulation onto a worker thread, so drawing and vsync never hold up
+// step(). publish() copies the grids into a spare snapshot only when the
+// window has taken the previous one, and otherwise returns at once: frames
+// are skipped rather than queued when the simulation runs ahead.
+class Renderer
+{
+private:
+    struct Snapshot
+    {
+        Grid<CellState> cells;
+        Grid<float> nutrients;
+        bool withNutrients = false;
+    };
+
+    const size_t gridWidth;
+    const size_t gridHeight;
+    FrameComposer composer;             // window thread only
+    std::vector<uint32_t> framebuffer;  // window thread only
+    mfb_window* window;                 // window thread only
+
+    Snapshot incoming;      // filled by publish()
+    Snapshot shown;         // drawn by the window thread
+    bool incomingFree = true;
+    bool incomingReady = false;
+    std::atomic<bool> overlay;
+
+    mutable std::mutex mutex;
+    std::condition_variable changed;
+    bool open = false;
+    bool stopping = false;          // the simulation has returned
+    RenderStats stats;
+
+    void renderLoop();
+public:
+    // Opens the window, throws std::runtime_error when it cannot
+    Renderer(size_t width, size_t height, const RenderOptions& options = {}, const char* title = "Cellular Automata");
+    // Closes the window
+    ~Renderer();
+
+    Renderer(const Renderer&) = delete;
+    Renderer& operator=(const Renderer&) = delete;
+
+    // Runs simulation on a worker thread and the window on this one until
+    // simulation returns; it should stop once publish() returns false.
+    // Rethrows what simulation throws. Call it on the thread that created
+    // the renderer.
+    void run(const std::function<void()>& simulation);
+
+    // Hands the current state to the window if it is ready for a new frame,
+    // returns false once the window has been closed
+    bool publish(const CellularAutomata& sim);
+    bool isOpen() const;
+    RenderStats getStats() const;
+
+    // Draw the nutrient field under the empty cells, from the next frame on
+    void setNutrientOverlay(bool enabled);
+    bool hasNutrientOverlay() const;
+};
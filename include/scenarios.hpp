@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <cellular_automata.hpp>
+#include <cellular_automata_3d.hpp>
+
+// Built-in initial conditions, shared by the simulator and the benchmarks.
+// Each one overwrites pre-sized grids in place, one band of rows per pool
+// task, and derives any randomness from seed, so the result does not depend
+// on the thread count.
+
+constexpr int SCENARIO_COUNT = 6;
+
+// Smallest grid edge every scenario fits on
+constexpr size_t SCENARIO_MIN_SIZE = 11;
+
+// Model parameters the scenarios are tuned for
+struct ScenarioParameters
+{
+    float diffusionSpeed = 0.05f;
+    float deathThreshold = 0.18f;
+    float divideThreshold = 0.55f;
+    float divisionCost = 0.18f;
+    float consumptionRate = 0.0f;
+};
+
+void sim_sparse_noise(Grid<CellState>& cells, Grid<float>& nutrients, uint64_t seed, ThreadPool& pool);
+void sim_radial_tumor(Grid<CellState>& cells, Grid<float>& nutrients, uint64_t seed, ThreadPool& pool);
+void sim_competing_colonies(Grid<CellState>& cells, Grid<float>& nutrients, uint64_t seed, ThreadPool& pool);
+void sim_stripes(Grid<CellState>& cells, Grid<float>& nutrients, uint64_t seed, ThreadPool& pool);
+void sim_traveling_wave(Grid<CellState>& cells, Grid<float>& nutrients, uint64_t seed, ThreadPool& pool);
+void sim_ring(Grid<CellState>& cells, Grid<float>& nutrients, uint64_t seed, ThreadPool& pool);
+
+const char* scenario_name(int id);
+
+// Scenario id (0 to SCENARIO_COUNT - 1), reproducible from the seed, on
+// threads threads (0 = all hardware threads). Throws std::invalid_argument
+// for grids narrower or shorter than SCENARIO_MIN_SIZE.
+void generate_scenario(int id, Grid<CellState>& cells, Grid<float>& nutrients, uint64_t seed, size_t threads = 1);
+// Same on a pool of the caller's, e.g. to reuse one over many runs
+void generate_scenario(int id, Grid<CellState>& cells, Grid<float>& nutrients, uint64_t seed, ThreadPool& pool);
+
+// Initial state from binary PPM/PGM images, sizing the grids to them. Cell
+// pixels in a cellColor() colour (as in exported frames) take that state,
+// other pixels are Alive when brighter than mid grey, except on the outer
+// ring, which stays Empty like every scenario's. The optional greyscale
+// nutrient image maps black to 0 and white to MAX_NUTRIENT; without one the
+// field starts at MAX_NUTRIENT.
+void load_scenario_images(
+    const std::string& cellPath,
+    const std::string& nutrientPath,
+    Grid<CellState>& cells,
+    Grid<float>& nutrients,
+    size_t threads = 1
+);
+
+// Volumes for CellularAutomata3D, same conventions
+constexpr int VOLUME_SCENARIO_COUNT = 2;
+
+void sim_sparse_noise_3d(Grid3D<CellState>& cells, Grid3D<float>& nutrients, uint64_t seed, ThreadPool& pool);
+void sim_spheroid(Grid3D<CellState>& cells, Grid3D<float>& nutrients, uint64_t seed, ThreadPool& pool);
+
+const char* volume_scenario_name(int id);
+
+// Volume scenario id (0 to VOLUME_SCENARIO_COUNT - 1), reproducible from
+// the seed. Throws std::invalid_argument for volumes under SCENARIO_MIN_SIZE
+// cells along any axis.
+void generate_volume_scenario(int id, Grid3D<CellState>& cells, Grid3D<float>& nutrients, uint64_t seed, size_t threads = 1);
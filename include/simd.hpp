@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+
+// Instruction sets with a hand-written kernel, in increasing order
+enum class SimdLevel
+{
+    Scalar,
+    AVX2,
+    AVX512,     // F and BW
+};
+
+// Best level supported by the CPU (and OS) we are running on
+SimdLevel detectSimdLevel();
+
+const char* simdLevelName(SimdLevel level);
+
+// Parses "scalar", "avx2" or "avx512", throws std::invalid_argument otherwise
+SimdLevel parseSimdLevel(const std::string& name);
+
+// Function attribute for kernels built for a specific instruction set
+#if defined(__x86_64__) || defined(_M_X64)
+#define CA_X86_KERNELS 1
+#if defined(__GNUC__)
+#define CA_TARGET(isa) __attribute__((target(isa)))
+#else
+#define CA_TARGET(isa)
+#endif
+#endif
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+
+#include <cellular_automata.hpp>
+
+enum class StatsFormat
+{
+    CSV,    // header line, then one row per step
+    JSONL,  // one JSON object per step
+};
+
+StatsFormat parseStatsFormat(const std::string& name);
+
+// Streams StepStats to a file, one record per write()
+class StatsWriter
+{
+private:
+    std::ofstream out;
+    const StatsFormat format;
+public:
+    StatsWriter(const std::string& path, StatsFormat format);
+
+    void write(const StepStats& stats);
+};
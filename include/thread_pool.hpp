@@ -0,0 +1,61 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent pool of worker threads. parallelFor() hands out task indices
+// in contiguous per-worker ranges; idle workers steal half of the remaining
+// range of a busy one. The calling thread takes part as worker 0, and the
+// call only returns once every task has finished, so each call is a phase
+// with a single synchronisation point at its end.
+class ThreadPool
+{
+public:
+    // task(index, worker), worker is in [0, getThreadCount())
+    using Task = std::function<void(size_t index, size_t worker)>;
+
+private:
+    struct alignas(64) WorkQueue
+    {
+        std::mutex lock;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    size_t threadCount;
+    std::vector<std::thread> workers;
+    std::unique_ptr<WorkQueue[]> queues;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    uint64_t generation = 0;
+    size_t busyWorkers = 0;
+    bool stopping = false;
+    const Task* task = nullptr;
+    std::exception_ptr error;
+
+    void workerLoop(size_t worker);
+    void runTasks(size_t worker);
+    bool takeTask(size_t worker, size_t& index);
+    bool stealTask(size_t worker, size_t& index);
+public:
+    // 0 threads means one per hardware thread
+    explicit ThreadPool(size_t threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t getThreadCount() const;
+
+    // Runs task(i, worker) for every i in [0, count), rethrows the first exception
+    void parallelFor(size_t count, const Task& task);
+};
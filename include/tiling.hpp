@@ -0,0 +1,64 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+// Default edge of a square tile: a float and a state tile of this size
+// together stay well inside a per-core L2 cache
+constexpr size_t DEFAULT_TILE_SIZE = 128;
+
+struct Tile
+{
+    size_t rowBegin;
+    size_t rowEnd;
+    size_t colBegin;
+    size_t colEnd;
+};
+
+// Splits a width x height grid into tiles of tileSize rows and tileWidth
+// columns (square by default), stored row-major: tile (r, c) is at index
+// r * getColumns() + c
+class Tiling
+{
+private:
+    size_t tileSize = DEFAULT_TILE_SIZE;
+    size_t tileWidth = DEFAULT_TILE_SIZE;
+    size_t rows = 0;
+    size_t columns = 0;
+    std::vector<Tile> tiles;
+public:
+    Tiling() = default;
+
+    Tiling(size_t width, size_t height, size_t tileSize)
+        : Tiling(width, height, tileSize, tileSize)
+    {
+    }
+
+    Tiling(size_t width, size_t height, size_t tileSize, size_t tileWidth)
+        : tileSize(tileSize),
+          tileWidth(tileWidth),
+          rows((height + tileSize - 1) / tileSize),
+          columns((width + tileWidth - 1) / tileWidth)
+    {
+        tiles.reserve(rows * columns);
+        for (size_t r = 0; r < rows; r++)
+            for (size_t c = 0; c < columns; c++)
+                tiles.push_back({
+                    r * tileSize, std::min(height, (r + 1) * tileSize),
+                    c * tileWidth, std::min(width, (c + 1) * tileWidth)
+                });
+    }
+
+    size_t getTileSize() const { return tileSize; }
+    size_t getTileWidth() const { return tileWidth; }
+    size_t getRows() const { return rows; }
+    size_t getColumns() const { return columns; }
+    size_t size() const { return tiles.size(); }
+
+    const Tile& operator[](size_t index) const { return tiles[index]; }
+    const Tile& at(size_t row, size_t column) const { return tiles[row * columns + column]; }
+
+    // Index of the tile holding grid cell (i, j)
+    size_t indexOf(size_t i, size_t j) const { return (i / tileSize) * columns + j / tileWidth; }
+};
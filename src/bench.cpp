@@ -0,0 +1,551 @@
+#include <cellular_automata.hpp>
+#include <cellular_automata_3d.hpp>
+#include <frame.hpp>
+#include <scenarios.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// Times every phase of the simulation on the built-in scenarios:
+// diffuseNutrients, updateCells, divideCells and renderFrame one by one,
+// then step() on its own over the same epochs. setup is the scenario
+// generation and build() before that run, per cell rather than per cell
+// update. Volumes (--volumes) go through the same phases, without rendering.
+// The separate phases and the fused step() must end in the same grids, a
+// mismatch exits with code 3.
+
+constexpr const char* PHASES[] = { "diffuse", "update", "divide", "render", "step", "setup" };
+constexpr size_t PHASE_COUNT = 6;
+constexpr size_t SETUP_PHASE = 5;
+
+struct BenchOptions
+{
+    std::vector<size_t> sizes = { 256, 1024, 2048 };
+    std::vector<int> scenarios = { 0, 1, 2, 3, 4, 5 };
+    std::vector<size_t> volumes;    // cube edges, run on every volume scenario
+    uint64_t epochs = 50;
+    uint64_t warmup = 5;
+    size_t repeat = 3;
+    uint64_t seed = 1;
+    SimdLevel simdLevel = detectSimdLevel();
+    size_t threads = 1;
+    size_t tileSize = DEFAULT_TILE_SIZE;
+    DivisionMode divisionMode = DivisionMode::Sequential;
+    std::optional<float> activeTolerance;
+    float consumptionRate = ScenarioParameters().consumptionRate;
+    NutrientPrecision nutrientPrecision = NutrientPrecision::Float32; // 2D grids only
+    std::optional<std::string> jsonPath;
+    std::optional<std::string> csvPath;
+    std::optional<std::string> baselinePath;
+    double maxSlowdown = 0.10;
+};
+
+struct BenchResult
+{
+    std::string scenario;
+    size_t size = 0;
+    std::string phase;
+    double seconds = 0.0;       // fastest repeat, all timed epochs
+    double nsPerCell = 0.0;
+    double cellsPerSecond = 0.0;
+};
+
+void print_usage()
+{
+    std::cout << "Usage: ./build/cellular_automata_bench [options]\n"
+              << "  --sizes LIST        comma separated grid edges (default 256,1024,2048)\n"
+              << "  --scenarios LIST    comma separated scenario ids, 0-5 (default all)\n"
+              << "  --volumes LIST      comma separated cube edges for the 3D scenarios (default none)\n"
+              << "  --epochs N          timed epochs per run (default 50)\n"
+              << "  --warmup N          untimed epochs before timing (default 5)\n"
+              << "  --repeat N          runs per case, the fastest one is kept (default 3)\n"
+              << "  --seed N            scenario and simulation seed (default 1)\n"
+              << "  --simd LEVEL        scalar, avx2 or avx512 (default: best supported)\n"
+              << "  --threads N         worker threads, 0 = all hardware threads (default 1)\n"
+              << "  --tile-size N       edge of the square tiles handed to the workers\n"
+              << "  --division MODE     sequential or deterministic\n"
+              << "  --active-tolerance X  skip steady tiles\n"
+              << "  --consumption X     nutrient each living cell draws per epoch (default 0)\n"
+              << "  --nutrient-precision P  float32 or fixed16 nutrient storage for the 2D grids\n"
+              << "  --json PATH         write the results as JSON\n"
+              << "  --csv PATH          write the results as CSV\n"
+              << "  --baseline PATH     compare with a JSON file from an earlier run\n"
+              << "  --max-slowdown X    relative ns/cell increase flagged as a regression (default 0.10)\n";
+}
+
+template <typename T>
+std::vector<T> parse_list(const std::string& text)
+{
+    std::vector<T> values;
+    std::stringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ','))
+        values.push_back(T(std::stoull(item)));
+    return values;
+}
+
+bool parse_options(int argc, char** argv, BenchOptions& options)
+{
+    for (int a = 1; a < argc; ++a)
+    {
+        std::string arg = argv[a];
+
+        if (arg == "--sizes" && a + 1 < argc)
+            options.sizes = parse_list<size_t>(argv[++a]);
+        else if (arg == "--scenarios" && a + 1 < argc)
+            options.scenarios = parse_list<int>(argv[++a]);
+        else if (arg == "--volumes" && a + 1 < argc)
+            options.volumes = parse_list<size_t>(argv[++a]);
+        else if (arg == "--epochs" && a + 1 < argc)
+            options.epochs = std::stoull(argv[++a]);
+        else if (arg == "--warmup" && a + 1 < argc)
+            options.warmup = std::stoull(argv[++a]);
+        else if (arg == "--repeat" && a + 1 < argc)
+            options.repeat = std::stoul(argv[++a]);
+        else if (arg == "--seed" && a + 1 < argc)
+            options.seed = std::stoull(argv[++a]);
+        else if (arg == "--simd" && a + 1 < argc)
+            options.simdLevel = parseSimdLevel(argv[++a]);
+        else if (arg == "--threads" && a + 1 < argc)
+            options.threads = std::stoul(argv[++a]);
+        else if (arg == "--tile-size" && a + 1 < argc)
+            options.tileSize = std::stoul(argv[++a]);
+        else if (arg == "--division" && a + 1 < argc)
+        {
+            std::string mode = argv[++a];
+            if (mode == "sequential")
+                options.divisionMode = DivisionMode::Sequential;
+            else if (mode == "deterministic")
+                options.divisionMode = DivisionMode::Deterministic;
+            else
+                return false;
+        }
+        else if (arg == "--active-tolerance" && a + 1 < argc)
+            options.activeTolerance = std::stof(argv[++a]);
+        else if (arg == "--consumption" && a + 1 < argc)
+            options.consumptionRate = std::stof(argv[++a]);
+        else if (arg == "--nutrient-precision" && a + 1 < argc)
+            options.nutrientPrecision = parseNutrientPrecision(argv[++a]);
+        else if (arg == "--json" && a + 1 < argc)
+            options.jsonPath = argv[++a];
+        else if (arg == "--csv" && a + 1 < argc)
+            options.csvPath = argv[++a];
+        else if (arg == "--baseline" && a + 1 < argc)
+            options.baselinePath = argv[++a];
+        else if (arg == "--max-slowdown" && a + 1 < argc)
+            options.maxSlowdown = std::stod(argv[++a]);
+        else
+            return false;
+    }
+
+    for (int id : options.scenarios)
+        if (id < 0 || id >= SCENARIO_COUNT)
+            return false;
+    for (size_t size : options.sizes)
+        if (size < 64)
+            return false;
+    for (size_t edge : options.volumes)
+        if (edge < 16)
+            return false;
+    return options.epochs > 0 && options.repeat > 0 && !options.sizes.empty() && !options.scenarios.empty();
+}
+
+CellularAutomata build_simulation(const BenchOptions& options, int scenario, size_t size)
+{
+    SimulationBuilder builder(size, size, [&](Grid<CellState>& cells, Grid<float>& nutrients)
+    {
+        generate_scenario(scenario, cells, nutrients, options.seed, options.threads);
+    });
+    if (options.activeTolerance)
+        builder.setActiveRegionTolerance(*options.activeTolerance);
+
+    ScenarioParameters parameters;
+    builder
+        .setDiffusionSpeed(parameters.diffusionSpeed)
+        .setDeathThreshold(parameters.deathThreshold)
+        .setDivideThreshold(parameters.divideThreshold)
+        .setDivisionCost(parameters.divisionCost)
+        .setConsumptionRate(options.consumptionRate)
+        .setNutrientPrecision(options.nutrientPrecision)
+        .setSimdLevel(options.simdLevel)
+        .setThreads(options.threads)
+        .setTileSize(options.tileSize)
+        .setDivisionMode(options.divisionMode)
+        .setSeed(options.seed);
+    return std::move(builder).build();
+}
+
+CellularAutomata3D build_volume(const BenchOptions& options, int scenario, size_t edge)
+{
+    Grid3D<CellState> cells(edge, edge, edge);
+    Grid3D<float> nutrients(edge, edge, edge);
+    generate_volume_scenario(scenario, cells, nutrients, options.seed, options.threads);
+
+    ScenarioParameters parameters;
+    SimulationBuilder3D builder(std::move(cells), std::move(nutrients));
+    builder
+        .setDiffusionSpeed(parameters.diffusionSpeed)
+        .setDeathThreshold(parameters.deathThreshold)
+        .setDivideThreshold(parameters.divideThreshold)
+        .setDivisionCost(parameters.divisionCost)
+        .setSimdLevel(options.simdLevel)
+        .setThreads(options.threads)
+        .setDivisionMode(options.divisionMode)
+        .setSeed(options.seed);
+    return std::move(builder).build();
+}
+
+using Clock = std::chrono::steady_clock;
+
+// The phases run one by one and step() disagree
+struct MismatchError : std::runtime_error
+{
+    using std::runtime_error::runtime_error;
+};
+
+bool same_grids(const CellularAutomata& a, const CellularAutomata& b)
+{
+    const Grid<CellState>& cellsA = a.getCellGrid();
+    const Grid<CellState>& cellsB = b.getCellGrid();
+    const Grid<float>& nutrientsA = a.getNutrientGrid();
+    const Grid<float>& nutrientsB = b.getNutrientGrid();
+    // Bit for bit, padding excluded
+    for (size_t i = 0; i < a.getHeight(); ++i)
+        if (std::memcmp(cellsA[i], cellsB[i], a.getWidth() * sizeof(CellState)) != 0
+            || std::memcmp(nutrientsA[i], nutrientsB[i], a.getWidth() * sizeof(float)) != 0)
+            return false;
+    return true;
+}
+
+double seconds_since(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Seconds spent in each phase over options.epochs epochs, for one repeat
+std::array<double, PHASE_COUNT> time_phases(const BenchOptions& options, int scenario, size_t size)
+{
+    std::array<double, PHASE_COUNT> seconds{};
+    std::vector<uint32_t> framebuffer(size * size);
+
+    CellularAutomata sim = build_simulation(options, scenario, size);
+    for (uint64_t epoch = 0; epoch < options.warmup; ++epoch)
+        sim.step();
+
+    for (uint64_t epoch = 0; epoch < options.epochs; ++epoch)
+    {
+        auto start = Clock::now();
+        sim.diffuseNutrients();
+        seconds[0] += seconds_since(start);
+
+        start = Clock::now();
+        sim.updateCells();
+        seconds[1] += seconds_since(start);
+
+        start = Clock::now();
+        sim.divideCells();
+        seconds[2] += seconds_since(start);
+
+        start = Clock::now();
+        renderFrame(sim.getCellGrid(), framebuffer.data());
+        seconds[3] += seconds_since(start);
+    }
+
+    // Same epochs again, through step() and without timers in between
+    auto start = Clock::now();
+    CellularAutomata stepped = build_simulation(options, scenario, size);
+    seconds[SETUP_PHASE] = seconds_since(start);
+    for (uint64_t epoch = 0; epoch < options.warmup; ++epoch)
+        stepped.step();
+
+    start = Clock::now();
+    for (uint64_t epoch = 0; epoch < options.epochs; ++epoch)
+        stepped.step();
+    seconds[4] = seconds_since(start);
+
+    if (!same_grids(sim, stepped))
+        throw MismatchError(std::string("step() and the separate phases diverged on ") + scenario_name(scenario)
+                            + " " + std::to_string(size));
+
+    return seconds;
+}
+
+// Same as time_phases() for a volume, render stays at 0
+std::array<double, PHASE_COUNT> time_volume_phases(const BenchOptions& options, int scenario, size_t edge)
+{
+    std::array<double, PHASE_COUNT> seconds{};
+
+    CellularAutomata3D sim = build_volume(options, scenario, edge);
+    for (uint64_t epoch = 0; epoch < options.warmup; ++epoch)
+        sim.step();
+
+    for (uint64_t epoch = 0; epoch < options.epochs; ++epoch)
+    {
+        auto start = Clock::now();
+        sim.diffuseNutrients();
+        seconds[0] += seconds_since(start);
+
+        start = Clock::now();
+        sim.updateCells();
+        seconds[1] += seconds_since(start);
+
+        start = Clock::now();
+        sim.divideCells();
+        seconds[2] += seconds_since(start);
+    }
+
+    auto start = Clock::now();
+    CellularAutomata3D stepped = build_volume(options, scenario, edge);
+    seconds[SETUP_PHASE] = seconds_since(start);
+    for (uint64_t epoch = 0; epoch < options.warmup; ++epoch)
+        stepped.step();
+
+    start = Clock::now();
+    for (uint64_t epoch = 0; epoch < options.epochs; ++epoch)
+        stepped.step();
+    seconds[4] = seconds_since(start);
+
+    return seconds;
+}
+
+void print_result(const BenchResult& result)
+{
+    std::cout << std::left << std::setw(20) << result.scenario
+              << std::right << std::setw(6) << result.size
+              << "  " << std::left << std::setw(8) << result.phase
+              << std::right << std::fixed << std::setprecision(3)
+              << std::setw(10) << result.nsPerCell << " ns/cell"
+              << std::setw(10) << result.cellsPerSecond / 1e6 << " Mcells/s\n"
+              << std::defaultfloat;
+}
+
+std::vector<BenchResult> run_benchmarks(const BenchOptions& options)
+{
+    std::vector<BenchResult> results;
+
+    for (size_t size : options.sizes)
+        for (int scenario : options.scenarios)
+        {
+            std::array<double, PHASE_COUNT> best;
+            best.fill(1e300);
+            for (size_t r = 0; r < options.repeat; ++r)
+            {
+                std::array<double, PHASE_COUNT> seconds = time_phases(options, scenario, size);
+                for (size_t p = 0; p < PHASE_COUNT; ++p)
+                    best[p] = std::min(best[p], seconds[p]);
+            }
+
+            const double cells = double(size) * double(size);
+            for (size_t p = 0; p < PHASE_COUNT; ++p)
+            {
+                const double cellUpdates = p == SETUP_PHASE ? cells : double(options.epochs) * cells;
+                BenchResult result;
+                result.scenario = scenario_name(scenario);
+                result.size = size;
+                result.phase = PHASES[p];
+                result.seconds = best[p];
+                result.nsPerCell = best[p] * 1e9 / cellUpdates;
+                result.cellsPerSecond = best[p] > 0.0 ? cellUpdates / best[p] : 0.0;
+                results.push_back(result);
+                print_result(result);
+            }
+        }
+
+    for (size_t edge : options.volumes)
+        for (int scenario = 0; scenario < VOLUME_SCENARIO_COUNT; ++scenario)
+        {
+            std::array<double, PHASE_COUNT> best;
+            best.fill(1e300);
+            for (size_t r = 0; r < options.repeat; ++r)
+            {
+                std::array<double, PHASE_COUNT> seconds = time_volume_phases(options, scenario, edge);
+                for (size_t p = 0; p < PHASE_COUNT; ++p)
+                    best[p] = std::min(best[p], seconds[p]);
+            }
+
+            const double cells = double(edge) * double(edge) * double(edge);
+            for (size_t p = 0; p < PHASE_COUNT; ++p)
+            {
+                if (std::string(PHASES[p]) == "render")
+                    continue;
+
+                const double cellUpdates = p == SETUP_PHASE ? cells : double(options.epochs) * cells;
+                BenchResult result;
+                result.scenario = volume_scenario_name(scenario);
+                result.size = edge;
+                result.phase = PHASES[p];
+                result.seconds = best[p];
+                result.nsPerCell = best[p] * 1e9 / cellUpdates;
+                result.cellsPerSecond = best[p] > 0.0 ? cellUpdates / best[p] : 0.0;
+                results.push_back(result);
+                print_result(result);
+            }
+        }
+
+    return results;
+}
+
+void write_json(const BenchOptions& options, const std::vector<BenchResult>& results, const std::string& path)
+{
+    std::ofstream out(path);
+    if (!out)
+        throw std::runtime_error("Unable to write " + path);
+
+    out << std::setprecision(9);
+    out << "{\n"
+        << "  \"simd\": \"" << simdLevelName(options.simdLevel) << "\",\n"
+        << "  \"threads\": " << options.threads << ",\n"
+        << "  \"division\": \"" << (options.divisionMode == DivisionMode::Sequential ? "sequential" : "deterministic") << "\",\n"
+        << "  \"nutrient_precision\": \"" << nutrientPrecisionName(options.nutrientPrecision) << "\",\n"
+        << "  \"epochs\": " << options.epochs << ",\n"
+        << "  \"results\": [\n";
+    // One result per line, which is what read_baseline() expects
+    for (size_t r = 0; r < results.size(); ++r)
+    {
+        const BenchResult& result = results[r];
+        out << "    {\"scenario\": \"" << result.scenario << "\", \"size\": " << result.size
+            << ", \"phase\": \"" << result.phase << "\", \"seconds\": " << result.seconds
+            << ", \"ns_per_cell\": " << result.nsPerCell
+            << ", \"cells_per_second\": " << result.cellsPerSecond << "}"
+            << (r + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+}
+
+void write_csv(const std::vector<BenchResult>& results, const std::string& path)
+{
+    std::ofstream out(path);
+    if (!out)
+        throw std::runtime_error("Unable to write " + path);
+
+    out << std::setprecision(9);
+    out << "scenario,size,phase,seconds,ns_per_cell,cells_per_second\n";
+    for (const BenchResult& result : results)
+        out << result.scenario << ',' << result.size << ',' << result.phase << ','
+            << result.seconds << ',' << result.nsPerCell << ',' << result.cellsPerSecond << '\n';
+}
+
+// Value following "key": on a line of a file written by write_json()
+std::optional<std::string> json_field(const std::string& line, const std::string& key)
+{
+    const std::string pattern = "\"" + key + "\": ";
+    size_t start = line.find(pattern);
+    if (start == std::string::npos)
+        return std::nullopt;
+    start += pattern.size();
+
+    if (line[start] == '"')
+        return line.substr(start + 1, line.find('"', start + 1) - start - 1);
+    return line.substr(start, line.find_first_of(",}", start) - start);
+}
+
+using ResultKey = std::tuple<std::string, size_t, std::string>;
+
+std::map<ResultKey, double> read_baseline(const std::string& path)
+{
+    std::ifstream in(path);
+    if (!in)
+        throw std::runtime_error("Unable to open baseline " + path);
+
+    std::map<ResultKey, double> baseline;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        auto scenario = json_field(line, "scenario");
+        auto size = json_field(line, "size");
+        auto phase = json_field(line, "phase");
+        auto nsPerCell = json_field(line, "ns_per_cell");
+        if (scenario && size && phase && nsPerCell)
+            baseline[{ *scenario, std::stoul(*size), *phase }] = std::stod(*nsPerCell);
+    }
+    return baseline;
+}
+
+// Number of results slower than the baseline by more than maxSlowdown
+size_t compare_with_baseline(const std::vector<BenchResult>& results, const std::map<ResultKey, double>& baseline, double maxSlowdown)
+{
+    size_t regressions = 0;
+    size_t compared = 0;
+
+    for (const BenchResult& result : results)
+    {
+        auto it = baseline.find({ result.scenario, result.size, result.phase });
+        if (it == baseline.end() || it->second <= 0.0)
+            continue;
+
+        ++compared;
+        double change = result.nsPerCell / it->second - 1.0;
+        if (change > maxSlowdown)
+        {
+            ++regressions;
+            std::cout << "REGRESSION " << result.scenario << " " << result.size << " " << result.phase << ": "
+                      << result.nsPerCell << " ns/cell vs " << it->second << " (+" << change * 100.0 << "%)\n";
+        }
+    }
+
+    std::cout << "Compared " << compared << " results with the baseline, "
+              << regressions << " regression(s)\n";
+    return regressions;
+}
+
+int main(int argc, char** argv)
+{
+    BenchOptions options;
+    try
+    {
+        if (!parse_options(argc, argv, options))
+        {
+            print_usage();
+            return 1;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    try
+    {
+        std::cout << "SIMD: " << simdLevelName(options.simdLevel)
+                  << ", threads: " << options.threads
+                  << ", nutrients: " << nutrientPrecisionName(options.nutrientPrecision)
+                  << ", epochs: " << options.epochs << " (+" << options.warmup << " warmup)"
+                  << ", best of " << options.repeat << "\n";
+
+        std::vector<BenchResult> results = run_benchmarks(options);
+
+        if (options.jsonPath)
+            write_json(options, results, *options.jsonPath);
+        if (options.csvPath)
+            write_csv(results, *options.csvPath);
+
+        // Exit code 2 flags a regression, e.g. for CI
+        if (options.baselinePath &&
+            compare_with_baseline(results, read_baseline(*options.baselinePath), options.maxSlowdown) > 0)
+            return 2;
+    }
+    catch (const MismatchError& e)
+    {
+        std::cerr << e.what() << "\n";
+        return 3;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,196 @@
+#include <cell_update.hpp>
+#include <cellular_automata.hpp>
+
+#include <algorithm>
+#include <bit>
+
+#ifdef CA_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+static_assert(sizeof(CellState) == 1, "The SIMD kernels work on one byte per cell");
+static_assert(uint8_t(CellState::Empty) == 0 && uint8_t(CellState::Alive) == 1 &&
+              uint8_t(CellState::Quiescent) == 2 && uint8_t(CellState::Necrotic) == 3,
+              "The SIMD kernels rely on the CellState encoding");
+
+static void updateRowScalar(CellState* states, const float* nutrients, const uint8_t* exposure, size_t jBegin, size_t jEnd, int row, float divideThreshold, float deathThreshold, std::vector<std::pair<int, int>>& aliveCells, StateTally& tally)
+{
+    for (size_t j = jBegin; j < jEnd; j++)
+    {
+        switch (states[j])
+        {
+            case CellState::Empty:
+                break;
+            case CellState::Necrotic:
+                tally.necrotic++;
+                break;
+            case CellState::Alive:
+                if (nutrients[j] >= divideThreshold)
+                {
+                    tally.alive++;
+                    if (!exposure || exposure[j])
+                        aliveCells.push_back({row, int(j)});
+                }
+                else
+                {
+                    states[j] = CellState::Quiescent;
+                    tally.quiescent++;
+                }
+                break;
+            case CellState::Quiescent:
+                if (nutrients[j] >= divideThreshold)
+                {
+                    states[j] = CellState::Alive;
+                    tally.alive++;
+                    if (!exposure || exposure[j])
+                        aliveCells.push_back({row, int(j)});
+                }
+                else if (nutrients[j] < deathThreshold)
+                {
+                    states[j] = CellState::Necrotic;
+                    tally.necrotic++;
+                }
+                else
+                    tally.quiescent++;
+                break;
+        }
+    }
+}
+
+#ifdef CA_X86_KERNELS
+
+// Appends the columns of the set bits of mask, lowest first. exposure is
+// only read where a cell is Alive, so sparse colonies do not stream it.
+static inline void appendAlive(uint64_t mask, int row, size_t j, const uint8_t* exposure, std::vector<std::pair<int, int>>& aliveCells)
+{
+    while (mask)
+    {
+        const size_t column = j + size_t(std::countr_zero(mask));
+        if (!exposure || exposure[column])
+            aliveCells.push_back({row, int(column)});
+        mask &= mask - 1;
+    }
+}
+
+// Per cell, branch free:
+//   living    = state is Alive or Quiescent
+//   candidate = nutrient >= divide ? Alive : (Quiescent and nutrient < death ? Necrotic : Quiescent)
+//   new state = living ? candidate : state
+CA_TARGET("avx2")
+static void updateRowAvx2(CellState* states, const float* nutrients, const uint8_t* exposure, size_t jBegin, size_t jEnd, int row, float divideThreshold, float deathThreshold, std::vector<std::pair<int, int>>& aliveCells, StateTally& tally)
+{
+    const __m256 divide = _mm256_set1_ps(divideThreshold);
+    const __m256 death = _mm256_set1_ps(deathThreshold);
+    const __m256i alive = _mm256_set1_epi8(char(CellState::Alive));
+    const __m256i quiescent = _mm256_set1_epi8(char(CellState::Quiescent));
+    const __m256i necrotic = _mm256_set1_epi8(char(CellState::Necrotic));
+    // packs interleaves 128-bit lanes, this puts the bytes back in order
+    const __m256i unshuffle = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+    size_t j = jBegin;
+
+    for (; j + 32 <= jEnd; j += 32)
+    {
+        __m256i state = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(states + j));
+
+        // Nutrient compares, narrowed from 32 to 8 bits per cell
+        __m256i ge[4], lt[4];
+        for (int k = 0; k < 4; k++)
+        {
+            __m256 nutrient = _mm256_loadu_ps(nutrients + j + 8 * k);
+            ge[k] = _mm256_castps_si256(_mm256_cmp_ps(nutrient, divide, _CMP_GE_OQ));
+            lt[k] = _mm256_castps_si256(_mm256_cmp_ps(nutrient, death, _CMP_LT_OQ));
+        }
+        __m256i canDivide = _mm256_packs_epi16(_mm256_packs_epi32(ge[0], ge[1]), _mm256_packs_epi32(ge[2], ge[3]));
+        __m256i starving = _mm256_packs_epi16(_mm256_packs_epi32(lt[0], lt[1]), _mm256_packs_epi32(lt[2], lt[3]));
+        canDivide = _mm256_permutevar8x32_epi32(canDivide, unshuffle);
+        starving = _mm256_permutevar8x32_epi32(starving, unshuffle);
+
+        __m256i isAlive = _mm256_cmpeq_epi8(state, alive);
+        __m256i isQuiescent = _mm256_cmpeq_epi8(state, quiescent);
+        __m256i living = _mm256_or_si256(isAlive, isQuiescent);
+
+        __m256i candidate = _mm256_blendv_epi8(quiescent, necrotic, _mm256_and_si256(isQuiescent, starving));
+        candidate = _mm256_blendv_epi8(candidate, alive, canDivide);
+        __m256i next = _mm256_blendv_epi8(state, candidate, living);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(states + j), next);
+
+        uint32_t nowAlive = uint32_t(_mm256_movemask_epi8(_mm256_and_si256(living, canDivide)));
+        tally.alive += size_t(std::popcount(nowAlive));
+        appendAlive(nowAlive, row, j, exposure, aliveCells);
+        tally.quiescent += size_t(std::popcount(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(next, quiescent)))));
+        tally.necrotic += size_t(std::popcount(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(next, necrotic)))));
+    }
+
+    updateRowScalar(states, nutrients, exposure, j, jEnd, row, divideThreshold, deathThreshold, aliveCells, tally);
+}
+
+CA_TARGET("avx512f,avx512bw")
+static void updateRowAvx512(CellState* states, const float* nutrients, const uint8_t* exposure, size_t jBegin, size_t jEnd, int row, float divideThreshold, float deathThreshold, std::vector<std::pair<int, int>>& aliveCells, StateTally& tally)
+{
+    const __m512 divide = _mm512_set1_ps(divideThreshold);
+    const __m512 death = _mm512_set1_ps(deathThreshold);
+    const __m512i alive = _mm512_set1_epi8(char(CellState::Alive));
+    const __m512i quiescent = _mm512_set1_epi8(char(CellState::Quiescent));
+    const __m512i necrotic = _mm512_set1_epi8(char(CellState::Necrotic));
+
+    for (size_t j = jBegin; j < jEnd; j += 64)
+    {
+        // The last chunk is masked instead of falling back to scalar
+        size_t remaining = std::min<size_t>(64, jEnd - j);
+        __mmask64 lanes = remaining == 64 ? ~__mmask64(0) : (__mmask64(1) << remaining) - 1;
+
+        __m512i state = _mm512_maskz_loadu_epi8(lanes, states + j);
+
+        __mmask64 canDivide = 0, starving = 0;
+        for (int k = 0; k < 4; k++)
+        {
+            __mmask16 part = __mmask16(lanes >> (16 * k));
+            __m512 nutrient = _mm512_maskz_loadu_ps(part, nutrients + j + 16 * k);
+            canDivide |= __mmask64(_mm512_mask_cmp_ps_mask(part, nutrient, divide, _CMP_GE_OQ)) << (16 * k);
+            starving |= __mmask64(_mm512_mask_cmp_ps_mask(part, nutrient, death, _CMP_LT_OQ)) << (16 * k);
+        }
+
+        __mmask64 isAlive = _mm512_mask_cmpeq_epi8_mask(lanes, state, alive);
+        __mmask64 isQuiescent = _mm512_mask_cmpeq_epi8_mask(lanes, state, quiescent);
+        __mmask64 living = isAlive | isQuiescent;
+
+        __m512i candidate = _mm512_mask_blend_epi8(isQuiescent & starving, quiescent, necrotic);
+        candidate = _mm512_mask_blend_epi8(canDivide, candidate, alive);
+        __m512i next = _mm512_mask_blend_epi8(living, state, candidate);
+        _mm512_mask_storeu_epi8(states + j, lanes, next);
+
+        __mmask64 nowAlive = living & canDivide;
+        tally.alive += size_t(std::popcount(uint64_t(nowAlive)));
+        appendAlive(nowAlive, row, j, exposure, aliveCells);
+        tally.quiescent += size_t(std::popcount(uint64_t(_mm512_mask_cmpeq_epi8_mask(lanes, next, quiescent))));
+        tally.necrotic += size_t(std::popcount(uint64_t(_mm512_mask_cmpeq_epi8_mask(lanes, next, necrotic))));
+    }
+}
+
+#endif
+
+CellUpdateKernel cellUpdateKernel(SimdLevel level)
+{
+    switch (level)
+    {
+#ifdef CA_X86_KERNELS
+        case SimdLevel::AVX512: return updateRowAvx512;
+        case SimdLevel::AVX2:   return updateRowAvx2;
+#endif
+        default:                return updateRowScalar;
+    }
+}
+
+void consumeRow(const CellState* states, float* nutrients, size_t jBegin, size_t jEnd, float rate)
+{
+    for (size_t j = jBegin; j < jEnd; j++)
+    {
+        // Alive (1) and Quiescent (2) are the only states with bit 0 xor bit 1 set
+        const uint8_t state = uint8_t(states[j]);
+        const bool living = ((state ^ (state >> 1)) & 1) != 0;
+        float drawn = nutrients[j] - rate;
+        drawn = drawn < MIN_NUTRIENT ? MIN_NUTRIENT : drawn;
+        nutrients[j] = living ? drawn : nutrients[j];
+    }
+}
@@ -1,252 +1,1209 @@
 #include <cellular_automata.hpp>
+#include <halo_transport.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+
+using Clock = std::chrono::steady_clock;
+
+static double secondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
 
 
 // Cellular Automata
 
-CellularAutomata::CellularAutomata(
-    std::array<std::array<CellState, GRID_SIZE>, GRID_SIZE>& cellGrid,
-    std::array<std::array<float, GRID_SIZE>, GRID_SIZE>& nutrientGrid,
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::BasicCellularAutomata(
+    Grid<CellState> cellGrid,
+    Grid<float> nutrientGrid,
     float diffusionSpeed,
     float deathThreshold,
     float divideThreshold,
-    float divideCost
-) : diffusionSpeed(diffusionSpeed),
+    float divideCost,
+    float consumptionRate,
+    DivisionMode divisionMode,
+    uint64_t seed,
+    const NutrientSolverOptions& nutrientSolver,
+    const EngineOptions& engine
+) : seed(seed),
+    counterRng(seed),
+    diffusionSpeed(diffusionSpeed),
     deathThreshold(deathThreshold),
     divideThreshold(divideThreshold),
-    divideCost(divideCost)
+    divideCost(divideCost),
+    consumptionRate(consumptionRate),
+    divisionMode(divisionMode),
+    nutrientSolver(nutrientSolver),
+    engine(engine),
+    diffuseRows(Neighborhood::kernel(engine.simdLevel)),
+    updateRow(cellUpdateKernel(engine.simdLevel)),
+    width(cellGrid.getWidth()),
+    height(cellGrid.getHeight()),
+    diffusePackedRow(Neighborhood::rowKernel(engine.simdLevel)),
+    packNutrients(nutrientPackKernel(engine.simdLevel)),
+    unpackNutrients(nutrientUnpackKernel(engine.simdLevel))
 {
+    if (nutrientGrid.getWidth() != width || nutrientGrid.getHeight() != height)
+        throw std::invalid_argument("Cell and nutrient grids must have the same size");
+    if (width < 3 || height < 3)
+        throw std::invalid_argument("Grids must be at least 3x3");
+    if (engine.tileSize == 0)
+        throw std::invalid_argument("Tile size must be positive");
+    if (engine.activeTolerance && !(*engine.activeTolerance >= 0.0f))
+        throw std::invalid_argument("Active region tolerance must not be negative");
+    if (!(nutrientSolver.timeStep > 0.0f) || !(nutrientSolver.tolerance >= 0.0f))
+        throw std::invalid_argument("Nutrient solver needs a positive time step and a non-negative tolerance");
+    if (!(consumptionRate >= 0.0f))
+        throw std::invalid_argument("Consumption rate must not be negative");
+
+    // The multigrid and the active-region bookkeeping assume the 4-neighbour
+    // stencil and a fixed border; halos assume the grid does not wrap
+    constexpr bool defaultField = std::is_same_v<Neighborhood, VonNeumann> && std::is_same_v<Boundary, DirichletSource>;
+    if (!defaultField && nutrientSolver.solver != NutrientSolver::Explicit)
+        throw std::invalid_argument("The implicit and steady solvers need the von Neumann stencil and a source boundary");
+    if (!defaultField && engine.activeTolerance)
+        throw std::invalid_argument("Active regions need the von Neumann stencil and a source boundary");
+    if (Boundary::PERIODIC && engine.subdomain)
+        throw std::invalid_argument("Subdomains do not support periodic boundaries");
+
+    packed = engine.nutrientPrecision == NutrientPrecision::Fixed16;
+    if (packed && (nutrientSolver.solver != NutrientSolver::Explicit || engine.activeTolerance || engine.subdomain))
+        throw std::invalid_argument("Fixed16 nutrients need the explicit nutrient step, without active regions or subdomains");
+
+    if (engine.subdomain)
+    {
+        const Subdomain& subdomain = *engine.subdomain;
+        if (!subdomain.transport)
+            throw std::invalid_argument("A subdomain needs a halo transport");
+        if (subdomain.rowOrigin + height > subdomain.globalHeight)
+            throw std::invalid_argument("Subdomain rows exceed the global grid");
+        // Claims reach one row beyond the parent, so the claim rows
+        // exchanged on either side of a band must not overlap
+        if (divisionMode != DivisionMode::Deterministic)
+            throw std::invalid_argument("Subdomains need deterministic division");
+        if (nutrientSolver.solver != NutrientSolver::Explicit)
+            throw std::invalid_argument("Subdomains need the explicit nutrient step");
+        if (engine.activeTolerance)
+            throw std::invalid_argument("Subdomains do not support active-region tracking");
+
+        rowOrigin = subdomain.rowOrigin;
+        haloAbove = rowOrigin > 0;
+        haloBelow = rowOrigin + height < subdomain.globalHeight;
+        if (height - haloAbove - haloBelow < 2)
+            throw std::invalid_argument("A subdomain must own at least two rows");
+
+        daughtersAbove.resize(width);
+        daughtersBelow.resize(width);
+        receivedDaughters.resize(width);
+        receivedClaims.resize(2 * Grid<uint64_t>::strideFor(width));
+    }
+
+    // Set the execution engine. Packed tiles are twice as wide, so that a
+    // tile row still spans as many nutrient bytes: short rows cost a TLB
+    // miss for every few cache lines.
+    tiling = packed ? Tiling(width, height, engine.tileSize, 2 * engine.tileSize)
+                    : Tiling(width, height, engine.tileSize);
+    pool = std::make_unique<ThreadPool>(engine.threads);
+
     // Set the grids
-    this->cellGrid = cellGrid;
-    this->nutrientGrid = nutrientGrid;
+    this->cellGrid = std::move(cellGrid);
+    if (packed)
+    {
+        packedNutrients = Grid<uint16_t>(width, height);
+        nextPackedNutrients = Grid<uint16_t>(width, height);
+        scratchRows = Grid<float>(width, 4 * pool->getThreadCount());
+        for (size_t i = 0; i < height; i++)
+            packNutrients(nutrientGrid[i], packedNutrients[i], width);
+        // Its memory serves the unpacked view
+        unpackedNutrients = std::move(nutrientGrid);
+    }
+    else
+    {
+        this->nutrientGrid = std::move(nutrientGrid);
+        nextNutrientGrid = Grid<float>(width, height);
+    }
+    tileFrontCells.resize(tiling.size());
+    tileTallies.resize(tiling.size());
+    if (engine.instrumentation)
+        tileNutrients.resize(tiling.size());
+
+    exposure = Grid<uint8_t>(width, height);
+    if (nutrientSolver.solver != NutrientSolver::Explicit)
+        multigrid = std::make_unique<MultigridSolver>(width, height);
+    startRun();
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+void BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::startRun()
+{
+    // From here on only placed daughters change it
+    pool->parallelFor(tiling.size(), [this](size_t index, size_t)
+    {
+        const Tile& tile = tiling[index];
+        computeExposure(tile.rowBegin, tile.rowEnd, tile.colBegin, tile.colEnd);
+    });
+
+    // Everything starts out active
+    if (engine.activeTolerance)
+        tileActivity.assign(tiling.size(), TileActivity{ 1, 1, 0, 0, 0 });
+    activeTiles = tiling.size();
+
+    if (multigrid && consumptionRate > 0.0f && uptake.empty())
+        uptake = Grid<float>(width, height);
+
+    // Claim tags restart with the epoch, so old ones must not survive
+    if (divisionMode == DivisionMode::Deterministic)
+    {
+        if (divisionClaims.empty())
+            divisionClaims = Grid<uint64_t>(width, height);
+        else
+            divisionClaims.fill(0);
+        tileClaims.resize(tiling.size());
+        tileDivisions.resize(tiling.size());
+    }
 
     // Set the RNG
-    gen = std::mt19937(rd());
+    std::seed_seq seedSequence{ uint32_t(seed), uint32_t(seed >> 32) };
+    gen.seed(seedSequence);
+
+    epoch = 0;
+    divisions = 0;
+    stepStats = StepStats();
+    unpackedCurrent = false;
 }
 
-//TODO: Rendere modulare la parte dove si refillano i nutrienti
-void CellularAutomata::diffuseNutrients()
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+void BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::restart(
+    const std::function<void(Grid<CellState>& cells, Grid<float>& nutrients)>& initialize,
+    float diffusionSpeed,
+    float deathThreshold,
+    float divideThreshold,
+    float divideCost,
+    float consumptionRate,
+    DivisionMode divisionMode,
+    uint64_t seed
+)
 {
-    // Create the new state od the grid
-    std::array<std::array<float, GRID_SIZE>, GRID_SIZE> newNutrientGrid;
-    
-    // Iterate only over inner cells
-    for (int i = 1; i < GRID_SIZE - 1; i++)
+    if (engine.subdomain)
+        throw std::invalid_argument("Subdomains cannot be restarted");
+    if (!(consumptionRate >= 0.0f))
+        throw std::invalid_argument("Consumption rate must not be negative");
+
+    // Packed runs start from the float view and pack it
+    Grid<float>& nutrients = packed ? unpackedNutrients : nutrientGrid;
+    initialize(cellGrid, nutrients);
+    if (cellGrid.getWidth() != width || cellGrid.getHeight() != height
+        || nutrients.getWidth() != width || nutrients.getHeight() != height)
+        throw std::invalid_argument("A restarted simulation keeps its grid size");
+    if (packed)
+    {
+        for (size_t i = 0; i < height; i++)
+            packNutrients(nutrients[i], packedNutrients[i], width);
+    }
+
+    this->seed = seed;
+    counterRng = Philox4x32(seed);
+    this->diffusionSpeed = diffusionSpeed;
+    this->deathThreshold = deathThreshold;
+    this->divideThreshold = divideThreshold;
+    this->divideCost = divideCost;
+    this->consumptionRate = consumptionRate;
+    this->divisionMode = divisionMode;
+    startRun();
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+void BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::diffuseNutrients()
+{
+    Clock::time_point start;
+    if (engine.instrumentation)
+        start = Clock::now();
+
+    // Ghost ring for the boundary condition, before the halos overwrite
+    // the rows they own
+    unpackedCurrent = false;
+    if (packed)
+        Boundary::prepare(packedNutrients);
+    else
+        Boundary::prepare(nutrientGrid);
+    if (engine.subdomain)
+        exchangeHalos();
+
+    // Stencil and border refill in one pass into the back buffer,
+    // which then becomes the current grid
+    if (packed)
+    {
+        pool->parallelFor(tiling.size(), [this](size_t index, size_t worker)
+        {
+            diffusePackedTile(index, worker);
+        });
+        packedNutrients.swap(nextPackedNutrients);
+    }
+    else if (multigrid)
+        solveNutrients();
+    else if (engine.activeTolerance)
+    {
+        pool->parallelFor(tiling.size(), [this](size_t index, size_t)
+        {
+            diffuseActiveTile(index);
+        });
+
+        activeTiles = 0;
+        for (TileActivity& activity : tileActivity)
+        {
+            activity.changed = activity.nextChanged;
+            activeTiles += activity.diffused;
+        }
+    }
+    else
     {
-        for (int j = 1; j < GRID_SIZE - 1; j++)
+        pool->parallelFor(tiling.size(), [this](size_t index, size_t)
         {
-            float nutrientAvg = 0.0f;
-            // TOP NEIGHBOR
-            nutrientAvg += nutrientGrid[i-1][j];
-            // LEFT NEIGHBOR
-            nutrientAvg += nutrientGrid[i][j-1];
-            // BOTTOM NEIGHBOR
-            nutrientAvg += nutrientGrid[i+1][j];
-            // RIGHT NEIGHBOR
-            nutrientAvg += nutrientGrid[i][j+1];
-            nutrientAvg /= 4.0f;
+            const Tile& tile = tiling[index];
+            diffuseRows(nutrientGrid, nextNutrientGrid, diffusionSpeed,
+                        tile.rowBegin, tile.rowEnd, tile.colBegin, tile.colEnd);
+            if (engine.instrumentation)
+                tileNutrients[index] = summarizeNutrients(nextNutrientGrid, tile.rowBegin, tile.rowEnd, tile.colBegin, tile.colEnd);
+        });
+    }
+    if (!multigrid && !packed)
+        nutrientGrid.swap(nextNutrientGrid);
+
+    if (engine.instrumentation)
+    {
+        summarizeNutrientStats();
+        stepStats.diffuseSeconds = secondsSince(start);
+    }
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+void BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::summarizeNutrientStats()
+{
+    // Skipped tiles keep the summary of their frozen values
+    NutrientSummary total = tileNutrients[0];
+    for (size_t index = 1; index < tileNutrients.size(); index++)
+    {
+        total.min = std::min(total.min, tileNutrients[index].min);
+        total.max = std::max(total.max, tileNutrients[index].max);
+        total.sum += tileNutrients[index].sum;
+    }
+    stepStats.nutrientMin = total.min;
+    stepStats.nutrientMax = total.max;
+    stepStats.nutrientMean = float(total.sum / double(width * height));
+}
 
-            newNutrientGrid[i][j] = ((nutrientAvg - nutrientGrid[i][j]) * diffusionSpeed) + nutrientGrid[i][j];
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+void BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::diffuseAndUpdateCells()
+{
+    Clock::time_point start;
+    if (engine.instrumentation)
+        start = Clock::now();
 
-            if (newNutrientGrid[i][j] > 1.0f) newNutrientGrid[i][j] = 1.0f;
-            if (newNutrientGrid[i][j] < 0.0f) newNutrientGrid[i][j] = 0.0f; 
-        }    
+    unpackedCurrent = false;
+    if (packed)
+    {
+        Boundary::prepare(packedNutrients);
+        pool->parallelFor(tiling.size(), [this](size_t index, size_t worker)
+        {
+            diffusePackedTile(index, worker);
+            updateTile(index, nextPackedNutrients, worker);
+        });
+        packedNutrients.swap(nextPackedNutrients);
+    }
+    else
+    {
+        Boundary::prepare(nutrientGrid);
+        if (engine.subdomain)
+            exchangeHalos();
+
+        // Diffusion only reads the front buffer and a cell's update only
+        // reads its own new nutrient, so a tile can be updated as soon as
+        // it is diffused, while its rows are still in cache
+        pool->parallelFor(tiling.size(), [this](size_t index, size_t worker)
+        {
+            const Tile& tile = tiling[index];
+            diffuseRows(nutrientGrid, nextNutrientGrid, diffusionSpeed,
+                        tile.rowBegin, tile.rowEnd, tile.colBegin, tile.colEnd);
+            if (engine.instrumentation)
+                tileNutrients[index] = summarizeNutrients(nextNutrientGrid, tile.rowBegin, tile.rowEnd, tile.colBegin, tile.colEnd);
+            updateTile(index, nextNutrientGrid, worker);
+        });
+        nutrientGrid.swap(nextNutrientGrid);
     }
 
-    // Refill with nutrients
+    if (divisionMode == DivisionMode::Sequential)
+        gatherFrontCells();
 
-    // Top and bottom rows
-    for (int j = 0; j < GRID_SIZE; ++j)
+    if (engine.instrumentation)
     {
-        newNutrientGrid[0][j] = MAX_NUTRIENT;
-        newNutrientGrid[GRID_SIZE - 1][j] = MAX_NUTRIENT;
+        summarizeNutrientStats();
+        summarizeCellStats();
+        stepStats.diffuseSeconds = secondsSince(start);
+        stepStats.updateSeconds = 0.0;
     }
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+void BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::diffusePackedTile(size_t index, size_t worker)
+{
+    // Same stencil and border refill as diffuseRows, one row at a time
+    // through the worker's scratch rows. The rows above and below are
+    // unpacked one column beyond the tile and move up as the row advances,
+    // so every source row is unpacked once per tile.
+    const Tile& tile = tiling[index];
+    const uint16_t border = packNutrient(MAX_NUTRIENT);
+    const size_t unpackBegin = tile.colBegin > 0 ? tile.colBegin - 1 : 0;
+    const size_t unpackEnd = std::min(tile.colEnd + 1, width);
+    const size_t jBegin = std::max<size_t>(tile.colBegin, 1);
+    const size_t jEnd = std::min(tile.colEnd, width - 1);
 
-    // Left and right columns
-    for (int i = 0; i < GRID_SIZE; ++i)
+    float* up = scratchRows[4 * worker];
+    float* row = scratchRows[4 * worker + 1];
+    float* down = scratchRows[4 * worker + 2];
+    float* out = scratchRows[4 * worker + 3];
+    auto unpack = [&](size_t i, float* values)
     {
-        newNutrientGrid[i][0] = MAX_NUTRIENT;
-        newNutrientGrid[i][GRID_SIZE - 1] = MAX_NUTRIENT;
+        unpackNutrients(packedNutrients[i] + unpackBegin, values + unpackBegin, unpackEnd - unpackBegin);
+    };
+
+    bool primed = false;
+    for (size_t i = tile.rowBegin; i < tile.rowEnd; i++)
+    {
+        uint16_t* dst = nextPackedNutrients[i];
+        if (i == 0 || i == height - 1)
+        {
+            std::fill(dst + tile.colBegin, dst + tile.colEnd, border);
+            continue;
+        }
+
+        if (!primed)
+        {
+            unpack(i - 1, up);
+            unpack(i, row);
+            primed = true;
+        }
+        else
+        {
+            float* oldUp = up;
+            up = row;
+            row = down;
+            down = oldUp;
+        }
+        unpack(i + 1, down);
+
+        out[0] = out[width - 1] = MAX_NUTRIENT;
+        diffusePackedRow(up, row, down, out, jBegin, jEnd, diffusionSpeed);
+        packNutrients(out + tile.colBegin, dst + tile.colBegin, tile.colEnd - tile.colBegin);
     }
 
-    this->nutrientGrid = std::move(newNutrientGrid);
+    if (engine.instrumentation)
+        tileNutrients[index] = summarizePackedNutrients(nextPackedNutrients, tile.rowBegin, tile.rowEnd, tile.colBegin, tile.colEnd);
 }
 
-void CellularAutomata::updateCells()
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+void BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::diffuseActiveTile(size_t index)
 {
-    // Create cell grid for the new state
-    std::array<std::array<CellState, GRID_SIZE>, GRID_SIZE> newCellGrid;
+    const Tile& tile = tiling[index];
+    TileActivity& activity = tileActivity[index];
 
-    // Clear alive cells
-    aliveCells.clear();
+    // The stencil reads one cell into the side neighbours, so a tile only
+    // needs work when it or one of them changed in the last step
+    const size_t columns = tiling.getColumns();
+    const size_t r = index / columns, c = index % columns;
+    bool needed = activity.changed
+        || (r > 0 && tileActivity[index - columns].changed)
+        || (r + 1 < tiling.getRows() && tileActivity[index + columns].changed)
+        || (c > 0 && tileActivity[index - 1].changed)
+        || (c + 1 < columns && tileActivity[index + 1].changed);
 
-    // Updating states
-    // Iterate only over inner cells
-    for (int i = 1; i < GRID_SIZE - 1; i++)
+    if (!needed)
     {
-        for (int j = 1; j < GRID_SIZE - 1; j++)
+        // Steady: the back buffer only has to catch up once
+        if (!activity.settled)
         {
-            switch (cellGrid[i][j])
+            for (size_t i = tile.rowBegin; i < tile.rowEnd; i++)
+                std::copy(nutrientGrid[i] + tile.colBegin, nutrientGrid[i] + tile.colEnd, nextNutrientGrid[i] + tile.colBegin);
+            activity.settled = 1;
+        }
+        activity.nextChanged = 0;
+        activity.diffused = 0;
+        return;
+    }
+
+    diffuseRows(nutrientGrid, nextNutrientGrid, diffusionSpeed,
+                tile.rowBegin, tile.rowEnd, tile.colBegin, tile.colEnd);
+    if (engine.instrumentation)
+        tileNutrients[index] = summarizeNutrients(nextNutrientGrid, tile.rowBegin, tile.rowEnd, tile.colBegin, tile.colEnd);
+
+    activity.nextChanged = exceedsTolerance(nutrientGrid, nextNutrientGrid, *engine.activeTolerance,
+                                            tile.rowBegin, tile.rowEnd, tile.colBegin, tile.colEnd);
+    activity.settled = 0;
+    activity.diffused = 1;
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+void BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::solveNutrients()
+{
+    // Border cells are sources held at MAX_NUTRIENT, as in the explicit step
+    std::fill_n(nutrientGrid[0], width, MAX_NUTRIENT);
+    std::fill_n(nutrientGrid[height - 1], width, MAX_NUTRIENT);
+    for (size_t i = 1; i < height - 1; i++)
+        nutrientGrid[i][0] = nutrientGrid[i][width - 1] = MAX_NUTRIENT;
+
+    // Living cells are sinks of the current cell configuration
+    if (!uptake.empty())
+    {
+        pool->parallelFor(tiling.size(), [this](size_t index, size_t)
+        {
+            const Tile& tile = tiling[index];
+            for (size_t i = tile.rowBegin; i < tile.rowEnd; i++)
             {
-                case CellState::Empty: 
-                    newCellGrid[i][j] = CellState::Empty; //TODO: Ottimizzabile 
-                    break;
-                case CellState::Necrotic:
-                    newCellGrid[i][j] = CellState::Necrotic; //TODO: Ottimizzabile
-                    break;
-                case CellState::Alive: 
-                    if (nutrientGrid[i][j] >= divideThreshold)
-                    {
-                        newCellGrid[i][j] = CellState::Alive;
-                        aliveCells.push_back({i,j});
-                    }
-                    else
-                        newCellGrid[i][j] = CellState::Quiescent;
-                    break;
-                case CellState::Quiescent: 
-                    if (nutrientGrid[i][j] >= divideThreshold)
-                    {
-                        newCellGrid[i][j] = CellState::Alive;
-                        aliveCells.push_back({i,j});
-                    }
-                    else if (nutrientGrid[i][j] < deathThreshold)
-                    {
-                        newCellGrid[i][j] = CellState::Necrotic;
-                    }
-                    else
-                        newCellGrid[i][j] = CellState::Quiescent;
-                    break;
+                for (size_t j = tile.colBegin; j < tile.colEnd; j++)
+                {
+                    const CellState state = cellGrid[i][j];
+                    uptake[i][j] = state == CellState::Alive || state == CellState::Quiescent ? consumptionRate : 0.0f;
+                }
             }
-        }    
+        });
+    }
+
+    // The previous field is the right-hand side and the first guess
+    float change = 0.0f;
+    size_t cycles = multigrid->solve(nutrientGrid, nutrientGrid, uptake.empty() ? nullptr : &uptake,
+                                     diffusionSpeed, nutrientSolver, *pool, change);
+
+    // The solve stops at a tolerance, so it may overshoot the bounds by as
+    // much; clamp like the explicit step does
+    pool->parallelFor(tiling.size(), [this](size_t index, size_t)
+    {
+        const Tile& tile = tiling[index];
+        for (size_t i = tile.rowBegin; i < tile.rowEnd; i++)
+            for (size_t j = tile.colBegin; j < tile.colEnd; j++)
+                nutrientGrid[i][j] = std::clamp(nutrientGrid[i][j], MIN_NUTRIENT, MAX_NUTRIENT);
+    });
+
+    // The whole field may have moved
+    if (!tileActivity.empty())
+    {
+        for (TileActivity& activity : tileActivity)
+            activity.changed = 1;
+        activeTiles = tiling.size();
     }
 
-    this->cellGrid = std::move(newCellGrid);
+    if (engine.instrumentation)
+    {
+        pool->parallelFor(tiling.size(), [this](size_t index, size_t)
+        {
+            const Tile& tile = tiling[index];
+            tileNutrients[index] = summarizeNutrients(nutrientGrid, tile.rowBegin, tile.rowEnd, tile.colBegin, tile.colEnd);
+        });
+        stepStats.solverCycles = cycles;
+        stepStats.solverChange = change;
+    }
 }
 
-void CellularAutomata::divideCells()
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+void BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::updateCells()
 {
-    // Mitosis
+    Clock::time_point start;
+    if (engine.instrumentation)
+        start = Clock::now();
+
+    unpackedCurrent = false;
+    pool->parallelFor(tiling.size(), [this](size_t index, size_t worker)
+    {
+        if (packed)
+            updateTile(index, packedNutrients, worker);
+        else
+            updateTile(index, nutrientGrid, worker);
+    });
+
+    // Only the sequential division depends on the order of the parents
+    if (divisionMode == DivisionMode::Sequential)
+        gatherFrontCells();
+
+    if (engine.instrumentation)
+    {
+        summarizeCellStats();
+        stepStats.updateSeconds = secondsSince(start);
+    }
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+void BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::summarizeCellStats()
+{
+    // Skipped tiles hold no living cells and keep their Necrotic count
+    CellCounts counts;
+    for (size_t index = 0; index < tiling.size(); index++)
+    {
+        counts.alive += tileTallies[index].alive;
+        counts.quiescent += tileTallies[index].quiescent;
+        counts.necrotic += tileTallies[index].necrotic;
+    }
+    stepStats.counts = counts;
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+template <typename T>
+void BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::updateTile(size_t index, Grid<T>& nutrients, size_t worker)
+{
+    // Each cell only depends on its own state and nutrient,
+    // so the grid is updated in place
+    const Tile& tile = tiling[index];
+
+    // Clear the front
+    std::vector<std::pair<int, int>>& frontCells = tileFrontCells[index];
+    frontCells.clear();
+
+    // Empty and Necrotic cells never change on their own
+    const bool tracking = !tileActivity.empty();
+    if (tracking && !tileActivity[index].live)
+        return;
+    StateTally tally;
+
+    // Consumption, then the states it leads to. The solvers already took
+    // it up as a sink, a second draw would count it twice.
     // Iterate only over inner cells
-    for (auto& cell : aliveCells)
+    const bool consuming = consumptionRate > 0.0f && !multigrid;
+    const size_t iEnd = std::min(tile.rowEnd, height - 1);
+    const size_t jBegin = std::max<size_t>(tile.colBegin, 1);
+    const size_t jEnd = std::min(tile.colEnd, width - 1);
+    for (size_t i = std::max<size_t>(tile.rowBegin, 1); i < iEnd; i++)
     {
-        std::array<Neighbor, 4> availableNeighbors;
-        int neighborCount = 0;
+        // Packed rows go through a scratch row, and back only when consumed
+        float* row;
+        if constexpr (std::is_same_v<T, float>)
+            row = nutrients[i];
+        else
+        {
+            row = scratchRows[4 * worker];
+            unpackNutrients(nutrients[i] + jBegin, row + jBegin, jEnd - jBegin);
+        }
+
+        if (consuming)
+            consumeRow(cellGrid[i], row, jBegin, jEnd, consumptionRate);
+        updateRow(cellGrid[i], row, exposure[i], jBegin, jEnd, int(i),
+                  divideThreshold, deathThreshold, frontCells, tally);
+
+        if constexpr (!std::is_same_v<T, float>)
+        {
+            if (consuming)
+                packNutrients(row + jBegin, nutrients[i] + jBegin, jEnd - jBegin);
+        }
+    }
+
+    tileTallies[index] = tally;
+    if (tracking)
+    {
+        tileActivity[index].live = tally.alive > 0 || tally.quiescent > 0;
+        // Consumption moved the nutrients after diffusion
+        if (consuming)
+        {
+            tileActivity[index].changed = 1;
+            tileActivity[index].settled = 0;
+        }
+    }
+}
 
-        // TOP NEIGHBOR
-        if (cellGrid[cell.first - 1][cell.second] == CellState::Empty)
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+void BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::gatherFrontCells()
+{
+    // Each tile lists its cells row-major within the tile. Interleaving the
+    // tiles of every tile row restores the row-major order over the whole
+    // grid, so divideCells() consumes random numbers exactly as before.
+    std::vector<size_t> rowOffsets(tiling.getRows() + 1, 0);
+    for (size_t r = 0; r < tiling.getRows(); r++)
+    {
+        rowOffsets[r + 1] = rowOffsets[r];
+        for (size_t c = 0; c < tiling.getColumns(); c++)
+            rowOffsets[r + 1] += tileFrontCells[r * tiling.getColumns() + c].size();
+    }
+
+    frontCells.resize(rowOffsets.back());
+
+    pool->parallelFor(tiling.getRows(), [&](size_t r, size_t)
+    {
+        const size_t columns = tiling.getColumns();
+        std::vector<size_t> cursors(columns, 0);
+        auto out = frontCells.begin() + rowOffsets[r];
+
+        const Tile& band = tiling.at(r, 0);
+        for (size_t i = band.rowBegin; i < band.rowEnd; i++)
         {
-            availableNeighbors[neighborCount] = Neighbor::TOP;
-            neighborCount++;
+            for (size_t c = 0; c < columns; c++)
+            {
+                const auto& cells = tileFrontCells[r * columns + c];
+                size_t& cursor = cursors[c];
+                while (cursor < cells.size() && size_t(cells[cursor].first) == i)
+                    *out++ = cells[cursor++];
+            }
         }
-        // LEFT NEIGHBOR
-        if (cellGrid[cell.first][cell.second - 1] == CellState::Empty)
+    });
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+void BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::computeExposure(size_t rowBegin, size_t rowEnd, size_t colBegin, size_t colEnd)
+{
+    // Inner cells only, the ring is never updated
+    const size_t iEnd = std::min(rowEnd, height - 1);
+    const size_t jBegin = std::max<size_t>(colBegin, 1);
+    const size_t jEnd = std::min(colEnd, width - 1);
+    for (size_t i = std::max<size_t>(rowBegin, 1); i < iEnd; i++)
+    {
+        for (size_t j = jBegin; j < jEnd; j++)
         {
-            availableNeighbors[neighborCount] = Neighbor::LEFT;
-            neighborCount++;
+            uint8_t count = 0;
+            for (int n = 0; n < Neighborhood::COUNT; n++)
+            {
+                int ti = int(i) + Neighborhood::DI[n], tj = int(j) + Neighborhood::DJ[n];
+                if (Boundary::mapCell(ti, tj, int(height), int(width)) && cellGrid[ti][tj] == CellState::Empty)
+                    count++;
+            }
+            exposure[i][j] = count;
         }
-        // BOTTOM NEIGHBOR
-        if (cellGrid[cell.first + 1][cell.second] == CellState::Empty)
+    }
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+void BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::coverCell(int i, int j, bool concurrent)
+{
+    // (i, j) was Empty and now holds a daughter. Neighbourhoods are
+    // symmetric, so the inner cells that see it are the ones at -offset,
+    // wrapped like any other position.
+    for (int n = 0; n < Neighborhood::COUNT; n++)
+    {
+        int ci = i - Neighborhood::DI[n], cj = j - Neighborhood::DJ[n];
+        if (!Boundary::mapCell(ci, cj, int(height), int(width))
+            || ci < 1 || cj < 1 || ci >= int(height) - 1 || cj >= int(width) - 1)
+            continue;
+        // Daughters committed by other tiles may share a neighbour
+        if (concurrent)
+            std::atomic_ref<uint8_t>(exposure[ci][cj]).fetch_sub(1, std::memory_order_relaxed);
+        else
+            exposure[ci][cj]--;
+    }
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+float BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::nutrientAt(int i, int j) const
+{
+    return packed ? unpackNutrient(packedNutrients[i][j]) : nutrientGrid[i][j];
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+void BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::spendNutrient(int i, int j)
+{
+    // The parent pays for its daughter
+    if (packed)
+        packedNutrients[i][j] = packNutrient(unpackNutrient(packedNutrients[i][j]) - divideCost);
+    else if ((nutrientGrid[i][j] -= divideCost) < MIN_NUTRIENT)
+        nutrientGrid[i][j] = MIN_NUTRIENT;
+}
+
+// Distinct generation tags in the high half of a division claim key
+static constexpr uint64_t CLAIM_GENERATIONS = 0xffffffffull;
+
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+void BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::divideCells()
+{
+    Clock::time_point start;
+    if (engine.instrumentation)
+        start = Clock::now();
+
+    unpackedCurrent = false;
+    switch (divisionMode)
+    {
+        case DivisionMode::Sequential:
+            divideCellsSequential();
+            break;
+        case DivisionMode::Deterministic:
+            // Claim tags are about to wrap around
+            if (epoch > 0 && epoch % CLAIM_GENERATIONS == 0)
+                divisionClaims.fill(0);
+
+            // Claims only read the post-update grid, commits only write it
+            pool->parallelFor(tiling.size(), [this](size_t index, size_t)
+            {
+                claimDivisions(index);
+            });
+            if (engine.subdomain)
+            {
+                exchangeClaims();
+                std::fill(daughtersAbove.begin(), daughtersAbove.end(), 0);
+                std::fill(daughtersBelow.begin(), daughtersBelow.end(), 0);
+            }
+            pool->parallelFor(tiling.size(), [this](size_t index, size_t)
+            {
+                commitDivisions(index);
+            });
+            if (engine.subdomain)
+                exchangeDaughters();
+            break;
+    }
+
+    // Divisions close the epoch, so the phases can also be driven one by one
+    epoch++;
+
+    if (engine.instrumentation)
+    {
+        if (divisionMode == DivisionMode::Deterministic)
         {
-            availableNeighbors[neighborCount] = Neighbor::BOTTOM;
-            neighborCount++;
+            divisions = 0;
+            for (size_t count : tileDivisions)
+                divisions += count;
         }
-        // RIGHT NEIGHBOR
-        if (cellGrid[cell.first][cell.second + 1] == CellState::Empty)
+        stepStats.epoch = epoch;
+        stepStats.divisions = divisions;
+        stepStats.blockedDivisions = stepStats.counts.alive - divisions;
+        stepStats.divideSeconds = secondsSince(start);
+    }
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+void BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::divideCellsSequential()
+{
+    // Mitosis
+    // Only the front can divide, and daughters only ever take Empty
+    // neighbours away, so the cells left out could not divide either
+    divisions = 0;
+    for (auto& cell : frontCells)
+    {
+        std::array<std::pair<int, int>, Neighborhood::COUNT> availableNeighbors;
+        int neighborCount = 0;
+
+        for (int n = 0; n < Neighborhood::COUNT; n++)
         {
-            availableNeighbors[neighborCount] = Neighbor::RIGHT;
-            neighborCount++;
+            int ti = cell.first + Neighborhood::DI[n], tj = cell.second + Neighborhood::DJ[n];
+            if (Boundary::mapCell(ti, tj, int(height), int(width)) && cellGrid[ti][tj] == CellState::Empty)
+                availableNeighbors[neighborCount++] = { ti, tj };
         }
 
         if (neighborCount == 0)
             continue;
 
         // Distribution over valid indices
-        std::uniform_int_distribution<> dist(0, neighborCount - 1);
+        auto draw = [this](int count)
+        {
+            std::uniform_int_distribution<> dist(0, count - 1);
+            return dist(gen);
+        };
+        auto nutrientOf = [&](int k)
+        {
+            return nutrientAt(availableNeighbors[k].first, availableNeighbors[k].second);
+        };
+        const auto [ti, tj] = availableNeighbors[DivisionRule::choose(neighborCount, draw, nutrientOf)];
+
+        cellGrid[ti][tj] = CellState::Alive;
+        coverCell(ti, tj, false);
+        spendNutrient(cell.first, cell.second);
+        divisions++;
 
-        Neighbor finalPos = availableNeighbors[dist(gen)];
-        
-        switch (finalPos)
+        // Wake up the tiles of the parent (nutrient drop) and the daughter
+        if (!tileActivity.empty())
         {
-            case Neighbor::TOP: 
-                cellGrid[cell.first-1][cell.second] = CellState::Alive;
-                break;
-            case Neighbor::LEFT:
-                cellGrid[cell.first][cell.second-1] = CellState::Alive;
-                break;
-            case Neighbor::BOTTOM:
-                cellGrid[cell.first+1][cell.second] = CellState::Alive;
-                break;
-            case Neighbor::RIGHT: 
-                cellGrid[cell.first][cell.second+1] = CellState::Alive;
-                break;
+            tileActivity[tiling.indexOf(cell.first, cell.second)].changed = 1;
+            tileActivity[tiling.indexOf(ti, tj)].live = 1;
         }
+    }
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+void BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::claimDivisions(size_t index)
+{
+    // Claim keys carry a generation tag in the high half, so claims left
+    // over from earlier steps always lose and the grid needs no clearing
+    const uint64_t tag = (epoch % CLAIM_GENERATIONS + 1) << 32;
+
+    std::vector<DivisionClaim>& claims = tileClaims[index];
+    claims.clear();
+
+    for (auto& cell : tileFrontCells[index])
+    {
+        const int i = cell.first, j = cell.second;
+
+        std::array<int, Neighborhood::COUNT> availableNeighbors;
+        int neighborCount = 0;
 
-        if ((nutrientGrid[cell.first][cell.second] -= divideCost) < MIN_NUTRIENT) nutrientGrid[cell.first][cell.second] = MIN_NUTRIENT;
+        for (int n = 0; n < Neighborhood::COUNT; n++)
+        {
+            int ti = i + Neighborhood::DI[n], tj = j + Neighborhood::DJ[n];
+            if (Boundary::mapCell(ti, tj, int(height), int(width)) && cellGrid[ti][tj] == CellState::Empty)
+                availableNeighbors[neighborCount++] = n;
+        }
+
+        if (neighborCount == 0)
+            continue;
+
+        // Choice and priority only depend on (seed, epoch, i, j), with i
+        // counted over the whole grid when this is a subdomain
+        Philox4x32::Counter draw = counterRng(epoch, uint32_t(rowOrigin + size_t(i)), uint32_t(j));
+        auto below = [&draw](int count)
+        {
+            return int(Philox4x32::below(draw[0], uint32_t(count)));
+        };
+        auto nutrientOf = [&](int k)
+        {
+            const int n = availableNeighbors[k];
+            int ni = i + Neighborhood::DI[n], nj = j + Neighborhood::DJ[n];
+            Boundary::mapCell(ni, nj, int(height), int(width));
+            return nutrientAt(ni, nj);
+        };
+        const int target = availableNeighbors[DivisionRule::choose(neighborCount, below, nutrientOf)];
+        int ti = i + Neighborhood::DI[target], tj = j + Neighborhood::DJ[target];
+        Boundary::mapCell(ti, tj, int(height), int(width));
+
+        // Every parent that can claim one target sits on a different side
+        // of it, so the direction in the low bits makes every key unique.
+        // The highest key wins.
+        constexpr uint32_t directionMask = (1u << Neighborhood::DIRECTION_BITS) - 1;
+        uint64_t key = tag | (draw[1] & ~directionMask) | uint32_t(target);
+
+        std::atomic_ref<uint64_t> slot(divisionClaims[ti][tj]);
+        uint64_t current = slot.load(std::memory_order_relaxed);
+        while (current < key && !slot.compare_exchange_weak(current, key, std::memory_order_relaxed))
+            ;
+
+        claims.push_back({ i, j, ti, tj, key });
+    }
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+void BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::commitDivisions(size_t index)
+{
+    size_t placed = 0;
+    for (const DivisionClaim& claim : tileClaims[index])
+    {
+        // Lost to a higher priority parent
+        if (divisionClaims[claim.ti][claim.tj] != claim.key)
+            continue;
+        placed++;
+
+        cellGrid[claim.ti][claim.tj] = CellState::Alive;
+        coverCell(claim.ti, claim.tj, true);
+        spendNutrient(claim.i, claim.j);
+
+        // Daughters in a halo row belong to the neighbouring band. Each
+        // target has a single winner, so the flags never race.
+        if (haloAbove && claim.ti == 0)
+            daughtersAbove[claim.tj] = 1;
+        else if (haloBelow && size_t(claim.ti) == height - 1)
+            daughtersBelow[claim.tj] = 1;
+
+        // Parents belong to this tile, daughters may land in a neighbouring one
+        if (!tileActivity.empty())
+        {
+            tileActivity[index].changed = 1;
+            std::atomic_ref<uint8_t>(tileActivity[tiling.indexOf(claim.ti, claim.tj)].live).store(1, std::memory_order_relaxed);
+        }
+    }
+    tileDivisions[index] = placed;
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+void BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::exchangeHalos()
+{
+    // Everything diffusion and the division claims read beyond the band:
+    // the neighbours' edge rows as their last step left them
+    HaloTransport& transport = *engine.subdomain->transport;
+    if (haloAbove)
+    {
+        transport.exchange(HaloSide::Up, nutrientGrid[1], nutrientGrid[0], width * sizeof(float));
+        transport.exchange(HaloSide::Up, cellGrid[1], cellGrid[0], width * sizeof(CellState));
+    }
+    if (haloBelow)
+    {
+        transport.exchange(HaloSide::Down, nutrientGrid[height - 2], nutrientGrid[height - 1], width * sizeof(float));
+        transport.exchange(HaloSide::Down, cellGrid[height - 2], cellGrid[height - 1], width * sizeof(CellState));
     }
+
+    // The neighbours' daughters next to the edge rows only show up here
+    if (haloAbove)
+        computeExposure(1, 2, 0, width);
+    if (haloBelow)
+        computeExposure(height - 2, height - 1, 0, width);
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+void BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::exchangeClaims()
+{
+    // Targets on either side of a band edge can be claimed from both bands.
+    // Both send their claims on the two edge rows and keep the higher key,
+    // so both see the same winners.
+    HaloTransport& transport = *engine.subdomain->transport;
+    const size_t stride = divisionClaims.getStride();
+
+    auto merge = [&](HaloSide side, size_t firstRow)
+    {
+        transport.exchange(side, divisionClaims[firstRow], receivedClaims.data(), 2 * stride * sizeof(uint64_t));
+        for (size_t r = 0; r < 2; r++)
+        {
+            uint64_t* row = divisionClaims[firstRow + r];
+            const uint64_t* received = receivedClaims.data() + r * stride;
+            for (size_t j = 0; j < width; j++)
+                row[j] = std::max(row[j], received[j]);
+        }
+    };
+
+    if (haloAbove)
+        merge(HaloSide::Up, 0);
+    if (haloBelow)
+        merge(HaloSide::Down, height - 2);
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+void BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::exchangeDaughters()
+{
+    // Daughters placed across an edge are only in the halo copy so far
+    HaloTransport& transport = *engine.subdomain->transport;
+
+    auto place = [&](HaloSide side, std::vector<uint8_t>& placed, size_t row)
+    {
+        transport.exchange(side, placed.data(), receivedDaughters.data(), width);
+        for (size_t j = 0; j < width; j++)
+        {
+            if (receivedDaughters[j] && cellGrid[row][j] == CellState::Empty)
+            {
+                cellGrid[row][j] = CellState::Alive;
+                coverCell(int(row), int(j), false);
+            }
+        }
+    };
+
+    if (haloAbove)
+        place(HaloSide::Up, daughtersAbove, 1);
+    if (haloBelow)
+        place(HaloSide::Down, daughtersBelow, height - 2);
 }
 
-void CellularAutomata::step()
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+void BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::step()
 {
-    diffuseNutrients();
-    updateCells();
+    // The multigrid solves the whole field at once, and active regions
+    // decide which tiles to diffuse from the flags their neighbours update
+    if (engine.fusedStep && !multigrid && tileActivity.empty())
+        diffuseAndUpdateCells();
+    else
+    {
+        diffuseNutrients();
+        updateCells();
+    }
     divideCells();
-    render();
 }
 
-void CellularAutomata::render()
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+size_t BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::getWidth() const
+{
+    return width;
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+size_t BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::getHeight() const
+{
+    return height;
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+uint64_t BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::getEpoch() const
+{
+    return epoch;
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+uint64_t BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::getSeed() const
+{
+    return seed;
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+float BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::getDiffusionSpeed() const
+{
+    return diffusionSpeed;
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+float BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::getDeathThreshold() const
+{
+    return deathThreshold;
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+float BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::getDivideThreshold() const
+{
+    return divideThreshold;
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+float BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::getDivisionCost() const
+{
+    return divideCost;
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+float BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::getConsumptionRate() const
+{
+    return consumptionRate;
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+DivisionMode BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::getDivisionMode() const
+{
+    return divisionMode;
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+const NutrientSolverOptions& BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::getNutrientSolver() const
+{
+    return nutrientSolver;
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+SimdLevel BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::getSimdLevel() const
+{
+    return engine.simdLevel;
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+size_t BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::getThreadCount() const
+{
+    return pool->getThreadCount();
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+size_t BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::getActiveTileCount() const
+{
+    return activeTiles;
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+bool BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::isInstrumented() const
+{
+    return engine.instrumentation;
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+const StepStats& BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::getStepStats() const
+{
+    return stepStats;
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+const Grid<CellState>& BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::getCellGrid() const
+{
+    return cellGrid;
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+NutrientPrecision BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::getNutrientPrecision() const
+{
+    return engine.nutrientPrecision;
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+const Grid<float>& BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::getNutrientGrid() const
 {
-    static mfb_window *window = nullptr;
+    if (!packed)
+        return nutrientGrid;
 
-    if (!window)
+    if (!unpackedCurrent)
     {
-        window = mfb_open_ex("Cellular Automata",
-                             WIDTH, HEIGHT,
-                             WF_RESIZABLE);
-        if (!window)
-            return;
+        for (size_t i = 0; i < height; i++)
+            unpackNutrients(packedNutrients[i], unpackedNutrients[i], width);
+        unpackedCurrent = true;
     }
+    return unpackedNutrients;
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+size_t BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::getOwnedRowBegin() const
+{
+    return haloAbove ? 1 : 0;
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+size_t BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::getOwnedRowEnd() const
+{
+    return haloBelow ? height - 1 : height;
+}
 
-    for (int y = 0; y < GRID_SIZE; ++y)
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+CellCounts BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::countCells() const
+{
+    return ::countCells(cellGrid);
+}
+
+CellCounts countCells(const Grid<CellState>& cellGrid)
+{
+    CellCounts counts;
+
+    for (size_t i = 0; i < cellGrid.getHeight(); i++)
     {
-        for (int x = 0; x < GRID_SIZE; ++x)
+        for (size_t j = 0; j < cellGrid.getWidth(); j++)
         {
-            uint32_t color = 0xff000000; // default: Empty (black)
-
-            switch (cellGrid[y][x])
+            switch (cellGrid[i][j])
             {
                 case CellState::Empty:
-                    color = 0xff000000; // black
                     break;
                 case CellState::Alive:
-                    color = 0xff00ff00; // green
+                    counts.alive++;
                     break;
                 case CellState::Quiescent:
-                    color = 0xffffff00; // yellow
+                    counts.quiescent++;
                     break;
                 case CellState::Necrotic:
-                    color = 0xff0000ff; // blue
+                    counts.necrotic++;
                     break;
             }
-
-            framebuffer[y * WIDTH + x] = color;
         }
     }
 
-    if (mfb_update_ex(window, framebuffer.data(), WIDTH, HEIGHT) < 0)
+    return counts;
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+void BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>::releaseGrids(Grid<CellState>& cellGrid, Grid<float>& nutrientGrid)
+{
+    cellGrid = std::move(this->cellGrid);
+    if (packed)
     {
-        mfb_close(window);
-        window = nullptr;
-        std::exit(0);
+        getNutrientGrid();
+        nutrientGrid = std::move(unpackedNutrients);
     }
+    else
+        nutrientGrid = std::move(this->nutrientGrid);
 }
 
 // Simulation Builder
 
 SimulationBuilder::SimulationBuilder(
-    std::array<std::array<CellState, GRID_SIZE>, GRID_SIZE>& cellGrid,
-    std::array<std::array<float, GRID_SIZE>, GRID_SIZE>& nutrientGrid
-) : cellGrid(cellGrid),
-    nutrientGrid(nutrientGrid)
-{}
+    const Grid<CellState>& cellGrid,
+    const Grid<float>& nutrientGrid
+) : cellGrid(&cellGrid),
+    nutrientGrid(&nutrientGrid)
+{
+    engine.simdLevel = detectSimdLevel();
+}
+
+SimulationBuilder::SimulationBuilder(
+    Grid<CellState>&& cellGrid,
+    Grid<float>&& nutrientGrid
+) : owned(std::make_shared<OwnedGrids>(OwnedGrids{ std::move(cellGrid), std::move(nutrientGrid) })),
+    cellGrid(&owned->cells),
+    nutrientGrid(&owned->nutrients)
+{
+    engine.simdLevel = detectSimdLevel();
+}
+
+SimulationBuilder::SimulationBuilder(size_t width, size_t height, const GridInitializer& initialize)
+    : SimulationBuilder(Grid<CellState>(width, height), Grid<float>(width, height))
+{
+    initialize(owned->cells, owned->nutrients);
+}
 
 SimulationBuilder& SimulationBuilder::setDiffusionSpeed(float diffusionSpeed)  
 {
@@ -278,14 +1235,183 @@ SimulationBuilder& SimulationBuilder::setDivisionCost(float divideCost)
     return *this;
 }
 
-CellularAutomata SimulationBuilder::build() const
+SimulationBuilder& SimulationBuilder::setConsumptionRate(float consumptionRate)
+{
+    this->consumptionRate = consumptionRate;
+    return *this;
+}
+
+SimulationBuilder& SimulationBuilder::setDivisionMode(DivisionMode divisionMode)
+{
+    this->divisionMode = divisionMode;
+    return *this;
+}
+
+SimulationBuilder& SimulationBuilder::setNutrientSolver(const NutrientSolverOptions& nutrientSolver)
+{
+    this->nutrientSolver = nutrientSolver;
+    return *this;
+}
+
+SimulationBuilder& SimulationBuilder::setSeed(uint64_t seed)
 {
-    return CellularAutomata(
-        cellGrid,
-        nutrientGrid,
+    this->seed = seed;
+    return *this;
+}
+
+SimulationBuilder& SimulationBuilder::setSimdLevel(SimdLevel simdLevel)
+{
+    engine.simdLevel = simdLevel;
+    return *this;
+}
+
+SimulationBuilder& SimulationBuilder::setThreads(size_t threads)
+{
+    engine.threads = threads;
+    return *this;
+}
+
+SimulationBuilder& SimulationBuilder::setTileSize(size_t tileSize)
+{
+    engine.tileSize = tileSize;
+    return *this;
+}
+
+SimulationBuilder& SimulationBuilder::setActiveRegionTolerance(float tolerance)
+{
+    engine.activeTolerance = tolerance;
+    return *this;
+}
+
+SimulationBuilder& SimulationBuilder::setInstrumentation(bool enabled)
+{
+    engine.instrumentation = enabled;
+    return *this;
+}
+
+SimulationBuilder& SimulationBuilder::setFusedStep(bool enabled)
+{
+    engine.fusedStep = enabled;
+    return *this;
+}
+
+SimulationBuilder& SimulationBuilder::setNutrientPrecision(NutrientPrecision precision)
+{
+    engine.nutrientPrecision = precision;
+    return *this;
+}
+
+std::optional<uint64_t> SimulationBuilder::getSeed() const
+{
+    return seed;
+}
+
+size_t SimulationBuilder::getWidth() const
+{
+    return cellGrid->getWidth();
+}
+
+size_t SimulationBuilder::getHeight() const
+{
+    return cellGrid->getHeight();
+}
+
+void SimulationBuilder::checkGrids() const
+{
+    if (owned && owned->cells.empty() && owned->nutrients.empty())
+        throw std::invalid_argument("SimulationBuilder: the grids were already moved into a simulation");
+    if (cellGrid->empty())
+        throw std::invalid_argument("SimulationBuilder: missing cell grid");
+    if (nutrientGrid->empty())
+        throw std::invalid_argument("SimulationBuilder: missing nutrient grid");
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+BasicCellularAutomata<Neighborhood, Boundary, DivisionRule> SimulationBuilder::build() const &
+{
+    checkGrids();
+    return buildFrom<Neighborhood, Boundary, DivisionRule>(Grid<CellState>(*cellGrid), Grid<float>(*nutrientGrid));
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+BasicCellularAutomata<Neighborhood, Boundary, DivisionRule> SimulationBuilder::build() &&
+{
+    checkGrids();
+    // Copies of this builder still see the grids, they get a copy
+    if (owned && owned.use_count() == 1)
+        return buildFrom<Neighborhood, Boundary, DivisionRule>(std::move(owned->cells), std::move(owned->nutrients));
+    return buildFrom<Neighborhood, Boundary, DivisionRule>(Grid<CellState>(*cellGrid), Grid<float>(*nutrientGrid));
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+BasicCellularAutomata<Neighborhood, Boundary, DivisionRule> SimulationBuilder::buildFrom(Grid<CellState>&& cells, Grid<float>&& nutrients) const
+{
+    if (engine.simdLevel > detectSimdLevel())
+        throw std::invalid_argument(std::string("SimulationBuilder: ") + simdLevelName(engine.simdLevel) + " is not supported by this CPU");
+    if (engine.tileSize == 0)
+        throw std::invalid_argument("SimulationBuilder: tile size must be positive");
+
+    std::random_device rd;
+    uint64_t resolvedSeed = seed ? *seed : (uint64_t(rd()) << 32) | rd();
+
+    return BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>(
+        std::move(cells),
+        std::move(nutrients),
         diffusionSpeed,
         deathThreshold,
         divideThreshold,
-        divideCost
+        divideCost,
+        consumptionRate,
+        divisionMode,
+        resolvedSeed,
+        nutrientSolver,
+        engine
     );
-}
\ No newline at end of file
+}
+
+CellularAutomata SimulationBuilder::buildSubdomain(size_t rowBegin, size_t rowEnd, HaloTransport& transport) const
+{
+    if (cellGrid->empty() || nutrientGrid->empty())
+        throw std::invalid_argument("SimulationBuilder: missing grids");
+    if (!seed)
+        throw std::invalid_argument("SimulationBuilder: a subdomain needs an explicit seed");
+    if (rowBegin >= rowEnd || rowEnd > cellGrid->getHeight())
+        throw std::invalid_argument("SimulationBuilder: subdomain rows out of range");
+
+    // The band plus a halo row on each side that has a neighbour
+    const size_t first = rowBegin > 0 ? rowBegin - 1 : 0;
+    const size_t last = std::min(rowEnd + 1, cellGrid->getHeight());
+    const size_t width = cellGrid->getWidth();
+
+    Grid<CellState> cells(width, last - first);
+    Grid<float> nutrients(width, last - first);
+    for (size_t i = first; i < last; i++)
+    {
+        std::copy((*cellGrid)[i], (*cellGrid)[i] + width, cells[i - first]);
+        std::copy((*nutrientGrid)[i], (*nutrientGrid)[i] + width, nutrients[i - first]);
+    }
+
+    SimulationBuilder band(*this);
+    band.engine.subdomain = Subdomain{ first, cellGrid->getHeight(), &transport };
+    return band.buildFrom<VonNeumann, DirichletSource, RandomNeighbor>(std::move(cells), std::move(nutrients));
+}
+
+// Every policy combination, so that users only need the header
+#define CA_INSTANTIATE(Neighborhood, Boundary, DivisionRule) \
+    template class BasicCellularAutomata<Neighborhood, Boundary, DivisionRule>; \
+    template BasicCellularAutomata<Neighborhood, Boundary, DivisionRule> SimulationBuilder::build<Neighborhood, Boundary, DivisionRule>() const &; \
+    template BasicCellularAutomata<Neighborhood, Boundary, DivisionRule> SimulationBuilder::build<Neighborhood, Boundary, DivisionRule>() &&;
+#define CA_INSTANTIATE_RULES(Neighborhood, Boundary) \
+    CA_INSTANTIATE(Neighborhood, Boundary, RandomNeighbor) \
+    CA_INSTANTIATE(Neighborhood, Boundary, RichestNeighbor)
+#define CA_INSTANTIATE_BOUNDARIES(Neighborhood) \
+    CA_INSTANTIATE_RULES(Neighborhood, DirichletSource) \
+    CA_INSTANTIATE_RULES(Neighborhood, NoFlux) \
+    CA_INSTANTIATE_RULES(Neighborhood, Periodic)
+
+CA_INSTANTIATE_BOUNDARIES(VonNeumann)
+CA_INSTANTIATE_BOUNDARIES(Moore)
+
+#undef CA_INSTANTIATE_BOUNDARIES
+#undef CA_INSTANTIATE_RULES
+#undef CA_INSTANTIATE
@@ -0,0 +1,481 @@
+#include <cellular_automata_3d.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <climits>
+#include <stdexcept>
+#include <string>
+
+
+// Cellular Automata 3D
+
+CellularAutomata3D::CellularAutomata3D(
+    Grid3D<CellState> cellGrid,
+    Grid3D<float> nutrientGrid,
+    float diffusionSpeed,
+    float deathThreshold,
+    float divideThreshold,
+    float divideCost,
+    DivisionMode divisionMode,
+    uint64_t seed,
+    const EngineOptions& engine
+) : seed(seed),
+    counterRng(seed),
+    diffusionSpeed(diffusionSpeed),
+    deathThreshold(deathThreshold),
+    divideThreshold(divideThreshold),
+    divideCost(divideCost),
+    divisionMode(divisionMode),
+    simdLevel(engine.simdLevel),
+    diffuseRow(diffusionRowKernel3D(engine.simdLevel)),
+    updateRow(cellUpdateKernel(engine.simdLevel)),
+    width(cellGrid.getWidth()),
+    height(cellGrid.getHeight()),
+    depth(cellGrid.getDepth())
+{
+    if (nutrientGrid.getWidth() != width || nutrientGrid.getHeight() != height || nutrientGrid.getDepth() != depth)
+        throw std::invalid_argument("Cell and nutrient grids must have the same size");
+    if (width < 3 || height < 3 || depth < 3)
+        throw std::invalid_argument("Volumes must be at least 3x3x3");
+    // Alive cells are listed as (z * height + y, x)
+    if (height * depth > size_t(INT_MAX) || width > size_t(INT_MAX))
+        throw std::invalid_argument("Volume too large");
+    if (engine.activeTolerance || engine.instrumentation || engine.subdomain)
+        throw std::invalid_argument("Volumes support neither active regions, instrumentation nor subdomains");
+
+    // Set the grids
+    this->cellGrid = std::move(cellGrid);
+    this->nutrientGrid = std::move(nutrientGrid);
+    nextNutrientGrid = Grid3D<float>(width, height, depth);
+
+    // Set the execution engine
+    const size_t bricks = this->cellGrid.getBrickCount();
+    pool = std::make_unique<ThreadPool>(engine.threads);
+    brickAliveCells.resize(bricks);
+
+    if (divisionMode == DivisionMode::Deterministic)
+    {
+        divisionClaims = Grid3D<uint64_t>(width, height, depth);
+        brickClaims.resize(bricks);
+    }
+
+    // Set the RNG
+    std::seed_seq seedSequence{ uint32_t(seed), uint32_t(seed >> 32) };
+    gen.seed(seedSequence);
+}
+
+void CellularAutomata3D::diffuseNutrients()
+{
+    // Stencil and face refill in one pass into the back buffer,
+    // which then becomes the current grid
+    pool->parallelFor(cellGrid.getBrickCount(), [this](size_t index, size_t)
+    {
+        diffuseBrick(index);
+    });
+    nutrientGrid.swap(nextNutrientGrid);
+}
+
+void CellularAutomata3D::diffuseBrick(size_t index)
+{
+    const Grid3D<float>::Brick brick = nutrientGrid.brick(index);
+
+    for (size_t z = brick.zBegin; z < brick.zEnd; z++)
+    {
+        for (size_t y = brick.yBegin; y < brick.yEnd; y++)
+        {
+            float* out = nextNutrientGrid.row(y, z);
+            if (y == 0 || y == height - 1 || z == 0 || z == depth - 1)
+            {
+                std::fill(out, out + width, MAX_NUTRIENT);
+                continue;
+            }
+
+            out[0] = MAX_NUTRIENT;
+            diffuseRow(nutrientGrid.row(y, z), nutrientGrid.row(y - 1, z), nutrientGrid.row(y + 1, z),
+                       nutrientGrid.row(y, z - 1), nutrientGrid.row(y, z + 1), out, width, diffusionSpeed);
+            out[width - 1] = MAX_NUTRIENT;
+        }
+    }
+}
+
+void CellularAutomata3D::updateCells()
+{
+    pool->parallelFor(cellGrid.getBrickCount(), [this](size_t index, size_t)
+    {
+        updateBrick(index);
+    });
+
+    // Only the sequential division depends on the order of the parents
+    if (divisionMode == DivisionMode::Sequential)
+        gatherAliveCells();
+}
+
+void CellularAutomata3D::updateBrick(size_t index)
+{
+    // Each cell only depends on its own state and nutrient,
+    // so the grid is updated in place
+    const Grid3D<CellState>::Brick brick = cellGrid.brick(index);
+
+    std::vector<std::pair<int, int>>& cells = brickAliveCells[index];
+    cells.clear();
+    StateTally tally;
+
+    // Iterate only over inner cells, z-major like the bricks
+    for (size_t z = std::max<size_t>(brick.zBegin, 1); z < std::min(brick.zEnd, depth - 1); z++)
+        for (size_t y = std::max<size_t>(brick.yBegin, 1); y < std::min(brick.yEnd, height - 1); y++)
+            updateRow(cellGrid.row(y, z), nutrientGrid.row(y, z), nullptr, 1, width - 1, int(z * height + y),
+                      divideThreshold, deathThreshold, cells, tally);
+}
+
+void CellularAutomata3D::gatherAliveCells()
+{
+    // Each brick lists its cells in (z, y, x) order. Interleaving the bricks
+    // of every brick layer row by row gives that order over the whole volume.
+    const size_t bricksY = cellGrid.getBricksY();
+    const size_t layers = cellGrid.getBricksZ();
+
+    std::vector<size_t> layerOffsets(layers + 1, 0);
+    for (size_t bz = 0; bz < layers; bz++)
+    {
+        layerOffsets[bz + 1] = layerOffsets[bz];
+        for (size_t by = 0; by < bricksY; by++)
+            layerOffsets[bz + 1] += brickAliveCells[bz * bricksY + by].size();
+    }
+
+    aliveCells.resize(layerOffsets.back());
+
+    pool->parallelFor(layers, [&](size_t bz, size_t)
+    {
+        std::vector<size_t> cursors(bricksY, 0);
+        auto out = aliveCells.begin() + layerOffsets[bz];
+
+        const Grid3D<CellState>::Brick layer = cellGrid.brick(bz * bricksY);
+        for (size_t z = layer.zBegin; z < layer.zEnd; z++)
+        {
+            for (size_t by = 0; by < bricksY; by++)
+            {
+                const auto& cells = brickAliveCells[bz * bricksY + by];
+                size_t& cursor = cursors[by];
+                while (cursor < cells.size() && size_t(cells[cursor].first) / height == z)
+                    *out++ = cells[cursor++];
+            }
+        }
+    });
+}
+
+// Distinct generation tags in the high half of a division claim key
+static constexpr uint64_t CLAIM_GENERATIONS = 0xffffffffull;
+
+// Offsets of the 6 face neighbours: -x, +x, -y, +y, -z, +z
+static constexpr int NEIGHBOR_DX[6] = { -1, 1, 0, 0, 0, 0 };
+static constexpr int NEIGHBOR_DY[6] = { 0, 0, -1, 1, 0, 0 };
+static constexpr int NEIGHBOR_DZ[6] = { 0, 0, 0, 0, -1, 1 };
+
+void CellularAutomata3D::divideCells()
+{
+    switch (divisionMode)
+    {
+        case DivisionMode::Sequential:
+            divideCellsSequential();
+            break;
+        case DivisionMode::Deterministic:
+            // Claim tags are about to wrap around
+            if (epoch > 0 && epoch % CLAIM_GENERATIONS == 0)
+                divisionClaims.fill(0);
+
+            // Claims only read the post-update grid, commits only write it
+            pool->parallelFor(cellGrid.getBrickCount(), [this](size_t index, size_t)
+            {
+                claimDivisions(index);
+            });
+            pool->parallelFor(cellGrid.getBrickCount(), [this](size_t index, size_t)
+            {
+                commitDivisions(index);
+            });
+            break;
+    }
+
+    // Divisions close the epoch, so the phases can also be driven one by one
+    epoch++;
+}
+
+void CellularAutomata3D::divideCellsSequential()
+{
+    // Mitosis, parents in (z, y, x) order, daughters visible to later parents
+    for (auto& cell : aliveCells)
+    {
+        const int z = int(size_t(cell.first) / height), y = int(size_t(cell.first) % height), x = cell.second;
+
+        std::array<int, 6> availableNeighbors;
+        int neighborCount = 0;
+        for (int n = 0; n < 6; n++)
+            if (cellGrid.at(x + NEIGHBOR_DX[n], y + NEIGHBOR_DY[n], z + NEIGHBOR_DZ[n]) == CellState::Empty)
+                availableNeighbors[neighborCount++] = n;
+
+        if (neighborCount == 0)
+            continue;
+
+        // Distribution over valid indices
+        std::uniform_int_distribution<> dist(0, neighborCount - 1);
+        const int n = availableNeighbors[dist(gen)];
+        cellGrid.at(x + NEIGHBOR_DX[n], y + NEIGHBOR_DY[n], z + NEIGHBOR_DZ[n]) = CellState::Alive;
+
+        float& nutrient = nutrientGrid.at(x, y, z);
+        if ((nutrient -= divideCost) < MIN_NUTRIENT) nutrient = MIN_NUTRIENT;
+    }
+}
+
+void CellularAutomata3D::claimDivisions(size_t index)
+{
+    // Same scheme as CellularAutomata::claimDivisions(), with the direction
+    // in the low three bits of the key
+    const uint64_t tag = (epoch % CLAIM_GENERATIONS + 1) << 32;
+
+    std::vector<DivisionClaim>& claims = brickClaims[index];
+    claims.clear();
+
+    for (auto& cell : brickAliveCells[index])
+    {
+        const int z = int(size_t(cell.first) / height), y = int(size_t(cell.first) % height), x = cell.second;
+
+        std::array<int, 6> availableNeighbors;
+        int neighborCount = 0;
+        for (int n = 0; n < 6; n++)
+            if (cellGrid.at(x + NEIGHBOR_DX[n], y + NEIGHBOR_DY[n], z + NEIGHBOR_DZ[n]) == CellState::Empty)
+                availableNeighbors[neighborCount++] = n;
+
+        if (neighborCount == 0)
+            continue;
+
+        // Choice and priority only depend on (seed, epoch, x, y, z)
+        Philox4x32::Counter draw = counterRng(epoch, uint32_t(x), uint32_t(y), uint32_t(z));
+        const int n = availableNeighbors[Philox4x32::below(draw[0], uint32_t(neighborCount))];
+        const int tx = x + NEIGHBOR_DX[n], ty = y + NEIGHBOR_DY[n], tz = z + NEIGHBOR_DZ[n];
+
+        uint64_t key = tag | (draw[1] & ~7u) | uint32_t(n);
+
+        std::atomic_ref<uint64_t> slot(divisionClaims.at(tx, ty, tz));
+        uint64_t current = slot.load(std::memory_order_relaxed);
+        while (current < key && !slot.compare_exchange_weak(current, key, std::memory_order_relaxed))
+            ;
+
+        claims.push_back({ x, y, z, tx, ty, tz, key });
+    }
+}
+
+void CellularAutomata3D::commitDivisions(size_t index)
+{
+    for (const DivisionClaim& claim : brickClaims[index])
+    {
+        // Lost to a higher priority parent
+        if (divisionClaims.at(claim.tx, claim.ty, claim.tz) != claim.key)
+            continue;
+
+        cellGrid.at(claim.tx, claim.ty, claim.tz) = CellState::Alive;
+        float& nutrient = nutrientGrid.at(claim.x, claim.y, claim.z);
+        if ((nutrient -= divideCost) < MIN_NUTRIENT) nutrient = MIN_NUTRIENT;
+    }
+}
+
+void CellularAutomata3D::step()
+{
+    diffuseNutrients();
+    updateCells();
+    divideCells();
+}
+
+size_t CellularAutomata3D::getWidth() const
+{
+    return width;
+}
+
+size_t CellularAutomata3D::getHeight() const
+{
+    return height;
+}
+
+size_t CellularAutomata3D::getDepth() const
+{
+    return depth;
+}
+
+uint64_t CellularAutomata3D::getEpoch() const
+{
+    return epoch;
+}
+
+uint64_t CellularAutomata3D::getSeed() const
+{
+    return seed;
+}
+
+DivisionMode CellularAutomata3D::getDivisionMode() const
+{
+    return divisionMode;
+}
+
+SimdLevel CellularAutomata3D::getSimdLevel() const
+{
+    return simdLevel;
+}
+
+size_t CellularAutomata3D::getThreadCount() const
+{
+    return pool->getThreadCount();
+}
+
+const Grid3D<CellState>& CellularAutomata3D::getCellGrid() const
+{
+    return cellGrid;
+}
+
+const Grid3D<float>& CellularAutomata3D::getNutrientGrid() const
+{
+    return nutrientGrid;
+}
+
+CellCounts CellularAutomata3D::countCells() const
+{
+    CellCounts counts;
+
+    for (size_t z = 0; z < depth; z++)
+    {
+        for (size_t y = 0; y < height; y++)
+        {
+            const CellState* row = cellGrid.row(y, z);
+            for (size_t x = 0; x < width; x++)
+            {
+                switch (row[x])
+                {
+                    case CellState::Alive:
+                        counts.alive++;
+                        break;
+                    case CellState::Quiescent:
+                        counts.quiescent++;
+                        break;
+                    case CellState::Necrotic:
+                        counts.necrotic++;
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+    return counts;
+}
+
+
+// Simulation Builder 3D
+
+SimulationBuilder3D::SimulationBuilder3D(
+    const Grid3D<CellState>& cellGrid,
+    const Grid3D<float>& nutrientGrid
+) : cellGrid(&cellGrid),
+    nutrientGrid(&nutrientGrid)
+{
+    engine.simdLevel = detectSimdLevel();
+}
+
+SimulationBuilder3D::SimulationBuilder3D(
+    Grid3D<CellState>&& cellGrid,
+    Grid3D<float>&& nutrientGrid
+) : owned(std::make_shared<OwnedGrids>(OwnedGrids{ std::move(cellGrid), std::move(nutrientGrid) })),
+    cellGrid(&owned->cells),
+    nutrientGrid(&owned->nutrients)
+{
+    engine.simdLevel = detectSimdLevel();
+}
+
+SimulationBuilder3D& SimulationBuilder3D::setDiffusionSpeed(float diffusionSpeed)
+{
+    this->diffusionSpeed = diffusionSpeed;
+    return *this;
+}
+
+SimulationBuilder3D& SimulationBuilder3D::setDeathThreshold(float deathThreshold)
+{
+    this->deathThreshold = deathThreshold;
+    return *this;
+}
+
+SimulationBuilder3D& SimulationBuilder3D::setDivideThreshold(float divideThreshold)
+{
+    this->divideThreshold = divideThreshold;
+    return *this;
+}
+
+SimulationBuilder3D& SimulationBuilder3D::setDivisionCost(float divideCost)
+{
+    this->divideCost = divideCost;
+    return *this;
+}
+
+SimulationBuilder3D& SimulationBuilder3D::setDivisionMode(DivisionMode divisionMode)
+{
+    this->divisionMode = divisionMode;
+    return *this;
+}
+
+SimulationBuilder3D& SimulationBuilder3D::setSeed(uint64_t seed)
+{
+    this->seed = seed;
+    return *this;
+}
+
+SimulationBuilder3D& SimulationBuilder3D::setSimdLevel(SimdLevel simdLevel)
+{
+    engine.simdLevel = simdLevel;
+    return *this;
+}
+
+SimulationBuilder3D& SimulationBuilder3D::setThreads(size_t threads)
+{
+    engine.threads = threads;
+    return *this;
+}
+
+void SimulationBuilder3D::checkGrids() const
+{
+    if (owned && owned->cells.empty() && owned->nutrients.empty())
+        throw std::invalid_argument("SimulationBuilder3D: the grids were already moved into a simulation");
+    if (cellGrid->empty() || nutrientGrid->empty())
+        throw std::invalid_argument("SimulationBuilder3D: missing grids");
+}
+
+CellularAutomata3D SimulationBuilder3D::build() const &
+{
+    checkGrids();
+    return buildFrom(Grid3D<CellState>(*cellGrid), Grid3D<float>(*nutrientGrid));
+}
+
+CellularAutomata3D SimulationBuilder3D::build() &&
+{
+    checkGrids();
+    // Copies of this builder still see the grids, they get a copy
+    if (owned && owned.use_count() == 1)
+        return buildFrom(std::move(owned->cells), std::move(owned->nutrients));
+    return buildFrom(Grid3D<CellState>(*cellGrid), Grid3D<float>(*nutrientGrid));
+}
+
+CellularAutomata3D SimulationBuilder3D::buildFrom(Grid3D<CellState>&& cells, Grid3D<float>&& nutrients) const
+{
+    if (engine.simdLevel > detectSimdLevel())
+        throw std::invalid_argument(std::string("SimulationBuilder3D: ") + simdLevelName(engine.simdLevel) + " is not supported by this CPU");
+
+    std::random_device rd;
+    uint64_t resolvedSeed = seed ? *seed : (uint64_t(rd()) << 32) | rd();
+
+    return CellularAutomata3D(
+        std::move(cells),
+        std::move(nutrients),
+        diffusionSpeed,
+        deathThreshold,
+        divideThreshold,
+        divideCost,
+        divisionMode,
+        resolvedSeed,
+        engine
+    );
+}
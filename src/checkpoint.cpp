@@ -0,0 +1,251 @@
+#include <checkpoint.hpp>
+
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CA_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+static constexpr char CHECKPOINT_MAGIC[8] = { 'C', 'A', 'S', 'N', 'A', 'P', 0, 0 };
+
+// Version 1 headers stop before the nutrient solver, which was always explicit
+static constexpr uint32_t CHECKPOINT_V1_HEADER_SIZE = offsetof(CheckpointHeader, nutrientSolver);
+// Version 2 headers stop before the consumption rate, which was always 0
+static constexpr uint32_t CHECKPOINT_V2_HEADER_SIZE = offsetof(CheckpointHeader, consumptionRate);
+
+static uint64_t alignPayload(uint64_t offset)
+{
+    return (offset + CHECKPOINT_PAYLOAD_ALIGNMENT - 1) / CHECKPOINT_PAYLOAD_ALIGNMENT * CHECKPOINT_PAYLOAD_ALIGNMENT;
+}
+
+static void writePadding(std::ofstream& out, uint64_t offset)
+{
+    static const char zeros[CHECKPOINT_PAYLOAD_ALIGNMENT] = {};
+    uint64_t position = uint64_t(out.tellp());
+    out.write(zeros, std::streamsize(offset - position));
+}
+
+void Checkpoint::save(const CellularAutomata& sim, const std::string& path)
+{
+    std::ostringstream rng;
+    rng << sim.gen;
+    const std::string rngState = rng.str();
+
+    const Grid<CellState>& cells = sim.getCellGrid();
+    const Grid<float>& nutrients = sim.getNutrientGrid();
+
+    CheckpointHeader header{};
+    std::memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.headerSize = sizeof(CheckpointHeader);
+    header.width = sim.getWidth();
+    header.height = sim.getHeight();
+    header.epoch = sim.getEpoch();
+    header.seed = sim.getSeed();
+    header.diffusionSpeed = sim.getDiffusionSpeed();
+    header.deathThreshold = sim.getDeathThreshold();
+    header.divideThreshold = sim.getDivideThreshold();
+    header.divideCost = sim.getDivisionCost();
+    header.divisionMode = uint32_t(sim.getDivisionMode());
+    header.cellStateSize = sizeof(CellState);
+    header.nutrientSolver = uint32_t(sim.getNutrientSolver().solver);
+    header.solverMaxCycles = uint32_t(sim.getNutrientSolver().maxCycles);
+    header.solverTimeStep = sim.getNutrientSolver().timeStep;
+    header.solverTolerance = sim.getNutrientSolver().tolerance;
+    header.consumptionRate = sim.getConsumptionRate();
+    header.nutrientPrecision = uint32_t(sim.getNutrientPrecision());
+    header.rngOffset = sizeof(CheckpointHeader);
+    header.rngSize = rngState.size();
+    header.cellOffset = alignPayload(header.rngOffset + header.rngSize);
+    header.cellSize = cells.getStride() * cells.getHeight() * sizeof(CellState);
+    header.nutrientOffset = alignPayload(header.cellOffset + header.cellSize);
+    header.nutrientSize = nutrients.getStride() * nutrients.getHeight() * sizeof(float);
+
+    const std::string partial = path + ".partial";
+    {
+        std::ofstream out(partial, std::ios::binary | std::ios::trunc);
+        if (!out)
+            throw std::runtime_error("Unable to write checkpoint " + partial);
+
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(rngState.data(), std::streamsize(rngState.size()));
+        writePadding(out, header.cellOffset);
+        out.write(reinterpret_cast<const char*>(cells.data()), std::streamsize(header.cellSize));
+        writePadding(out, header.nutrientOffset);
+        out.write(reinterpret_cast<const char*>(nutrients.data()), std::streamsize(header.nutrientSize));
+
+        if (!out.flush())
+            throw std::runtime_error("Unable to write checkpoint " + partial);
+    }
+    std::filesystem::rename(partial, path);
+}
+
+Checkpoint::Checkpoint(const std::string& path)
+    : path(path)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        throw std::runtime_error("Unable to open checkpoint " + path);
+
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)))
+        throw std::runtime_error("Truncated checkpoint header in " + path);
+
+    if (std::memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0)
+        throw std::runtime_error(path + " is not a checkpoint");
+    if (header.version == 1 && header.headerSize == CHECKPOINT_V1_HEADER_SIZE)
+    {
+        // What was read past the old header is the RNG state
+        NutrientSolverOptions explicitSolver;
+        header.nutrientSolver = uint32_t(explicitSolver.solver);
+        header.solverMaxCycles = uint32_t(explicitSolver.maxCycles);
+        header.solverTimeStep = explicitSolver.timeStep;
+        header.solverTolerance = explicitSolver.tolerance;
+        header.consumptionRate = 0.0f;
+        header.nutrientPrecision = uint32_t(NutrientPrecision::Float32);
+    }
+    else if (header.version == 2 && header.headerSize == CHECKPOINT_V2_HEADER_SIZE)
+    {
+        header.consumptionRate = 0.0f;
+        header.nutrientPrecision = uint32_t(NutrientPrecision::Float32);
+    }
+    // Version 3 headers are as long, with zero padding in place of the precision
+    else if (header.version == 3 && header.headerSize == sizeof(CheckpointHeader))
+        header.nutrientPrecision = uint32_t(NutrientPrecision::Float32);
+    else if (header.version != CHECKPOINT_VERSION || header.headerSize != sizeof(CheckpointHeader))
+        throw std::runtime_error(path + " has unsupported checkpoint version " + std::to_string(header.version));
+    if (header.cellStateSize != sizeof(CellState))
+        throw std::runtime_error(path + " was written with a different cell state size");
+    if (header.divisionMode > uint32_t(DivisionMode::Deterministic))
+        throw std::runtime_error(path + " has an unknown division mode");
+    if (header.nutrientSolver > uint32_t(NutrientSolver::SteadyState))
+        throw std::runtime_error(path + " has an unknown nutrient solver");
+    if (header.nutrientPrecision > uint32_t(NutrientPrecision::Fixed16))
+        throw std::runtime_error(path + " has an unknown nutrient precision");
+    if (!(header.consumptionRate >= 0.0f))
+        throw std::runtime_error(path + " has an invalid consumption rate");
+
+    // Payloads must match the Grid layout for the stored size
+    uint64_t alignment = header.version < 4 ? CHECKPOINT_V3_PAYLOAD_ALIGNMENT : CHECKPOINT_PAYLOAD_ALIGNMENT;
+    if (header.width < 3 || header.height < 3 ||
+        header.cellSize != Grid<CellState>::strideFor(header.width) * header.height * sizeof(CellState) ||
+        header.nutrientSize != Grid<float>::strideFor(header.width) * header.height * sizeof(float) ||
+        header.cellOffset % alignment != 0 ||
+        header.nutrientOffset % alignment != 0)
+        throw std::runtime_error(path + " has an inconsistent checkpoint layout");
+
+    // Header, RNG state, cells and nutrients follow each other without
+    // overlapping, and all of them lie in the file. Subtractions only, so
+    // offsets and sizes from a corrupt file cannot overflow.
+    if (header.rngOffset < header.headerSize ||
+        header.cellOffset < header.rngOffset || header.rngSize > header.cellOffset - header.rngOffset ||
+        header.nutrientOffset < header.cellOffset || header.cellSize > header.nutrientOffset - header.cellOffset)
+        throw std::runtime_error(path + " has an inconsistent checkpoint layout");
+
+    const uint64_t fileSize = std::filesystem::file_size(path);
+    if (header.nutrientOffset > fileSize || header.nutrientSize > fileSize - header.nutrientOffset)
+        throw std::runtime_error(path + " is truncated");
+
+    rngState.resize(header.rngSize);
+    in.seekg(std::streamoff(header.rngOffset));
+    if (!in.read(rngState.data(), std::streamsize(rngState.size())))
+        throw std::runtime_error("Truncated RNG state in " + path);
+}
+
+const CheckpointHeader& Checkpoint::getHeader() const
+{
+    return header;
+}
+
+template <typename T>
+static Grid<T> readPayload(const std::string& path, uint64_t width, uint64_t height, uint64_t offset, uint64_t size)
+{
+    Grid<T> grid(width, height);
+    std::ifstream in(path, std::ios::binary);
+    in.seekg(std::streamoff(offset));
+    if (!in.read(reinterpret_cast<char*>(grid.data()), std::streamsize(size)))
+        throw std::runtime_error("Unable to read checkpoint " + path);
+    return grid;
+}
+
+template <typename T>
+static Grid<T> mapPayload(const std::string& path, uint64_t width, uint64_t height, uint64_t offset, uint64_t size)
+{
+#ifdef CA_HAS_MMAP
+    // mmap needs a page-aligned offset; larger pages than the file was
+    // written for fall back to reading
+    long pageSize = ::sysconf(_SC_PAGESIZE);
+    if (pageSize <= 0 || offset % uint64_t(pageSize) != 0)
+        return readPayload<T>(path, width, height, offset, size);
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Unable to open checkpoint " + path);
+
+    void* mapped = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, off_t(offset));
+    ::close(fd);
+    if (mapped == MAP_FAILED)
+        throw std::runtime_error("Unable to map checkpoint " + path);
+
+    std::shared_ptr<void> owner(mapped, [size](void* address) { ::munmap(address, size); });
+    return Grid<T>::adopt(width, height, static_cast<T*>(mapped), std::move(owner));
+#else
+    // No mmap: read the payload into a regular grid
+    return readPayload<T>(path, width, height, offset, size);
+#endif
+}
+
+Grid<CellState> Checkpoint::mapCellGrid() const
+{
+    return mapPayload<CellState>(path, header.width, header.height, header.cellOffset, header.cellSize);
+}
+
+Grid<float> Checkpoint::mapNutrientGrid() const
+{
+    return mapPayload<float>(path, header.width, header.height, header.nutrientOffset, header.nutrientSize);
+}
+
+CellularAutomata Checkpoint::restore(const EngineOptions& engine, std::optional<uint64_t> seed) const
+{
+    NutrientSolverOptions nutrientSolver;
+    nutrientSolver.solver = NutrientSolver(header.nutrientSolver);
+    nutrientSolver.maxCycles = header.solverMaxCycles;
+    nutrientSolver.timeStep = header.solverTimeStep;
+    nutrientSolver.tolerance = header.solverTolerance;
+
+    // Fixed16 grids are saved unpacked and pack back to the same values
+    EngineOptions stored = engine;
+    stored.nutrientPrecision = NutrientPrecision(header.nutrientPrecision);
+
+    CellularAutomata sim(
+        mapCellGrid(),
+        mapNutrientGrid(),
+        header.diffusionSpeed,
+        header.deathThreshold,
+        header.divideThreshold,
+        header.divideCost,
+        header.consumptionRate,
+        DivisionMode(header.divisionMode),
+        seed.value_or(header.seed),
+        nutrientSolver,
+        stored
+    );
+
+    sim.epoch = header.epoch;
+
+    // Same seed: pick the sequential generator up where it stopped
+    if (!seed || *seed == header.seed)
+    {
+        std::istringstream rng(rngState);
+        rng >> sim.gen;
+    }
+
+    return sim;
+}
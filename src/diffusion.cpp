@@ -0,0 +1,422 @@
+#include <diffusion.hpp>
+#include <cellular_automata.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef CA_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+// Scalar reference for a single inner cell. The SIMD kernels below follow
+// the exact same operation order, and the library is built without
+// floating point contraction, so all of them round identically.
+static inline float diffuseCell(float top, float left, float bottom, float right, float center, float diffusionSpeed)
+{
+    float nutrientAvg = top;
+    nutrientAvg += left;
+    nutrientAvg += bottom;
+    nutrientAvg += right;
+    nutrientAvg /= 4.0f;
+
+    float value = ((nutrientAvg - center) * diffusionSpeed) + center;
+
+    if (value > 1.0f) value = 1.0f;
+    if (value < 0.0f) value = 0.0f;
+    return value;
+}
+
+static void diffuseRowScalar(const float* up, const float* row, const float* down, float* out, size_t j, size_t jEnd, float diffusionSpeed)
+{
+    for (; j < jEnd; j++)
+        out[j] = diffuseCell(up[j], row[j - 1], down[j], row[j + 1], row[j], diffusionSpeed);
+}
+
+// A block of a grid through one of the row kernels, with the border refill
+template <DiffusionRowKernel diffuseRow>
+static void diffuseBlock(const Grid<float>& src, Grid<float>& dst, float diffusionSpeed, size_t rowBegin, size_t rowEnd, size_t colBegin, size_t colEnd)
+{
+    const size_t width = src.getWidth();
+    const size_t height = src.getHeight();
+    // Inner columns of the block
+    const size_t jBegin = std::max<size_t>(colBegin, 1);
+    const size_t jEnd = std::min(colEnd, width - 1);
+
+    for (size_t i = rowBegin; i < rowEnd; i++)
+    {
+        float* out = dst[i];
+        if (i == 0 || i == height - 1)
+        {
+            std::fill(out + colBegin, out + colEnd, MAX_NUTRIENT);
+            continue;
+        }
+
+        if (colBegin == 0) out[0] = MAX_NUTRIENT;
+        diffuseRow(src[i - 1], src[i], src[i + 1], out, jBegin, jEnd, diffusionSpeed);
+        if (colEnd == width) out[width - 1] = MAX_NUTRIENT;
+    }
+}
+
+#ifdef CA_X86_KERNELS
+
+CA_TARGET("avx2")
+static void diffuseRowAvx2(const float* up, const float* row, const float* down, float* out, size_t j, size_t jEnd, float diffusionSpeed)
+{
+    const __m256 quarter = _mm256_set1_ps(0.25f);
+    const __m256 speed = _mm256_set1_ps(diffusionSpeed);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+
+    for (; j + 8 <= jEnd; j += 8)
+    {
+        __m256 center = _mm256_loadu_ps(row + j);
+        __m256 avg = _mm256_add_ps(_mm256_loadu_ps(up + j), _mm256_loadu_ps(row + j - 1));
+        avg = _mm256_add_ps(avg, _mm256_loadu_ps(down + j));
+        avg = _mm256_add_ps(avg, _mm256_loadu_ps(row + j + 1));
+        avg = _mm256_mul_ps(avg, quarter);
+
+        __m256 value = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(avg, center), speed), center);
+        // min/max return their second operand on NaN, matching the scalar clamps
+        value = _mm256_max_ps(zero, _mm256_min_ps(one, value));
+        _mm256_storeu_ps(out + j, value);
+    }
+    diffuseRowScalar(up, row, down, out, j, jEnd, diffusionSpeed);
+}
+
+CA_TARGET("avx512f")
+static void diffuseRowAvx512(const float* up, const float* row, const float* down, float* out, size_t jBegin, size_t jEnd, float diffusionSpeed)
+{
+    const __m512 quarter = _mm512_set1_ps(0.25f);
+    const __m512 speed = _mm512_set1_ps(diffusionSpeed);
+    const __m512 zero = _mm512_setzero_ps();
+    const __m512 one = _mm512_set1_ps(1.0f);
+
+    for (size_t j = jBegin; j < jEnd; j += 16)
+    {
+        // The last chunk is masked instead of falling back to scalar
+        size_t remaining = std::min<size_t>(16, jEnd - j);
+        __mmask16 mask = __mmask16((1u << remaining) - 1);
+
+        __m512 center = _mm512_maskz_loadu_ps(mask, row + j);
+        __m512 avg = _mm512_add_ps(_mm512_maskz_loadu_ps(mask, up + j), _mm512_maskz_loadu_ps(mask, row + j - 1));
+        avg = _mm512_add_ps(avg, _mm512_maskz_loadu_ps(mask, down + j));
+        avg = _mm512_add_ps(avg, _mm512_maskz_loadu_ps(mask, row + j + 1));
+        avg = _mm512_mul_ps(avg, quarter);
+
+        __m512 value = _mm512_add_ps(_mm512_mul_ps(_mm512_sub_ps(avg, center), speed), center);
+        value = _mm512_maskz_max_ps(mask, zero, _mm512_maskz_min_ps(mask, one, value));
+        _mm512_mask_storeu_ps(out + j, mask, value);
+    }
+}
+
+#endif
+
+DiffusionRowKernel diffusionRowKernel(SimdLevel level)
+{
+    switch (level)
+    {
+#ifdef CA_X86_KERNELS
+        case SimdLevel::AVX512: return diffuseRowAvx512;
+        case SimdLevel::AVX2:   return diffuseRowAvx2;
+#endif
+        default:                return diffuseRowScalar;
+    }
+}
+
+DiffusionKernel diffusionKernel(SimdLevel level)
+{
+    switch (level)
+    {
+#ifdef CA_X86_KERNELS
+        case SimdLevel::AVX512: return diffuseBlock<diffuseRowAvx512>;
+        case SimdLevel::AVX2:   return diffuseBlock<diffuseRowAvx2>;
+#endif
+        default:                return diffuseBlock<diffuseRowScalar>;
+    }
+}
+
+// Moore
+
+// Scalar reference for a single inner cell averaging all 8 neighbours
+static inline float diffuseCellMoore(const float* up, const float* row, const float* down, size_t j, float diffusionSpeed)
+{
+    float nutrientAvg = up[j - 1];
+    nutrientAvg += up[j];
+    nutrientAvg += up[j + 1];
+    nutrientAvg += row[j - 1];
+    nutrientAvg += row[j + 1];
+    nutrientAvg += down[j - 1];
+    nutrientAvg += down[j];
+    nutrientAvg += down[j + 1];
+    nutrientAvg /= 8.0f;
+
+    const float center = row[j];
+    float value = ((nutrientAvg - center) * diffusionSpeed) + center;
+
+    if (value > 1.0f) value = 1.0f;
+    if (value < 0.0f) value = 0.0f;
+    return value;
+}
+
+static void diffuseRowMooreScalar(const float* up, const float* row, const float* down, float* out, size_t j, size_t jEnd, float diffusionSpeed)
+{
+    for (; j < jEnd; j++)
+        out[j] = diffuseCellMoore(up, row, down, j, diffusionSpeed);
+}
+
+#ifdef CA_X86_KERNELS
+
+CA_TARGET("avx2")
+static void diffuseRowMooreAvx2(const float* up, const float* row, const float* down, float* out, size_t j, size_t jEnd, float diffusionSpeed)
+{
+    const __m256 eighth = _mm256_set1_ps(0.125f);
+    const __m256 speed = _mm256_set1_ps(diffusionSpeed);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+
+    for (; j + 8 <= jEnd; j += 8)
+    {
+        __m256 avg = _mm256_add_ps(_mm256_loadu_ps(up + j - 1), _mm256_loadu_ps(up + j));
+        avg = _mm256_add_ps(avg, _mm256_loadu_ps(up + j + 1));
+        avg = _mm256_add_ps(avg, _mm256_loadu_ps(row + j - 1));
+        avg = _mm256_add_ps(avg, _mm256_loadu_ps(row + j + 1));
+        avg = _mm256_add_ps(avg, _mm256_loadu_ps(down + j - 1));
+        avg = _mm256_add_ps(avg, _mm256_loadu_ps(down + j));
+        avg = _mm256_add_ps(avg, _mm256_loadu_ps(down + j + 1));
+        avg = _mm256_mul_ps(avg, eighth);
+
+        __m256 center = _mm256_loadu_ps(row + j);
+        __m256 value = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(avg, center), speed), center);
+        value = _mm256_max_ps(zero, _mm256_min_ps(one, value));
+        _mm256_storeu_ps(out + j, value);
+    }
+    diffuseRowMooreScalar(up, row, down, out, j, jEnd, diffusionSpeed);
+}
+
+CA_TARGET("avx512f")
+static void diffuseRowMooreAvx512(const float* up, const float* row, const float* down, float* out, size_t jBegin, size_t jEnd, float diffusionSpeed)
+{
+    const __m512 eighth = _mm512_set1_ps(0.125f);
+    const __m512 speed = _mm512_set1_ps(diffusionSpeed);
+    const __m512 zero = _mm512_setzero_ps();
+    const __m512 one = _mm512_set1_ps(1.0f);
+
+    for (size_t j = jBegin; j < jEnd; j += 16)
+    {
+        size_t remaining = std::min<size_t>(16, jEnd - j);
+        __mmask16 mask = __mmask16((1u << remaining) - 1);
+
+        __m512 avg = _mm512_add_ps(_mm512_maskz_loadu_ps(mask, up + j - 1), _mm512_maskz_loadu_ps(mask, up + j));
+        avg = _mm512_add_ps(avg, _mm512_maskz_loadu_ps(mask, up + j + 1));
+        avg = _mm512_add_ps(avg, _mm512_maskz_loadu_ps(mask, row + j - 1));
+        avg = _mm512_add_ps(avg, _mm512_maskz_loadu_ps(mask, row + j + 1));
+        avg = _mm512_add_ps(avg, _mm512_maskz_loadu_ps(mask, down + j - 1));
+        avg = _mm512_add_ps(avg, _mm512_maskz_loadu_ps(mask, down + j));
+        avg = _mm512_add_ps(avg, _mm512_maskz_loadu_ps(mask, down + j + 1));
+        avg = _mm512_mul_ps(avg, eighth);
+
+        __m512 center = _mm512_maskz_loadu_ps(mask, row + j);
+        __m512 value = _mm512_add_ps(_mm512_mul_ps(_mm512_sub_ps(avg, center), speed), center);
+        value = _mm512_maskz_max_ps(mask, zero, _mm512_maskz_min_ps(mask, one, value));
+        _mm512_mask_storeu_ps(out + j, mask, value);
+    }
+}
+
+#endif
+
+DiffusionRowKernel mooreDiffusionRowKernel(SimdLevel level)
+{
+    switch (level)
+    {
+#ifdef CA_X86_KERNELS
+        case SimdLevel::AVX512: return diffuseRowMooreAvx512;
+        case SimdLevel::AVX2:   return diffuseRowMooreAvx2;
+#endif
+        default:                return diffuseRowMooreScalar;
+    }
+}
+
+DiffusionKernel mooreDiffusionKernel(SimdLevel level)
+{
+    switch (level)
+    {
+#ifdef CA_X86_KERNELS
+        case SimdLevel::AVX512: return diffuseBlock<diffuseRowMooreAvx512>;
+        case SimdLevel::AVX2:   return diffuseBlock<diffuseRowMooreAvx2>;
+#endif
+        default:                return diffuseBlock<diffuseRowMooreScalar>;
+    }
+}
+
+// 3D
+
+// Scalar reference for a single inner cell of a volume, same rules as diffuseCell()
+static inline float diffuseCell3D(float west, float east, float north, float south, float below, float above, float center, float diffusionSpeed)
+{
+    float nutrientAvg = west;
+    nutrientAvg += east;
+    nutrientAvg += north;
+    nutrientAvg += south;
+    nutrientAvg += below;
+    nutrientAvg += above;
+    nutrientAvg /= 6.0f;
+
+    float value = ((nutrientAvg - center) * diffusionSpeed) + center;
+
+    if (value > 1.0f) value = 1.0f;
+    if (value < 0.0f) value = 0.0f;
+    return value;
+}
+
+static inline void diffuseRow3DTail(const float* row, const float* north, const float* south, const float* below, const float* above, float* out, size_t j, size_t jEnd, float diffusionSpeed)
+{
+    for (; j < jEnd; j++)
+        out[j] = diffuseCell3D(row[j - 1], row[j + 1], north[j], south[j], below[j], above[j], row[j], diffusionSpeed);
+}
+
+static void diffuseRow3DScalar(const float* row, const float* north, const float* south, const float* below, const float* above, float* out, size_t width, float diffusionSpeed)
+{
+    diffuseRow3DTail(row, north, south, below, above, out, 1, width - 1, diffusionSpeed);
+}
+
+#ifdef CA_X86_KERNELS
+
+CA_TARGET("avx2")
+static void diffuseRow3DAvx2(const float* row, const float* north, const float* south, const float* below, const float* above, float* out, size_t width, float diffusionSpeed)
+{
+    // A sixth is not exact, so the average divides like the scalar code
+    const __m256 six = _mm256_set1_ps(6.0f);
+    const __m256 speed = _mm256_set1_ps(diffusionSpeed);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+
+    const size_t jEnd = width - 1;
+    size_t j = 1;
+    for (; j + 8 <= jEnd; j += 8)
+    {
+        __m256 center = _mm256_loadu_ps(row + j);
+        __m256 avg = _mm256_add_ps(_mm256_loadu_ps(row + j - 1), _mm256_loadu_ps(row + j + 1));
+        avg = _mm256_add_ps(avg, _mm256_loadu_ps(north + j));
+        avg = _mm256_add_ps(avg, _mm256_loadu_ps(south + j));
+        avg = _mm256_add_ps(avg, _mm256_loadu_ps(below + j));
+        avg = _mm256_add_ps(avg, _mm256_loadu_ps(above + j));
+        avg = _mm256_div_ps(avg, six);
+
+        __m256 value = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(avg, center), speed), center);
+        value = _mm256_max_ps(zero, _mm256_min_ps(one, value));
+        _mm256_storeu_ps(out + j, value);
+    }
+    diffuseRow3DTail(row, north, south, below, above, out, j, jEnd, diffusionSpeed);
+}
+
+CA_TARGET("avx512f")
+static void diffuseRow3DAvx512(const float* row, const float* north, const float* south, const float* below, const float* above, float* out, size_t width, float diffusionSpeed)
+{
+    const __m512 six = _mm512_set1_ps(6.0f);
+    const __m512 speed = _mm512_set1_ps(diffusionSpeed);
+    const __m512 zero = _mm512_setzero_ps();
+    const __m512 one = _mm512_set1_ps(1.0f);
+
+    const size_t jEnd = width - 1;
+    for (size_t j = 1; j < jEnd; j += 16)
+    {
+        size_t remaining = std::min<size_t>(16, jEnd - j);
+        __mmask16 mask = __mmask16((1u << remaining) - 1);
+
+        __m512 center = _mm512_maskz_loadu_ps(mask, row + j);
+        __m512 avg = _mm512_add_ps(_mm512_maskz_loadu_ps(mask, row + j - 1), _mm512_maskz_loadu_ps(mask, row + j + 1));
+        avg = _mm512_add_ps(avg, _mm512_maskz_loadu_ps(mask, north + j));
+        avg = _mm512_add_ps(avg, _mm512_maskz_loadu_ps(mask, south + j));
+        avg = _mm512_add_ps(avg, _mm512_maskz_loadu_ps(mask, below + j));
+        avg = _mm512_add_ps(avg, _mm512_maskz_loadu_ps(mask, above + j));
+        avg = _mm512_div_ps(avg, six);
+
+        __m512 value = _mm512_add_ps(_mm512_mul_ps(_mm512_sub_ps(avg, center), speed), center);
+        value = _mm512_maskz_max_ps(mask, zero, _mm512_maskz_min_ps(mask, one, value));
+        _mm512_mask_storeu_ps(out + j, mask, value);
+    }
+}
+
+#endif
+
+DiffusionRowKernel3D diffusionRowKernel3D(SimdLevel level)
+{
+    switch (level)
+    {
+#ifdef CA_X86_KERNELS
+        case SimdLevel::AVX512: return diffuseRow3DAvx512;
+        case SimdLevel::AVX2:   return diffuseRow3DAvx2;
+#endif
+        default:                return diffuseRow3DScalar;
+    }
+}
+
+bool exceedsTolerance(const Grid<float>& a, const Grid<float>& b, float tolerance, size_t rowBegin, size_t rowEnd, size_t colBegin, size_t colEnd)
+{
+    for (size_t i = rowBegin; i < rowEnd; i++)
+    {
+        const float* rowA = a[i];
+        const float* rowB = b[i];
+
+        // Integer OR instead of a float max keeps the loop vectorizable
+        int exceeds = 0;
+        for (size_t j = colBegin; j < colEnd; j++)
+            exceeds |= std::fabs(rowA[j] - rowB[j]) > tolerance;
+        if (exceeds)
+            return true;
+    }
+    return false;
+}
+
+NutrientSummary summarizeNutrients(const Grid<float>& grid, size_t rowBegin, size_t rowEnd, size_t colBegin, size_t colEnd)
+{
+    float low = grid[rowBegin][colBegin];
+    float high = low;
+    double sum = 0.0;
+
+#ifdef CA_X86_KERNELS
+    // SSE is always there on x86-64, and the compiler will not vectorize
+    // float min/max reductions on its own
+    __m128 lowLanes = _mm_set1_ps(low);
+    __m128 highLanes = lowLanes;
+#endif
+
+    for (size_t i = rowBegin; i < rowEnd; i++)
+    {
+        const float* row = grid[i];
+        float total = 0.0f;
+        size_t j = colBegin;
+
+#ifdef CA_X86_KERNELS
+        __m128 totalLanes = _mm_setzero_ps();
+        for (; j + 4 <= colEnd; j += 4)
+        {
+            __m128 value = _mm_loadu_ps(row + j);
+            lowLanes = _mm_min_ps(lowLanes, value);
+            highLanes = _mm_max_ps(highLanes, value);
+            totalLanes = _mm_add_ps(totalLanes, value);
+        }
+        float lanes[4];
+        _mm_storeu_ps(lanes, totalLanes);
+        total = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+
+        for (; j < colEnd; j++)
+        {
+            low = std::min(low, row[j]);
+            high = std::max(high, row[j]);
+            total += row[j];
+        }
+        sum += total;
+    }
+
+#ifdef CA_X86_KERNELS
+    float lanes[4];
+    _mm_storeu_ps(lanes, lowLanes);
+    low = std::min({ low, lanes[0], lanes[1], lanes[2], lanes[3] });
+    _mm_storeu_ps(lanes, highLanes);
+    high = std::max({ high, lanes[0], lanes[1], lanes[2], lanes[3] });
+#endif
+
+    return { low, high, sum };
+}
@@ -0,0 +1,190 @@
+#include <domain.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <system_error>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CA_HAS_FORK 1
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+std::vector<Band> splitRows(size_t height, size_t processes)
+{
+    if (processes == 0)
+        throw std::invalid_argument("A domain needs at least one process");
+
+    // The first height % processes bands take one extra row
+    std::vector<Band> bands(processes);
+    size_t row = 0;
+    for (size_t p = 0; p < processes; p++)
+    {
+        size_t rows = height / processes + (p < height % processes ? 1 : 0);
+        bands[p] = { row, row + rows };
+        row += rows;
+    }
+    return bands;
+}
+
+#ifdef CA_HAS_FORK
+
+// A grid in memory shared with the processes forked after it is made
+template <typename T>
+static Grid<T> sharedGrid(size_t width, size_t height)
+{
+    const size_t bytes = Grid<T>::strideFor(width) * height * sizeof(T);
+    void* mapped = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED)
+        throw std::system_error(errno, std::generic_category(), "Unable to map the shared grids");
+
+    std::shared_ptr<void> owner(mapped, [bytes](void* address) { ::munmap(address, bytes); });
+    return Grid<T>::adopt(width, height, static_cast<T*>(mapped), std::move(owner));
+}
+
+// Body of a forked process, never returns
+[[noreturn]] static void runBand(
+    const SimulationBuilder& builder,
+    HaloLinks& links,
+    size_t rank,
+    const Band& band,
+    uint64_t epochs,
+    Grid<CellState>& cells,
+    Grid<float>& nutrients
+)
+{
+    try
+    {
+        std::unique_ptr<HaloTransport> transport = links.attach(rank);
+        CellularAutomata sim = builder.buildSubdomain(band.rowBegin, band.rowEnd, *transport);
+
+        for (uint64_t epoch = 0; epoch < epochs; epoch++)
+            sim.step();
+
+        // Owned rows only, the halos belong to the neighbours
+        const size_t width = sim.getWidth();
+        const size_t begin = sim.getOwnedRowBegin();
+        for (size_t i = begin; i < sim.getOwnedRowEnd(); i++)
+        {
+            const size_t row = band.rowBegin + (i - begin);
+            std::memcpy(cells[row], sim.getCellGrid()[i], width * sizeof(CellState));
+            std::memcpy(nutrients[row], sim.getNutrientGrid()[i], width * sizeof(float));
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Band " << rank << ": " << e.what() << std::endl;
+        ::_exit(1);
+    }
+
+    // Skips the destructors of everything inherited from the parent
+    ::_exit(0);
+}
+
+DomainResult runDecomposed(const SimulationBuilder& builder, uint64_t epochs, const DomainOptions& options)
+{
+    using Clock = std::chrono::steady_clock;
+
+    const size_t width = builder.getWidth();
+    const size_t height = builder.getHeight();
+    if (options.processes == 0)
+        throw std::invalid_argument("A domain needs at least one process");
+    if (height / options.processes < 2)
+        throw std::invalid_argument("Every band needs at least two rows");
+
+    // Every band must draw the same random numbers
+    SimulationBuilder seeded = builder;
+    if (!seeded.getSeed())
+    {
+        std::random_device rd;
+        seeded.setSeed((uint64_t(rd()) << 32) | rd());
+    }
+
+    DomainResult result;
+    result.cells = sharedGrid<CellState>(width, height);
+    result.nutrients = sharedGrid<float>(width, height);
+    result.epoch = epochs;
+    result.seed = *seeded.getSeed();
+
+    // The largest exchange is two rows of division claims
+    const std::vector<Band> bands = splitRows(height, options.processes);
+    std::unique_ptr<HaloLinks> links = makeHaloLinks(options.transport, options.processes, 2 * Grid<uint64_t>::strideFor(width) * sizeof(uint64_t));
+
+    // Buffered output would otherwise be written once per process
+    std::cout.flush();
+    std::cerr.flush();
+
+    auto start = Clock::now();
+
+    std::vector<pid_t> children;
+    auto killChildren = [&children]()
+    {
+        for (pid_t child : children)
+            ::kill(child, SIGKILL);
+        for (pid_t child : children)
+            ::waitpid(child, nullptr, 0);
+    };
+
+    for (size_t rank = 0; rank < bands.size(); rank++)
+    {
+        pid_t child = ::fork();
+        if (child < 0)
+        {
+            int error = errno;
+            killChildren();
+            throw std::system_error(error, std::generic_category(), "Unable to fork a band");
+        }
+        if (child == 0)
+            runBand(seeded, *links, rank, bands[rank], epochs, result.cells, result.nutrients);
+        children.push_back(child);
+    }
+
+    // The children hold their own ends of the links now
+    links.reset();
+
+    // A band that fails leaves its neighbours waiting on it, so the first
+    // failure takes the others down
+    while (!children.empty())
+    {
+        int status = 0;
+        pid_t child = ::waitpid(-1, &status, 0);
+        if (child < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            int error = errno;
+            killChildren();
+            throw std::system_error(error, std::generic_category(), "Unable to wait for the bands");
+        }
+
+        auto found = std::find(children.begin(), children.end(), child);
+        if (found == children.end())
+            continue;
+        children.erase(found);
+
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            killChildren();
+            throw std::runtime_error("A band of the decomposed run failed");
+        }
+    }
+
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return result;
+}
+
+#else
+
+DomainResult runDecomposed(const SimulationBuilder&, uint64_t, const DomainOptions&)
+{
+    throw std::runtime_error("Domain decomposition needs fork() and shared memory");
+}
+
+#endif
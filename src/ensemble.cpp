@@ -0,0 +1,284 @@
+#include <ensemble.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+
+// ---- Sweep specification ----
+
+static std::string trim(const std::string& text)
+{
+    size_t begin = text.find_first_not_of(" \t\r");
+    if (begin == std::string::npos)
+        return "";
+    return text.substr(begin, text.find_last_not_of(" \t\r") - begin + 1);
+}
+
+static std::vector<std::string> splitList(const std::string& text)
+{
+    std::vector<std::string> items;
+    std::stringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ','))
+        if (!trim(item).empty())
+            items.push_back(trim(item));
+    return items;
+}
+
+// One number, integers parsed as such so large seeds stay exact
+template <typename T>
+static T parseValue(const std::string& text)
+{
+    if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+        return T(std::stoll(text));
+    else if constexpr (std::is_integral_v<T>)
+    {
+        if (text.find('-') != std::string::npos)
+            throw std::invalid_argument("Negative value: " + text);
+        return T(std::stoull(text));
+    }
+    else
+        return T(std::stod(text));
+}
+
+// "a, b, c" or "start:stop[:step]", inclusive
+template <typename T>
+static std::vector<T> parseValues(const std::string& text)
+{
+    std::vector<T> values;
+    for (const std::string& item : splitList(text))
+    {
+        size_t colon = item.find(':');
+        if (colon == std::string::npos)
+        {
+            values.push_back(parseValue<T>(item));
+            continue;
+        }
+
+        size_t second = item.find(':', colon + 1);
+        T start = parseValue<T>(item.substr(0, colon));
+        T stop = parseValue<T>(item.substr(colon + 1, second == std::string::npos ? std::string::npos : second - colon - 1));
+        T step = second == std::string::npos ? T(1) : parseValue<T>(item.substr(second + 1));
+        if (!(step > T(0)) || stop < start)
+            throw std::invalid_argument("Invalid range: " + item);
+
+        if constexpr (std::is_integral_v<T>)
+        {
+            // Stepped without overshooting, even next to the type's maximum
+            for (T value = start; ; value += step)
+            {
+                values.push_back(value);
+                if (stop - value < step)
+                    break;
+            }
+        }
+        else
+        {
+            // Counted rather than accumulated, so 0.1 steps do not drift past stop
+            size_t count = size_t(std::floor(double(stop - start) / double(step) + 1e-6)) + 1;
+            for (size_t k = 0; k < count; k++)
+                values.push_back(T(double(start) + double(k) * double(step)));
+        }
+    }
+
+    if (values.empty())
+        throw std::invalid_argument("Empty value list: " + text);
+    return values;
+}
+
+SweepSpec SweepSpec::load(const std::string& path)
+{
+    std::ifstream in(path);
+    if (!in)
+        throw std::runtime_error("Unable to open sweep specification " + path);
+
+    SweepSpec spec;
+    std::string line;
+    for (size_t number = 1; std::getline(in, line); number++)
+    {
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty())
+            continue;
+
+        size_t equals = line.find('=');
+        if (equals == std::string::npos)
+            throw std::invalid_argument(path + ":" + std::to_string(number) + ": expected key = values");
+        const std::string key = trim(line.substr(0, equals));
+        const std::string value = trim(line.substr(equals + 1));
+
+        if (key == "scenario")
+            spec.scenarios = parseValues<int>(value);
+        else if (key == "size")
+        {
+            spec.sizes.clear();
+            for (const std::string& item : splitList(value))
+            {
+                size_t x = item.find('x');
+                size_t width = std::stoul(item.substr(0, x));
+                size_t height = x == std::string::npos ? width : std::stoul(item.substr(x + 1));
+                spec.sizes.push_back({ width, height });
+            }
+        }
+        else if (key == "epochs")
+            spec.epochs = std::stoull(value);
+        else if (key == "division")
+        {
+            if (value == "sequential")
+                spec.divisionMode = DivisionMode::Sequential;
+            else if (value == "deterministic")
+                spec.divisionMode = DivisionMode::Deterministic;
+            else
+                throw std::invalid_argument(path + ":" + std::to_string(number) + ": unknown division mode " + value);
+        }
+        else if (key == "diffusion_speed")
+            spec.diffusionSpeeds = parseValues<float>(value);
+        else if (key == "death_threshold")
+            spec.deathThresholds = parseValues<float>(value);
+        else if (key == "divide_threshold")
+            spec.divideThresholds = parseValues<float>(value);
+        else if (key == "division_cost")
+            spec.divisionCosts = parseValues<float>(value);
+        else if (key == "seed")
+            spec.seeds = parseValues<uint64_t>(value);
+        else
+            throw std::invalid_argument(path + ":" + std::to_string(number) + ": unknown key " + key);
+    }
+
+    for (int scenario : spec.scenarios)
+        if (scenario < 0 || scenario >= SCENARIO_COUNT)
+            throw std::invalid_argument(path + ": invalid scenario " + std::to_string(scenario));
+    for (const auto& size : spec.sizes)
+        if (size.first < 64 || size.second < 64)
+            throw std::invalid_argument(path + ": grids must be at least 64x64");
+    if (spec.sizes.empty())
+        throw std::invalid_argument(path + ": no grid size");
+
+    return spec;
+}
+
+std::vector<EnsembleJob> SweepSpec::expand() const
+{
+    std::vector<EnsembleJob> jobs;
+    jobs.reserve(scenarios.size() * sizes.size() * diffusionSpeeds.size() * deathThresholds.size() *
+                 divideThresholds.size() * divisionCosts.size() * seeds.size());
+
+    EnsembleJob job;
+    job.epochs = epochs;
+    job.divisionMode = divisionMode;
+    for (int scenario : scenarios)
+        for (const auto& size : sizes)
+            for (float diffusionSpeed : diffusionSpeeds)
+                for (float deathThreshold : deathThresholds)
+                    for (float divideThreshold : divideThresholds)
+                        for (float divisionCost : divisionCosts)
+                            for (uint64_t seed : seeds)
+                            {
+                                job.scenario = scenario;
+                                job.width = size.first;
+                                job.height = size.second;
+                                job.parameters = { diffusionSpeed, deathThreshold, divideThreshold, divisionCost };
+                                job.seed = seed;
+                                jobs.push_back(job);
+                            }
+    return jobs;
+}
+
+// ---- Ensemble ----
+
+Ensemble::Ensemble(size_t threads, SimdLevel simdLevel)
+    : simdLevel(simdLevel),
+      pool(threads)
+{
+    workspaces.resize(pool.getThreadCount());
+}
+
+size_t Ensemble::getThreadCount() const
+{
+    return pool.getThreadCount();
+}
+
+EnsembleResult Ensemble::runJob(const EnsembleJob& job, Workspace& workspace)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    // A new engine only when the grid size changes between jobs
+    if (!workspace.sim || workspace.sim->getWidth() != job.width || workspace.sim->getHeight() != job.height)
+    {
+        EngineOptions engine;
+        engine.simdLevel = simdLevel;
+        engine.threads = 1;
+        engine.instrumentation = true;
+
+        workspace.sim = std::make_unique<CellularAutomata>(
+            Grid<CellState>(job.width, job.height),
+            Grid<float>(job.width, job.height),
+            job.parameters.diffusionSpeed,
+            job.parameters.deathThreshold,
+            job.parameters.divideThreshold,
+            job.parameters.divisionCost,
+            job.parameters.consumptionRate,
+            job.divisionMode,
+            job.seed,
+            NutrientSolverOptions(),
+            engine
+        );
+    }
+
+    if (!workspace.scenarioPool)
+        workspace.scenarioPool = std::make_unique<ThreadPool>(1);
+
+    CellularAutomata& sim = *workspace.sim;
+    sim.restart(
+        [&](Grid<CellState>& cells, Grid<float>& nutrients)
+        {
+            generate_scenario(job.scenario, cells, nutrients, job.seed, *workspace.scenarioPool);
+        },
+        job.parameters.diffusionSpeed,
+        job.parameters.deathThreshold,
+        job.parameters.divideThreshold,
+        job.parameters.divisionCost,
+        job.parameters.consumptionRate,
+        job.divisionMode,
+        job.seed
+    );
+
+    EnsembleResult result;
+    for (uint64_t epoch = 0; epoch < job.epochs; epoch++)
+    {
+        sim.step();
+        result.divisions += sim.getStepStats().divisions;
+    }
+
+    result.counts = sim.countCells();
+    result.nutrientMean = sim.getStepStats().nutrientMean;
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+std::vector<EnsembleResult> Ensemble::run(
+    const std::vector<EnsembleJob>& jobs,
+    const std::function<void(size_t index, const EnsembleResult& result)>& onResult
+)
+{
+    std::vector<EnsembleResult> results(jobs.size());
+    std::mutex reporting;
+
+    pool.parallelFor(jobs.size(), [&](size_t index, size_t worker)
+    {
+        results[index] = runJob(jobs[index], workspaces[worker]);
+
+        if (onResult)
+        {
+            std::lock_guard<std::mutex> lock(reporting);
+            onResult(index, results[index]);
+        }
+    });
+
+    return results;
+}
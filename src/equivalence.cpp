@@ -0,0 +1,184 @@
+#include <cellular_automata.hpp>
+#include <scenarios.hpp>
+
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Steps a fused and an unfused engine in lockstep from the same state and
+// compares both grids bit for bit after every epoch, over several
+// scenarios, engine options and policy combinations. Exits with code 1 on
+// the first epoch where they differ, so it runs as a test (ctest).
+
+constexpr size_t GRID_WIDTH = 150;
+constexpr size_t GRID_HEIGHT = 130;
+constexpr uint64_t EPOCHS = 60;
+
+struct EquivalenceCase
+{
+    std::string name;
+    int scenario = 1;
+    uint64_t seed = 1;
+    float consumptionRate = 0.0f;
+    DivisionMode divisionMode = DivisionMode::Deterministic;
+    NutrientPrecision nutrientPrecision = NutrientPrecision::Float32;
+    std::optional<float> activeTolerance;
+    size_t threads = 1;
+    size_t tileSize = DEFAULT_TILE_SIZE;
+};
+
+// First row where the grids differ, padding excluded, or -1
+template <typename Simulation>
+long first_difference(const Simulation& a, const Simulation& b)
+{
+    const Grid<CellState>& cellsA = a.getCellGrid();
+    const Grid<CellState>& cellsB = b.getCellGrid();
+    const Grid<float>& nutrientsA = a.getNutrientGrid();
+    const Grid<float>& nutrientsB = b.getNutrientGrid();
+    for (size_t i = 0; i < a.getHeight(); ++i)
+        if (std::memcmp(cellsA[i], cellsB[i], a.getWidth() * sizeof(CellState)) != 0
+            || std::memcmp(nutrientsA[i], nutrientsB[i], a.getWidth() * sizeof(float)) != 0)
+            return long(i);
+    return -1;
+}
+
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+bool run_case(const EquivalenceCase& test, const std::string& policies)
+{
+    Grid<CellState> cells(GRID_WIDTH, GRID_HEIGHT);
+    Grid<float> nutrients(GRID_WIDTH, GRID_HEIGHT);
+    generate_scenario(test.scenario, cells, nutrients, test.seed);
+
+    ScenarioParameters parameters;
+    SimulationBuilder builder(cells, nutrients);
+    builder
+        .setDiffusionSpeed(parameters.diffusionSpeed)
+        .setDeathThreshold(parameters.deathThreshold)
+        .setDivideThreshold(parameters.divideThreshold)
+        .setDivisionCost(parameters.divisionCost)
+        .setConsumptionRate(test.consumptionRate)
+        .setSimdLevel(detectSimdLevel())
+        .setThreads(test.threads)
+        .setTileSize(test.tileSize)
+        .setDivisionMode(test.divisionMode)
+        .setNutrientPrecision(test.nutrientPrecision)
+        .setSeed(test.seed);
+    if (test.activeTolerance)
+        builder.setActiveRegionTolerance(*test.activeTolerance);
+
+    auto fused = builder.setFusedStep(true).build<Neighborhood, Boundary, DivisionRule>();
+    auto unfused = builder.setFusedStep(false).build<Neighborhood, Boundary, DivisionRule>();
+
+    for (uint64_t epoch = 1; epoch <= EPOCHS; ++epoch)
+    {
+        fused.step();
+        unfused.step();
+        long row = first_difference(fused, unfused);
+        if (row >= 0)
+        {
+            std::cout << "FAILED " << test.name << " (" << policies << "): row " << row
+                      << " differs after epoch " << epoch << "\n";
+            return false;
+        }
+    }
+    std::cout << "ok     " << test.name << " (" << policies << ")\n";
+    return true;
+}
+
+// Every policy combination on one case. Active regions only take the von
+// Neumann stencil and the source boundary.
+bool run_policies(const EquivalenceCase& test)
+{
+    bool passed = true;
+    passed &= run_case<VonNeumann, DirichletSource, RandomNeighbor>(test, "von-neumann, dirichlet, random");
+    passed &= run_case<VonNeumann, DirichletSource, RichestNeighbor>(test, "von-neumann, dirichlet, richest");
+    if (test.activeTolerance)
+        return passed;
+    passed &= run_case<VonNeumann, NoFlux, RichestNeighbor>(test, "von-neumann, no-flux, richest");
+    passed &= run_case<VonNeumann, Periodic, RandomNeighbor>(test, "von-neumann, periodic, random");
+    passed &= run_case<Moore, DirichletSource, RichestNeighbor>(test, "moore, dirichlet, richest");
+    passed &= run_case<Moore, NoFlux, RandomNeighbor>(test, "moore, no-flux, random");
+    passed &= run_case<Moore, Periodic, RichestNeighbor>(test, "moore, periodic, richest");
+    return passed;
+}
+
+std::vector<EquivalenceCase> equivalence_cases()
+{
+    std::vector<EquivalenceCase> cases;
+    for (int scenario = 0; scenario < SCENARIO_COUNT; ++scenario)
+    {
+        EquivalenceCase test;
+        test.name = scenario_name(scenario);
+        test.scenario = scenario;
+        test.seed = uint64_t(scenario) + 1;
+        cases.push_back(test);
+    }
+
+    EquivalenceCase test;
+    test.name = "sequential division";
+    test.divisionMode = DivisionMode::Sequential;
+    cases.push_back(test);
+
+    test = EquivalenceCase();
+    test.name = "consumption, small tiles, 3 threads";
+    test.scenario = 2;
+    test.consumptionRate = 0.001f;
+    test.threads = 3;
+    test.tileSize = 32;
+    cases.push_back(test);
+
+    test = EquivalenceCase();
+    test.name = "fixed16";
+    test.scenario = 1;
+    test.nutrientPrecision = NutrientPrecision::Fixed16;
+    cases.push_back(test);
+
+    test = EquivalenceCase();
+    test.name = "fixed16, consumption, small tiles, 3 threads";
+    test.scenario = 3;
+    test.consumptionRate = 0.001f;
+    test.nutrientPrecision = NutrientPrecision::Fixed16;
+    test.threads = 3;
+    test.tileSize = 32;
+    cases.push_back(test);
+
+    test = EquivalenceCase();
+    test.name = "active tolerance 0";
+    test.scenario = 4;
+    test.activeTolerance = 0.0f;
+    test.tileSize = 32;
+    cases.push_back(test);
+
+    test = EquivalenceCase();
+    test.name = "active tolerance 1e-4";
+    test.scenario = 5;
+    test.activeTolerance = 1e-4f;
+    test.tileSize = 32;
+    cases.push_back(test);
+    return cases;
+}
+
+int main()
+{
+    try
+    {
+        int failures = 0;
+        for (const EquivalenceCase& test : equivalence_cases())
+            failures += run_policies(test) ? 0 : 1;
+
+        if (failures > 0)
+        {
+            std::cout << failures << " case(s) where step() fused and unfused diverged\n";
+            return 1;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
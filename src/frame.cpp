@@ -0,0 +1,196 @@
+#include <frame.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+// Indexed by the state byte, unknown states draw black
+static const std::array<uint32_t, 256> CELL_COLORS = []
+{
+    std::array<uint32_t, 256> colors;
+    colors.fill(0xff000000);
+    colors[uint8_t(CellState::Empty)] = 0xff000000;     // black
+    colors[uint8_t(CellState::Alive)] = 0xff00ff00;     // green
+    colors[uint8_t(CellState::Quiescent)] = 0xffffff00; // yellow
+    colors[uint8_t(CellState::Necrotic)] = 0xff0000ff;  // blue
+    return colors;
+}();
+
+static constexpr size_t NUTRIENT_LEVELS = 256;
+static constexpr uint32_t NUTRIENT_BRIGHTEST = 0x80;
+
+static const std::array<uint32_t, NUTRIENT_LEVELS> NUTRIENT_COLORS = []
+{
+    std::array<uint32_t, NUTRIENT_LEVELS> colors;
+    for (size_t level = 0; level < NUTRIENT_LEVELS; ++level)
+        colors[level] = 0xff000000 | uint32_t(level * NUTRIENT_BRIGHTEST / (NUTRIENT_LEVELS - 1)) * 0x010101;
+    return colors;
+}();
+
+// Colours with each channel in its own 21-bit lane, so one integer sums a
+// run of up to 8224 pixels channel by channel (used when downscaling)
+static constexpr uint64_t spreadColor(uint32_t color)
+{
+    return uint64_t((color >> 16) & 0xff) << 42 | uint64_t((color >> 8) & 0xff) << 21 | (color & 0xff);
+}
+
+static const std::array<uint64_t, 256> CELL_SPREAD = []
+{
+    std::array<uint64_t, 256> spread;
+    for (size_t state = 0; state < spread.size(); ++state)
+        spread[state] = spreadColor(CELL_COLORS[state]);
+    return spread;
+}();
+
+static const std::array<uint64_t, NUTRIENT_LEVELS> NUTRIENT_SPREAD = []
+{
+    std::array<uint64_t, NUTRIENT_LEVELS> spread;
+    for (size_t level = 0; level < spread.size(); ++level)
+        spread[level] = spreadColor(NUTRIENT_COLORS[level]);
+    return spread;
+}();
+
+static inline size_t nutrientLevel(float nutrient)
+{
+    float level = std::clamp(nutrient / MAX_NUTRIENT, 0.0f, 1.0f) * float(NUTRIENT_LEVELS - 1);
+    return size_t(level + 0.5f);
+}
+
+uint32_t cellColor(CellState state)
+{
+    return CELL_COLORS[uint8_t(state)];
+}
+
+uint32_t nutrientColor(float nutrient)
+{
+    return NUTRIENT_COLORS[nutrientLevel(nutrient)];
+}
+
+void renderFrame(const Grid<CellState>& cellGrid, uint32_t* pixels)
+{
+    const size_t width = cellGrid.getWidth();
+
+    for (size_t y = 0; y < cellGrid.getHeight(); ++y)
+    {
+        const CellState* row = cellGrid[y];
+        for (size_t x = 0; x < width; ++x)
+            pixels[y * width + x] = CELL_COLORS[uint8_t(row[x])];
+    }
+}
+
+FrameComposer::FrameComposer(size_t gridWidth, size_t gridHeight, size_t maxWidth, size_t maxHeight)
+    : gridWidth(gridWidth),
+      gridHeight(gridHeight),
+      drawnCells(gridWidth, gridHeight)
+{
+    if (maxWidth == 0 || maxHeight == 0)
+        throw std::invalid_argument("The frame must be at least one pixel wide and high");
+
+    scale = std::max({ size_t(1), (gridWidth + maxWidth - 1) / maxWidth, (gridHeight + maxHeight - 1) / maxHeight });
+    // The spread colours sum one block row at a time
+    if (scale > 8224)
+        throw std::invalid_argument("The frame is too small for the grid");
+    width = (gridWidth + scale - 1) / scale;
+    height = (gridHeight + scale - 1) / scale;
+}
+
+void FrameComposer::composeRow(size_t y, const Grid<CellState>& cells, const Grid<float>* nutrients, uint32_t* pixels) const
+{
+    uint32_t* out = pixels + y * width;
+
+    if (scale == 1)
+    {
+        const CellState* row = cells[y];
+        if (!nutrients)
+        {
+            for (size_t x = 0; x < width; ++x)
+                out[x] = CELL_COLORS[uint8_t(row[x])];
+            return;
+        }
+
+        const float* nutrientRow = (*nutrients)[y];
+        for (size_t x = 0; x < width; ++x)
+            out[x] = row[x] == CellState::Empty ? nutrientColor(nutrientRow[x]) : CELL_COLORS[uint8_t(row[x])];
+        return;
+    }
+
+    // Average of the block, channel by channel; blocks on the right and
+    // bottom edges may be partial
+    const size_t rowBegin = y * scale;
+    const size_t rowEnd = std::min(rowBegin + scale, gridHeight);
+
+    for (size_t x = 0; x < width; ++x)
+    {
+        const size_t colBegin = x * scale;
+        const size_t colEnd = std::min(colBegin + scale, gridWidth);
+        uint32_t red = 0, green = 0, blue = 0;
+
+        for (size_t i = rowBegin; i < rowEnd; ++i)
+        {
+            const CellState* row = cells[i];
+            uint64_t sum = 0;
+            if (nutrients)
+            {
+                const float* nutrientRow = (*nutrients)[i];
+                for (size_t j = colBegin; j < colEnd; ++j)
+                    sum += row[j] == CellState::Empty ? NUTRIENT_SPREAD[nutrientLevel(nutrientRow[j])] : CELL_SPREAD[uint8_t(row[j])];
+            }
+            else
+            {
+                for (size_t j = colBegin; j < colEnd; ++j)
+                    sum += CELL_SPREAD[uint8_t(row[j])];
+            }
+
+            red += uint32_t(sum >> 42);
+            green += uint32_t(sum >> 21) & 0x1fffff;
+            blue += uint32_t(sum) & 0x1fffff;
+        }
+
+        const uint32_t count = uint32_t((rowEnd - rowBegin) * (colEnd - colBegin));
+        out[x] = 0xff000000 | (red / count) << 16 | (green / count) << 8 | (blue / count);
+    }
+}
+
+size_t FrameComposer::compose(const Grid<CellState>& cells, const Grid<float>* nutrients, uint32_t* pixels)
+{
+    if (cells.getWidth() != gridWidth || cells.getHeight() != gridHeight
+        || (nutrients && (nutrients->getWidth() != gridWidth || nutrients->getHeight() != gridHeight)))
+        throw std::invalid_argument("The grids do not match the frame");
+
+    const bool overlay = nutrients != nullptr;
+    if (overlay && drawnNutrients.empty())
+        drawnNutrients = Grid<float>(gridWidth, gridHeight);
+
+    // Every pixel is stale on the first frame and when the overlay is toggled
+    const bool redrawAll = !drawn || overlay != drawnOverlay;
+    size_t redrawn = 0;
+
+    for (size_t y = 0; y < height; ++y)
+    {
+        const size_t rowBegin = y * scale;
+        const size_t rowEnd = std::min(rowBegin + scale, gridHeight);
+
+        bool changed = redrawAll;
+        for (size_t i = rowBegin; i < rowEnd && !changed; ++i)
+        {
+            changed = std::memcmp(cells[i], drawnCells[i], gridWidth * sizeof(CellState)) != 0
+                || (overlay && std::memcmp((*nutrients)[i], drawnNutrients[i], gridWidth * sizeof(float)) != 0);
+        }
+        if (!changed)
+            continue;
+
+        composeRow(y, cells, nutrients, pixels);
+        for (size_t i = rowBegin; i < rowEnd; ++i)
+        {
+            std::memcpy(drawnCells[i], cells[i], gridWidth * sizeof(CellState));
+            if (overlay)
+                std::memcpy(drawnNutrients[i], (*nutrients)[i], gridWidth * sizeof(float));
+        }
+        ++redrawn;
+    }
+
+    drawn = true;
+    drawnOverlay = overlay;
+    return redrawn;
+}
@@ -0,0 +1,426 @@
+#include <frame_exporter.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#include <frame.hpp>
+
+// Raw stream layout: a RawStreamHeader, then per frame the epoch (uint64)
+// followed by the enabled payloads, row-major without row padding: cell states
+// as one byte each, then nutrients as float32. Native byte order.
+static constexpr char RAW_STREAM_MAGIC[8] = { 'C', 'A', 'S', 'T', 'R', 'E', 'A', 'M' };
+static constexpr uint32_t RAW_STREAM_VERSION = 1;
+static constexpr uint32_t RAW_STREAM_CELLS = 1;
+static constexpr uint32_t RAW_STREAM_NUTRIENTS = 2;
+
+struct RawStreamHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t contents;      // RAW_STREAM_CELLS | RAW_STREAM_NUTRIENTS
+    uint64_t width;
+    uint64_t height;
+};
+
+ExportFormat parseExportFormat(const std::string& name)
+{
+    if (name == "ppm")
+        return ExportFormat::PPM;
+    if (name == "png")
+        return ExportFormat::PNG;
+    if (name == "raw")
+        return ExportFormat::Raw;
+    throw std::invalid_argument("Unknown export format: " + name);
+}
+
+// ---- Encoders ----
+
+static uint32_t crc32(uint32_t crc, const uint8_t* data, size_t size)
+{
+    static const std::array<uint32_t, 256> table = []
+    {
+        std::array<uint32_t, 256> table{};
+        for (uint32_t n = 0; n < 256; ++n)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        return table;
+    }();
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i)
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static uint32_t adler32(const uint8_t* data, size_t size)
+{
+    constexpr uint32_t MOD_ADLER = 65521;
+    uint32_t a = 1;
+    uint32_t b = 0;
+
+    // 5552 bytes is the longest run that cannot overflow b before the modulo
+    while (size > 0)
+    {
+        size_t block = std::min<size_t>(size, 5552);
+        size -= block;
+        while (block-- > 0)
+        {
+            a += *data++;
+            b += a;
+        }
+        a %= MOD_ADLER;
+        b %= MOD_ADLER;
+    }
+    return (b << 16) | a;
+}
+
+static void putBigEndian32(std::vector<uint8_t>& out, uint32_t value)
+{
+    out.push_back(uint8_t(value >> 24));
+    out.push_back(uint8_t(value >> 16));
+    out.push_back(uint8_t(value >> 8));
+    out.push_back(uint8_t(value));
+}
+
+static void writePngChunk(std::ofstream& out, const char type[4], const std::vector<uint8_t>& data)
+{
+    std::vector<uint8_t> chunk;
+    chunk.reserve(data.size() + 12);
+    putBigEndian32(chunk, uint32_t(data.size()));
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    putBigEndian32(chunk, crc32(0, chunk.data() + 4, data.size() + 4));
+    out.write(reinterpret_cast<const char*>(chunk.data()), std::streamsize(chunk.size()));
+}
+
+// scanlines holds height rows, each a filter byte (0) followed by the pixels.
+// Written as stored (uncompressed) deflate blocks: the writer thread stays
+// cheap and there is no zlib dependency.
+static void writePng(std::ofstream& out, size_t width, size_t height, uint8_t bitDepth, uint8_t colorType, const std::vector<uint8_t>& scanlines)
+{
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    out.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+    std::vector<uint8_t> ihdr;
+    putBigEndian32(ihdr, uint32_t(width));
+    putBigEndian32(ihdr, uint32_t(height));
+    ihdr.insert(ihdr.end(), { bitDepth, colorType, 0, 0, 0 });
+    writePngChunk(out, "IHDR", ihdr);
+
+    constexpr size_t MAX_STORED_BLOCK = 65535;
+    std::vector<uint8_t> idat;
+    idat.reserve(scanlines.size() + scanlines.size() / MAX_STORED_BLOCK * 5 + 16);
+    idat.push_back(0x78);   // deflate, 32K window
+    idat.push_back(0x01);   // no preset dictionary, check bits
+    size_t offset = 0;
+    do
+    {
+        size_t block = std::min(scanlines.size() - offset, MAX_STORED_BLOCK);
+        bool last = offset + block == scanlines.size();
+        idat.push_back(last ? 1 : 0);
+        idat.push_back(uint8_t(block));
+        idat.push_back(uint8_t(block >> 8));
+        idat.push_back(uint8_t(~block));
+        idat.push_back(uint8_t(~block >> 8));
+        idat.insert(idat.end(), scanlines.begin() + offset, scanlines.begin() + offset + block);
+        offset += block;
+    } while (offset < scanlines.size());
+    putBigEndian32(idat, adler32(scanlines.data(), scanlines.size()));
+    writePngChunk(out, "IDAT", idat);
+
+    writePngChunk(out, "IEND", {});
+}
+
+// Row-major RGB pixels, with a leading filter byte per row when scanlines is set
+static std::vector<uint8_t> cellPixels(const Grid<CellState>& cells, bool scanlines)
+{
+    const size_t width = cells.getWidth();
+    std::vector<uint8_t> pixels;
+    pixels.reserve(cells.getHeight() * (width * 3 + 1));
+
+    for (size_t i = 0; i < cells.getHeight(); ++i)
+    {
+        if (scanlines)
+            pixels.push_back(0);
+        const CellState* row = cells[i];
+        for (size_t j = 0; j < width; ++j)
+        {
+            uint32_t color = cellColor(row[j]);
+            pixels.push_back(uint8_t(color >> 16));
+            pixels.push_back(uint8_t(color >> 8));
+            pixels.push_back(uint8_t(color));
+        }
+    }
+    return pixels;
+}
+
+// Nutrients as 16-bit big-endian grey levels (PGM and PNG agree on this)
+static std::vector<uint8_t> nutrientPixels(const Grid<float>& nutrients, bool scanlines)
+{
+    const size_t width = nutrients.getWidth();
+    std::vector<uint8_t> pixels;
+    pixels.reserve(nutrients.getHeight() * (width * 2 + 1));
+
+    for (size_t i = 0; i < nutrients.getHeight(); ++i)
+    {
+        if (scanlines)
+            pixels.push_back(0);
+        const float* row = nutrients[i];
+        for (size_t j = 0; j < width; ++j)
+        {
+            float value = std::clamp(row[j], MIN_NUTRIENT, MAX_NUTRIENT) / MAX_NUTRIENT;
+            uint16_t level = uint16_t(std::lround(value * 65535.0f));
+            pixels.push_back(uint8_t(level >> 8));
+            pixels.push_back(uint8_t(level));
+        }
+    }
+    return pixels;
+}
+
+static std::string framePath(const std::string& prefix, const char* field, uint64_t epoch, const char* extension)
+{
+    std::ostringstream path;
+    path << prefix << '_' << field << '_' << std::setw(8) << std::setfill('0') << epoch << extension;
+    return path.str();
+}
+
+static std::ofstream openFrame(const std::string& path)
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+        throw std::runtime_error("Unable to write frame " + path);
+    return out;
+}
+
+static void writeBytes(std::ofstream& out, const std::vector<uint8_t>& bytes)
+{
+    out.write(reinterpret_cast<const char*>(bytes.data()), std::streamsize(bytes.size()));
+}
+
+// ---- FrameExporter ----
+
+FrameExporter::FrameExporter(size_t width, size_t height, const ExportOptions& options)
+    : options(options)
+{
+    if (options.queueDepth == 0)
+        throw std::invalid_argument("Export queue depth must be positive");
+    if (!options.cells && !options.nutrients)
+        throw std::invalid_argument("Nothing to export");
+
+    // One snapshot per queue slot plus the one being written
+    for (size_t k = 0; k <= options.queueDepth; ++k)
+    {
+        auto snapshot = std::make_unique<Snapshot>();
+        if (options.cells)
+            snapshot->cells = Grid<CellState>(width, height);
+        if (options.nutrients)
+            snapshot->nutrients = Grid<float>(width, height);
+        freeSnapshots.push_back(snapshot.get());
+        pool.push_back(std::move(snapshot));
+    }
+
+    if (options.format == ExportFormat::Raw)
+    {
+        const std::string path = options.prefix + ".castream";
+        stream.open(path, std::ios::binary | std::ios::trunc);
+        if (!stream)
+            throw std::runtime_error("Unable to write frame stream " + path);
+
+        RawStreamHeader header{};
+        std::memcpy(header.magic, RAW_STREAM_MAGIC, sizeof(header.magic));
+        header.version = RAW_STREAM_VERSION;
+        header.contents = (options.cells ? RAW_STREAM_CELLS : 0) | (options.nutrients ? RAW_STREAM_NUTRIENTS : 0);
+        header.width = width;
+        header.height = height;
+        stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+
+    writer = std::thread(&FrameExporter::writerLoop, this);
+}
+
+FrameExporter::~FrameExporter()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    snapshotReady.notify_one();
+    writer.join();
+}
+
+void FrameExporter::submit(const CellularAutomata& sim)
+{
+    const Snapshot& shape = *pool.front();
+    const size_t width = options.cells ? shape.cells.getWidth() : shape.nutrients.getWidth();
+    const size_t height = options.cells ? shape.cells.getHeight() : shape.nutrients.getHeight();
+    if (sim.getWidth() != width || sim.getHeight() != height)
+        throw std::invalid_argument("Simulation size does not match the exporter");
+
+    Snapshot* snapshot;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (failure)
+            std::rethrow_exception(failure);
+
+        if (freeSnapshots.empty())
+        {
+            if (options.dropWhenFull)
+            {
+                ++stats.dropped;
+                return;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            snapshotFree.wait(lock, [this] { return !freeSnapshots.empty() || failure; });
+            if (failure)
+                std::rethrow_exception(failure);
+            ++stats.delayed;
+            stats.delaySeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        snapshot = freeSnapshots.back();
+        freeSnapshots.pop_back();
+    }
+
+    // Same size as the recycled buffers, so these are plain copies
+    snapshot->epoch = sim.getEpoch();
+    if (options.cells)
+        snapshot->cells = sim.getCellGrid();
+    if (options.nutrients)
+        snapshot->nutrients = sim.getNutrientGrid();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.push_back(snapshot);
+    }
+    snapshotReady.notify_one();
+}
+
+void FrameExporter::flush()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    snapshotFree.wait(lock, [this] { return (pending.empty() && writing == nullptr) || failure; });
+    if (failure)
+        std::rethrow_exception(failure);
+}
+
+ExportStats FrameExporter::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void FrameExporter::writerLoop()
+{
+    for (;;)
+    {
+        bool failed;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            snapshotReady.wait(lock, [this] { return stopping || !pending.empty(); });
+            // Stop only once the queue is drained
+            if (pending.empty())
+                return;
+            writing = pending.front();
+            pending.pop_front();
+            failed = failure != nullptr;
+        }
+
+        // After an error the queue is still drained, but nothing more is written
+        std::exception_ptr error;
+        if (!failed)
+        {
+            try
+            {
+                write(*writing);
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (error)
+                failure = error;
+            else if (!failed)
+                ++stats.written;
+            freeSnapshots.push_back(writing);
+            writing = nullptr;
+        }
+        snapshotFree.notify_all();
+    }
+}
+
+void FrameExporter::write(const Snapshot& snapshot)
+{
+    switch (options.format)
+    {
+        case ExportFormat::PPM:
+        {
+            if (options.cells)
+            {
+                const std::string path = framePath(options.prefix, "cells", snapshot.epoch, ".ppm");
+                std::ofstream out = openFrame(path);
+                out << "P6\n" << snapshot.cells.getWidth() << ' ' << snapshot.cells.getHeight() << "\n255\n";
+                writeBytes(out, cellPixels(snapshot.cells, false));
+                if (!out.flush())
+                    throw std::runtime_error("Unable to write frame " + path);
+            }
+            if (options.nutrients)
+            {
+                const std::string path = framePath(options.prefix, "nutrients", snapshot.epoch, ".pgm");
+                std::ofstream out = openFrame(path);
+                out << "P5\n" << snapshot.nutrients.getWidth() << ' ' << snapshot.nutrients.getHeight() << "\n65535\n";
+                writeBytes(out, nutrientPixels(snapshot.nutrients, false));
+                if (!out.flush())
+                    throw std::runtime_error("Unable to write frame " + path);
+            }
+            break;
+        }
+        case ExportFormat::PNG:
+        {
+            if (options.cells)
+            {
+                const std::string path = framePath(options.prefix, "cells", snapshot.epoch, ".png");
+                std::ofstream out = openFrame(path);
+                writePng(out, snapshot.cells.getWidth(), snapshot.cells.getHeight(), 8, 2, cellPixels(snapshot.cells, true));
+                if (!out.flush())
+                    throw std::runtime_error("Unable to write frame " + path);
+            }
+            if (options.nutrients)
+            {
+                const std::string path = framePath(options.prefix, "nutrients", snapshot.epoch, ".png");
+                std::ofstream out = openFrame(path);
+                writePng(out, snapshot.nutrients.getWidth(), snapshot.nutrients.getHeight(), 16, 0, nutrientPixels(snapshot.nutrients, true));
+                if (!out.flush())
+                    throw std::runtime_error("Unable to write frame " + path);
+            }
+            break;
+        }
+        case ExportFormat::Raw:
+        {
+            stream.write(reinterpret_cast<const char*>(&snapshot.epoch), sizeof(snapshot.epoch));
+            if (options.cells)
+                for (size_t i = 0; i < snapshot.cells.getHeight(); ++i)
+                    stream.write(reinterpret_cast<const char*>(snapshot.cells[i]), std::streamsize(snapshot.cells.getWidth() * sizeof(CellState)));
+            if (options.nutrients)
+                for (size_t i = 0; i < snapshot.nutrients.getHeight(); ++i)
+                    stream.write(reinterpret_cast<const char*>(snapshot.nutrients[i]), std::streamsize(snapshot.nutrients.getWidth() * sizeof(float)));
+            if (!stream.flush())
+                throw std::runtime_error("Unable to write frame stream " + options.prefix + ".castream");
+            break;
+        }
+    }
+}
@@ -0,0 +1,312 @@
+#include <halo_transport.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CA_HAS_HALO_LINKS 1
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+HaloTransportKind parseHaloTransport(const std::string& name)
+{
+    if (name == "shm")
+        return HaloTransportKind::SharedMemory;
+    if (name == "socket")
+        return HaloTransportKind::Socket;
+    throw std::invalid_argument("Unknown halo transport: " + name);
+}
+
+const char* haloTransportName(HaloTransportKind kind)
+{
+    switch (kind)
+    {
+        case HaloTransportKind::SharedMemory: return "shm";
+        case HaloTransportKind::Socket:       return "socket";
+    }
+    return "unknown";
+}
+
+#ifdef CA_HAS_HALO_LINKS
+
+// Shared memory
+
+// Single-message mailbox for one direction of a link, followed in the
+// mapping by its payload
+struct alignas(64) Mailbox
+{
+    std::atomic<uint32_t> full;     // a message waits for the receiver
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "Mailboxes are shared between processes");
+
+static char* payload(Mailbox* mailbox)
+{
+    return reinterpret_cast<char*>(mailbox) + sizeof(Mailbox);
+}
+
+// Blocks while word holds value. Futexes on a shared mapping work across
+// processes (the private ones std::atomic::wait may use do not).
+static void waitWhile(std::atomic<uint32_t>& word, uint32_t value)
+{
+    while (word.load(std::memory_order_acquire) == value)
+    {
+#ifdef __linux__
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, value, nullptr, nullptr, 0);
+#else
+        std::this_thread::yield();
+#endif
+    }
+}
+
+static void wake(std::atomic<uint32_t>& word)
+{
+#ifdef __linux__
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+#else
+    (void)word;
+#endif
+}
+
+class SharedMemoryTransport : public HaloTransport
+{
+    std::shared_ptr<void> mapping;
+    size_t capacity;
+    // Indexed by HaloSide, null without a band on that side
+    std::array<Mailbox*, 2> outgoing;
+    std::array<Mailbox*, 2> incoming;
+public:
+    SharedMemoryTransport(std::shared_ptr<void> mapping, size_t capacity, std::array<Mailbox*, 2> outgoing, std::array<Mailbox*, 2> incoming)
+        : mapping(std::move(mapping)),
+          capacity(capacity),
+          outgoing(outgoing),
+          incoming(incoming)
+    {}
+
+    void exchange(HaloSide side, const void* send, void* receive, size_t size) override
+    {
+        Mailbox* out = outgoing[size_t(side)];
+        Mailbox* in = incoming[size_t(side)];
+        if (!out)
+            throw std::logic_error("No band on that side");
+        if (size > capacity)
+            throw std::length_error("Halo message larger than the mailbox");
+
+        // Waits for the neighbour to have taken the previous message
+        waitWhile(out->full, 1);
+        std::memcpy(payload(out), send, size);
+        out->full.store(1, std::memory_order_release);
+        wake(out->full);
+
+        waitWhile(in->full, 0);
+        std::memcpy(receive, payload(in), size);
+        in->full.store(0, std::memory_order_release);
+        wake(in->full);
+    }
+};
+
+class SharedMemoryLinks : public HaloLinks
+{
+    size_t processes;
+    size_t capacity;
+    size_t slot;
+    std::shared_ptr<void> mapping;
+
+    // Direction 0 runs down the link (rank to rank + 1), 1 up
+    Mailbox* mailbox(size_t link, size_t direction) const
+    {
+        return reinterpret_cast<Mailbox*>(static_cast<char*>(mapping.get()) + (2 * link + direction) * slot);
+    }
+public:
+    SharedMemoryLinks(size_t processes, size_t maxMessage)
+        : processes(processes),
+          capacity(maxMessage),
+          slot(sizeof(Mailbox) + (maxMessage + alignof(Mailbox) - 1) / alignof(Mailbox) * alignof(Mailbox))
+    {
+        const size_t links = processes - 1;
+        const size_t bytes = std::max<size_t>(2 * links * slot, 1);
+        void* mapped = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (mapped == MAP_FAILED)
+            throw std::system_error(errno, std::generic_category(), "Unable to map the halo mailboxes");
+        mapping = std::shared_ptr<void>(mapped, [bytes](void* address) { ::munmap(address, bytes); });
+
+        for (size_t link = 0; link < links; link++)
+            for (size_t direction = 0; direction < 2; direction++)
+                new (mailbox(link, direction)) Mailbox{ 0 };
+    }
+
+    std::unique_ptr<HaloTransport> attach(size_t rank) override
+    {
+        std::array<Mailbox*, 2> outgoing = { nullptr, nullptr };
+        std::array<Mailbox*, 2> incoming = { nullptr, nullptr };
+        if (rank > 0)
+        {
+            outgoing[size_t(HaloSide::Up)] = mailbox(rank - 1, 1);
+            incoming[size_t(HaloSide::Up)] = mailbox(rank - 1, 0);
+        }
+        if (rank + 1 < processes)
+        {
+            outgoing[size_t(HaloSide::Down)] = mailbox(rank, 0);
+            incoming[size_t(HaloSide::Down)] = mailbox(rank, 1);
+        }
+        return std::make_unique<SharedMemoryTransport>(mapping, capacity, outgoing, incoming);
+    }
+};
+
+
+// Sockets
+
+class SocketTransport : public HaloTransport
+{
+    // Indexed by HaloSide, -1 without a band on that side
+    std::array<int, 2> sockets;
+public:
+    explicit SocketTransport(std::array<int, 2> sockets)
+        : sockets(sockets)
+    {}
+
+    ~SocketTransport() override
+    {
+        for (int fd : sockets)
+            if (fd >= 0)
+                ::close(fd);
+    }
+
+    void exchange(HaloSide side, const void* send, void* receive, size_t size) override
+    {
+        const int fd = sockets[size_t(side)];
+        if (fd < 0)
+            throw std::logic_error("No band on that side");
+
+        // Both ends send and receive at once, so a message larger than the
+        // socket buffers cannot deadlock
+        const char* out = static_cast<const char*>(send);
+        char* in = static_cast<char*>(receive);
+        size_t sent = 0, received = 0;
+        while (sent < size || received < size)
+        {
+            pollfd request{ fd, short((sent < size ? POLLOUT : 0) | (received < size ? POLLIN : 0)), 0 };
+            if (::poll(&request, 1, -1) < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                throw std::system_error(errno, std::generic_category(), "Halo poll failed");
+            }
+
+            if (sent < size && (request.revents & POLLOUT))
+            {
+                ssize_t n = ::send(fd, out + sent, size - sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+                if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                    throw std::system_error(errno, std::generic_category(), "Halo send failed");
+                if (n > 0)
+                    sent += size_t(n);
+            }
+            if (received < size && (request.revents & (POLLIN | POLLHUP | POLLERR)))
+            {
+                ssize_t n = ::recv(fd, in + received, size - received, MSG_DONTWAIT);
+                if (n == 0)
+                    throw std::runtime_error("Halo neighbour closed the connection");
+                if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                    throw std::system_error(errno, std::generic_category(), "Halo receive failed");
+                if (n > 0)
+                    received += size_t(n);
+            }
+        }
+    }
+};
+
+class SocketLinks : public HaloLinks
+{
+    // One connected pair per link: [0] for the band above, [1] for the one below
+    std::vector<std::array<int, 2>> links;
+
+    void closeAll()
+    {
+        for (auto& pair : links)
+            for (int& fd : pair)
+                if (fd >= 0)
+                {
+                    ::close(fd);
+                    fd = -1;
+                }
+    }
+public:
+    explicit SocketLinks(size_t processes)
+        : links(processes - 1, std::array<int, 2>{ -1, -1 })
+    {
+        for (auto& pair : links)
+        {
+            int fds[2];
+            if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+            {
+                int error = errno;
+                closeAll();
+                throw std::system_error(error, std::generic_category(), "Unable to create the halo sockets");
+            }
+            pair = { fds[0], fds[1] };
+        }
+    }
+
+    ~SocketLinks() override
+    {
+        closeAll();
+    }
+
+    std::unique_ptr<HaloTransport> attach(size_t rank) override
+    {
+        std::array<int, 2> sockets = { -1, -1 };
+        if (rank > 0)
+            std::swap(sockets[size_t(HaloSide::Up)], links[rank - 1][1]);
+        if (rank < links.size())
+            std::swap(sockets[size_t(HaloSide::Down)], links[rank][0]);
+
+        // Other processes' ends are closed here, so a neighbour that dies
+        // shows up as a closed connection instead of a hang
+        closeAll();
+        return std::make_unique<SocketTransport>(sockets);
+    }
+};
+
+#endif
+
+std::unique_ptr<HaloLinks> makeHaloLinks(HaloTransportKind kind, size_t processes, size_t maxMessage)
+{
+    if (processes == 0)
+        throw std::invalid_argument("Halo links need at least one process");
+
+#ifdef CA_HAS_HALO_LINKS
+    switch (kind)
+    {
+        case HaloTransportKind::SharedMemory:
+            return std::make_unique<SharedMemoryLinks>(processes, maxMessage);
+        case HaloTransportKind::Socket:
+            return std::make_unique<SocketLinks>(processes);
+    }
+    throw std::invalid_argument("Unknown halo transport");
+#else
+    (void)kind;
+    (void)maxMessage;
+    throw std::runtime_error("Halo links need POSIX shared memory and sockets");
+#endif
+}
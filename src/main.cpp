@@ -1,164 +1,705 @@
 #include <cellular_automata.hpp>
+#include <cellular_automata_3d.hpp>
+#include <checkpoint.hpp>
+#include <domain.hpp>
+#include <frame.hpp>
+#include <frame_exporter.hpp>
+#ifdef CELLULAR_AUTOMATA_VIEWER
+#include <renderer.hpp>
+#endif
+#include <scenarios.hpp>
+#include <stats_writer.hpp>
 
-#include <array>
-#include <cmath>
+#include <chrono>
 #include <iostream>
+#include <memory>
+#include <optional>
 #include <random>
 #include <string>
 #include <algorithm>
+#include <vector>
 
-std::array<std::array<CellState, GRID_SIZE>, GRID_SIZE>
-make_empty_cell_grid()
+struct RunOptions
 {
-    std::array<std::array<CellState, GRID_SIZE>, GRID_SIZE> grid{};
-    for (auto& row : grid)
-        row.fill(CellState::Empty);
-    return grid;
+    int simId = -1;
+    size_t width = DEFAULT_GRID_SIZE;
+    size_t height = DEFAULT_GRID_SIZE;
+    size_t depth = 0;          // 0 = 2D grid
+    bool headless = false;
+    uint64_t epochs = 0;       // 0 = until the window is closed
+    uint64_t renderEvery = 1;  // 0 = never
+    bool renderEverySet = false;
+    RenderOptions renderOptions;
+    SimdLevel simdLevel = detectSimdLevel();
+    size_t threads = 1;
+    size_t tileSize = DEFAULT_TILE_SIZE;
+    DivisionMode divisionMode = DivisionMode::Sequential;
+    NutrientSolverOptions nutrientSolver;
+    std::optional<uint64_t> seed;
+    std::optional<float> activeTolerance;
+    std::optional<float> consumptionRate; // unset = ScenarioParameters
+    bool fusedStep = true;
+    NutrientPrecision nutrientPrecision = NutrientPrecision::Float32;
+    bool nutrientPrecisionSet = false;
+    std::optional<std::string> restorePath;
+    std::optional<std::string> checkpointPath;
+    uint64_t checkpointEvery = 0; // 0 = only at the end
+    std::optional<std::string> exportPrefix;
+    uint64_t exportEvery = 1;
+    ExportOptions exportOptions;
+    std::optional<std::string> statsPath;
+    StatsFormat statsFormat = StatsFormat::CSV;
+    size_t processes = 0;      // 0 = run in this process
+    HaloTransportKind transport = HaloTransportKind::SharedMemory;
+    // Model policies, see automaton_policies.hpp
+    std::string neighborhood = "von-neumann";
+    std::string boundary = "source";
+    std::string divisionRule = "random";
+    // Initial state from images instead of a scenario
+    std::optional<std::string> cellsImage;
+    std::optional<std::string> nutrientsImage;
+};
+
+void print_usage()
+{
+    std::cout << "Usage: ./build/cellular_automata <0-5> [width] [height] [options]\n"
+              << "       ./build/cellular_automata --cells-image PATH [options]\n"
+              << "  --headless          run without a window (requires --epochs)\n"
+              << "  --epochs N          stop after N epochs\n"
+              << "  --render-every N    render every N epochs, 0 = never (window only)\n"
+              << "  --window WxH        largest window, bigger grids are downscaled (default 1280x960)\n"
+              << "  --overlay           draw the nutrient field under empty cells (N toggles it)\n"
+              << "  --simd LEVEL        scalar, avx2 or avx512 (default: best supported)\n"
+              << "  --threads N         worker threads, 0 = all hardware threads (default 1)\n"
+              << "  --tile-size N       edge of the square tiles handed to the workers\n"
+              << "  --division MODE     sequential or deterministic (any thread count, same result)\n"
+              << "  --nutrient-solver S explicit, implicit or steady (default explicit)\n"
+              << "  --solver-step N     epochs covered by one implicit step (default 100)\n"
+              << "  --solver-tolerance X  stop the multigrid once it changes no cell by more\n"
+              << "  --seed N            seed for the scenario and the simulation, to replay a run\n"
+              << "  --active-tolerance X  skip steady tiles (0 = exact, unset = full sweeps)\n"
+              << "  --consumption X     nutrient each living cell draws per epoch (default 0)\n"
+              << "  --unfused           run the phases of a step as separate sweeps, for comparison\n"
+              << "  --nutrient-precision P  float32 or fixed16 (16-bit nutrient storage, explicit\n"
+              << "                      nutrients only, default float32)\n"
+              << "  --cells-image PATH  start from a PPM/PGM image instead of a scenario (exported cell\n"
+              << "                      colours keep their state, other bright pixels are Alive)\n"
+              << "  --nutrients-image PATH  PGM nutrient field for --cells-image (default MAX_NUTRIENT)\n"
+              << "  --restore PATH      continue from a checkpoint instead of a scenario\n"
+              << "                      (with --seed: fork it with a new random stream)\n"
+              << "  --checkpoint PATH   write a checkpoint at the end of the run\n"
+              << "  --checkpoint-every N  also write it every N epochs\n"
+              << "  --export PREFIX     record frames in the background (PREFIX_cells_<epoch>...)\n"
+              << "  --export-every N    record every N epochs (default 1)\n"
+              << "  --export-format F   ppm, png or raw (one PREFIX.castream file)\n"
+              << "  --export-fields F   cells, nutrients or both (default cells)\n"
+              << "  --export-queue N    frames that may wait for the writer (default 4)\n"
+              << "  --export-drop       drop frames instead of waiting when the queue is full\n"
+              << "  --stats PATH        record per-step timings and statistics\n"
+              << "  --stats-format F    csv or jsonl (default csv)\n"
+              << "  --processes N       split the grid into N row bands, one process each\n"
+              << "                      (headless, deterministic division, explicit nutrients)\n"
+              << "  --transport T       halo exchange between bands: shm or socket (default shm)\n"
+              << "  --depth D           run a width x height x D volume (headless, scenarios 0-1)\n"
+              << "  --neighborhood N    von-neumann or moore (default von-neumann)\n"
+              << "  --boundary B        source, no-flux or periodic (default source)\n"
+              << "  --division-rule R   random or richest empty neighbour (default random)\n"
+              << "                      (other models run headless, without the output or restore options)\n";
 }
 
-std::array<std::array<float, GRID_SIZE>, GRID_SIZE>
-make_uniform_nutrient_grid(float value)
+bool parse_options(int argc, char** argv, RunOptions& options)
 {
-    std::array<std::array<float, GRID_SIZE>, GRID_SIZE> grid{};
-    for (auto& row : grid)
-        row.fill(value);
-    return grid;
+    std::vector<std::string> positional;
+
+    for (int a = 1; a < argc; ++a)
+    {
+        std::string arg = argv[a];
+
+        if (arg == "--headless")
+            options.headless = true;
+        else if (arg == "--epochs" && a + 1 < argc)
+            options.epochs = std::stoull(argv[++a]);
+        else if (arg == "--render-every" && a + 1 < argc)
+        {
+            options.renderEvery = std::stoull(argv[++a]);
+            options.renderEverySet = true;
+        }
+        else if (arg == "--window" && a + 1 < argc)
+        {
+            std::string size = argv[++a];
+            size_t x = size.find('x');
+            if (x == std::string::npos)
+                return false;
+            options.renderOptions.maxWidth = std::stoul(size.substr(0, x));
+            options.renderOptions.maxHeight = std::stoul(size.substr(x + 1));
+        }
+        else if (arg == "--overlay")
+            options.renderOptions.nutrients = true;
+        else if (arg == "--simd" && a + 1 < argc)
+            options.simdLevel = parseSimdLevel(argv[++a]);
+        else if (arg == "--threads" && a + 1 < argc)
+            options.threads = std::stoul(argv[++a]);
+        else if (arg == "--tile-size" && a + 1 < argc)
+            options.tileSize = std::stoul(argv[++a]);
+        else if (arg == "--division" && a + 1 < argc)
+        {
+            std::string mode = argv[++a];
+            if (mode == "sequential")
+                options.divisionMode = DivisionMode::Sequential;
+            else if (mode == "deterministic")
+                options.divisionMode = DivisionMode::Deterministic;
+            else
+                return false;
+        }
+        else if (arg == "--nutrient-solver" && a + 1 < argc)
+            options.nutrientSolver.solver = parseNutrientSolver(argv[++a]);
+        else if (arg == "--solver-step" && a + 1 < argc)
+            options.nutrientSolver.timeStep = std::stof(argv[++a]);
+        else if (arg == "--solver-tolerance" && a + 1 < argc)
+            options.nutrientSolver.tolerance = std::stof(argv[++a]);
+        else if (arg == "--seed" && a + 1 < argc)
+            options.seed = std::stoull(argv[++a]);
+        else if (arg == "--active-tolerance" && a + 1 < argc)
+            options.activeTolerance = std::stof(argv[++a]);
+        else if (arg == "--consumption" && a + 1 < argc)
+            options.consumptionRate = std::stof(argv[++a]);
+        else if (arg == "--unfused")
+            options.fusedStep = false;
+        else if (arg == "--nutrient-precision" && a + 1 < argc)
+        {
+            options.nutrientPrecision = parseNutrientPrecision(argv[++a]);
+            options.nutrientPrecisionSet = true;
+        }
+        else if (arg == "--restore" && a + 1 < argc)
+            options.restorePath = argv[++a];
+        else if (arg == "--checkpoint" && a + 1 < argc)
+            options.checkpointPath = argv[++a];
+        else if (arg == "--checkpoint-every" && a + 1 < argc)
+            options.checkpointEvery = std::stoull(argv[++a]);
+        else if (arg == "--export" && a + 1 < argc)
+            options.exportPrefix = argv[++a];
+        else if (arg == "--export-every" && a + 1 < argc)
+            options.exportEvery = std::stoull(argv[++a]);
+        else if (arg == "--export-format" && a + 1 < argc)
+            options.exportOptions.format = parseExportFormat(argv[++a]);
+        else if (arg == "--export-fields" && a + 1 < argc)
+        {
+            std::string fields = argv[++a];
+            if (fields != "cells" && fields != "nutrients" && fields != "both")
+                return false;
+            options.exportOptions.cells = fields != "nutrients";
+            options.exportOptions.nutrients = fields != "cells";
+        }
+        else if (arg == "--export-queue" && a + 1 < argc)
+            options.exportOptions.queueDepth = std::stoul(argv[++a]);
+        else if (arg == "--export-drop")
+            options.exportOptions.dropWhenFull = true;
+        else if (arg == "--stats" && a + 1 < argc)
+            options.statsPath = argv[++a];
+        else if (arg == "--stats-format" && a + 1 < argc)
+            options.statsFormat = parseStatsFormat(argv[++a]);
+        else if (arg == "--processes" && a + 1 < argc)
+            options.processes = std::stoul(argv[++a]);
+        else if (arg == "--transport" && a + 1 < argc)
+            options.transport = parseHaloTransport(argv[++a]);
+        else if (arg == "--depth" && a + 1 < argc)
+            options.depth = std::stoul(argv[++a]);
+        else if (arg == "--cells-image" && a + 1 < argc)
+            options.cellsImage = argv[++a];
+        else if (arg == "--nutrients-image" && a + 1 < argc)
+            options.nutrientsImage = argv[++a];
+        else if (arg == "--neighborhood" && a + 1 < argc)
+        {
+            options.neighborhood = argv[++a];
+            if (options.neighborhood != "von-neumann" && options.neighborhood != "moore")
+                return false;
+        }
+        else if (arg == "--boundary" && a + 1 < argc)
+        {
+            options.boundary = argv[++a];
+            if (options.boundary != "source" && options.boundary != "no-flux" && options.boundary != "periodic")
+                return false;
+        }
+        else if (arg == "--division-rule" && a + 1 < argc)
+        {
+            options.divisionRule = argv[++a];
+            if (options.divisionRule != "random" && options.divisionRule != "richest")
+                return false;
+        }
+        else if (arg.rfind("--", 0) == 0)
+            return false;
+        else
+            positional.push_back(arg);
+    }
+
+    // A restored run takes everything from the checkpoint
+    if (options.restorePath)
+        return positional.empty() && !options.cellsImage && !options.nutrientsImage && !options.consumptionRate;
+
+    // Images give the grid size, no scenario or size then
+    if (options.nutrientsImage && !options.cellsImage)
+        return false;
+    if (options.cellsImage)
+    {
+        if (!positional.empty())
+            return false;
+    }
+    else
+    {
+        if (positional.empty() || positional.size() > 3)
+            return false;
+
+        options.simId = std::stoi(positional[0]);
+        if (positional.size() > 1)
+            options.width = options.height = std::stoul(positional[1]);
+        if (positional.size() > 2)
+            options.height = std::stoul(positional[2]);
+    }
+
+    // Headless runs do no rendering unless asked to
+    if (options.headless && !options.renderEverySet)
+        options.renderEvery = 0;
+
+    return true;
 }
 
-std::mt19937& rng()
+// FNV-1a over both grids, to check that two runs ended in the same state
+uint64_t state_checksum(const Grid<CellState>& cells, const Grid<float>& nutrients)
 {
-    static std::mt19937 gen(std::random_device{}());
-    return gen;
+    uint64_t hash = 0xcbf29ce484222325ull;
+    auto mix = [&hash](const void* data, size_t bytes)
+    {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        for (size_t b = 0; b < bytes; ++b)
+            hash = (hash ^ p[b]) * 0x100000001b3ull;
+    };
+
+    for (size_t i = 0; i < cells.getHeight(); ++i)
+    {
+        mix(cells[i], cells.getWidth() * sizeof(CellState));
+        mix(nutrients[i], nutrients.getWidth() * sizeof(float));
+    }
+    return hash;
 }
 
-void sim_sparse_noise(auto& cells, auto& nutrients)
+template <typename Automaton>
+void print_summary(const Automaton& sim, double seconds)
 {
-    cells = make_empty_cell_grid();
-    nutrients = make_uniform_nutrient_grid(0.8f);
+    CellCounts counts = sim.countCells();
+    double cellUpdates = double(sim.getEpoch()) * double(sim.getWidth() * sim.getHeight());
 
-    std::uniform_real_distribution<float> dist(0.f, 1.f);
+    std::cout << "Epochs:      " << sim.getEpoch() << "\n"
+              << "Grid:        " << sim.getWidth() << "x" << sim.getHeight() << "\n"
+              << "SIMD:        " << simdLevelName(sim.getSimdLevel()) << "\n"
+              << "Threads:     " << sim.getThreadCount() << "\n"
+              << "Seed:        " << sim.getSeed() << "\n"
+              << "Nutrients:   " << nutrientSolverName(sim.getNutrientSolver().solver) << ", "
+              << nutrientPrecisionName(sim.getNutrientPrecision()) << "\n"
+              << "Active tiles: " << sim.getActiveTileCount() << "\n"
+              << "Wall time:   " << seconds << " s\n"
+              << "Epochs/s:    " << sim.getEpoch() / seconds << "\n"
+              << "Cells/s:     " << cellUpdates / seconds << "\n"
+              << "Alive:       " << counts.alive << "\n"
+              << "Quiescent:   " << counts.quiescent << "\n"
+              << "Necrotic:    " << counts.necrotic << "\n"
+              << "Checksum:    " << std::hex << state_checksum(sim.getCellGrid(), sim.getNutrientGrid()) << std::dec << "\n";
+}
 
-    for (int i = 1; i < GRID_SIZE - 1; ++i)
-        for (int j = 1; j < GRID_SIZE - 1; ++j)
-            if (dist(rng()) < 0.002f)
-                cells[i][j] = CellState::Alive;
+EngineOptions engine_options(const RunOptions& options)
+{
+    EngineOptions engine;
+    engine.simdLevel = options.simdLevel;
+    engine.threads = options.threads;
+    engine.tileSize = options.tileSize;
+    engine.activeTolerance = options.activeTolerance;
+    engine.instrumentation = options.statsPath.has_value();
+    engine.fusedStep = options.fusedStep;
+    engine.nutrientPrecision = options.nutrientPrecision;
+    return engine;
 }
 
-void sim_radial_tumor(auto& cells, auto& nutrients)
+void print_decomposed_summary(const DomainResult& result, const RunOptions& options)
 {
-    cells = make_empty_cell_grid();
-    nutrients = make_uniform_nutrient_grid(0.2f);
+    CellCounts counts = countCells(result.cells);
+    double cellUpdates = double(result.epoch) * double(result.cells.getWidth() * result.cells.getHeight());
+
+    std::cout << "Epochs:      " << result.epoch << "\n"
+              << "Grid:        " << result.cells.getWidth() << "x" << result.cells.getHeight() << "\n"
+              << "Processes:   " << options.processes << "\n"
+              << "Transport:   " << haloTransportName(options.transport) << "\n"
+              << "Threads:     " << options.threads << " per process\n"
+              << "Seed:        " << result.seed << "\n"
+              << "Wall time:   " << result.seconds << " s\n"
+              << "Epochs/s:    " << result.epoch / result.seconds << "\n"
+              << "Cells/s:     " << cellUpdates / result.seconds << "\n"
+              << "Alive:       " << counts.alive << "\n"
+              << "Quiescent:   " << counts.quiescent << "\n"
+              << "Necrotic:    " << counts.necrotic << "\n"
+              << "Checksum:    " << std::hex << state_checksum(result.cells, result.nutrients) << std::dec << "\n";
+}
 
-    int cx = GRID_SIZE / 2, cy = GRID_SIZE / 2;
-    for (int i = 0; i < GRID_SIZE; ++i)
-        for (int j = 0; j < GRID_SIZE; ++j)
+uint64_t volume_checksum(const CellularAutomata3D& sim)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    auto mix = [&hash](const void* data, size_t bytes)
+    {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        for (size_t b = 0; b < bytes; ++b)
+            hash = (hash ^ p[b]) * 0x100000001b3ull;
+    };
+
+    for (size_t z = 0; z < sim.getDepth(); ++z)
+        for (size_t y = 0; y < sim.getHeight(); ++y)
         {
-            float d = std::hypot(i - cx, j - cy);
-            nutrients[i][j] = std::clamp(1.f - d / (GRID_SIZE / 2.f), 0.f, 1.f);
-            if (d < 6) cells[i][j] = CellState::Alive;
+            mix(sim.getCellGrid().row(y, z), sim.getWidth() * sizeof(CellState));
+            mix(sim.getNutrientGrid().row(y, z), sim.getWidth() * sizeof(float));
         }
+    return hash;
 }
 
-void sim_competing_colonies(auto& cells, auto& nutrients)
+void print_volume_summary(const CellularAutomata3D& sim, double seconds)
 {
-    cells = make_empty_cell_grid();
-    nutrients = make_uniform_nutrient_grid(0.7f);
+    CellCounts counts = sim.countCells();
+    double cellUpdates = double(sim.getEpoch()) * double(sim.getWidth() * sim.getHeight() * sim.getDepth());
 
-    std::uniform_int_distribution<int> pos(20, GRID_SIZE - 20);
+    std::cout << "Epochs:      " << sim.getEpoch() << "\n"
+              << "Volume:      " << sim.getWidth() << "x" << sim.getHeight() << "x" << sim.getDepth() << "\n"
+              << "SIMD:        " << simdLevelName(sim.getSimdLevel()) << "\n"
+              << "Threads:     " << sim.getThreadCount() << "\n"
+              << "Seed:        " << sim.getSeed() << "\n"
+              << "Wall time:   " << seconds << " s\n"
+              << "Epochs/s:    " << sim.getEpoch() / seconds << "\n"
+              << "Cells/s:     " << cellUpdates / seconds << "\n"
+              << "Alive:       " << counts.alive << "\n"
+              << "Quiescent:   " << counts.quiescent << "\n"
+              << "Necrotic:    " << counts.necrotic << "\n"
+              << "Checksum:    " << std::hex << volume_checksum(sim) << std::dec << "\n";
+}
 
-    for (int c = 0; c < 12; ++c)
+// Builder owning the initial grids for options (a scenario or images),
+// drawing the seed when none was given
+SimulationBuilder scenario_builder(RunOptions& options)
+{
+    // One seed drives both the scenario and the simulation, so a run can be replayed
+    if (!options.seed)
+        options.seed = (uint64_t(std::random_device{}()) << 32) | std::random_device{}();
+
+    if (options.cellsImage)
     {
-        int cx = pos(rng()), cy = pos(rng());
-        for (int i = cx - 4; i <= cx + 4; ++i)
-            for (int j = cy - 4; j <= cy + 4; ++j)
-                if ((i - cx)*(i - cx) + (j - cy)*(j - cy) <= 16)
-                    cells[i][j] = CellState::Alive;
+        Grid<CellState> cells;
+        Grid<float> nutrients;
+        load_scenario_images(*options.cellsImage, options.nutrientsImage.value_or(""), cells, nutrients, options.threads);
+        return SimulationBuilder(std::move(cells), std::move(nutrients));
     }
+
+    return SimulationBuilder(options.width, options.height, [&options](Grid<CellState>& cells, Grid<float>& nutrients)
+    {
+        generate_scenario(options.simId, cells, nutrients, *options.seed, options.threads);
+    });
 }
 
-void sim_stripes(auto& cells, auto& nutrients)
+SimulationBuilder& configure_builder(SimulationBuilder& builder, const RunOptions& options)
 {
-    cells = make_empty_cell_grid();
-    nutrients = make_uniform_nutrient_grid(0.15f);
+    if (options.activeTolerance)
+        builder.setActiveRegionTolerance(*options.activeTolerance);
 
-    for (int i = 0; i < GRID_SIZE; ++i)
-        if ((i / 16) % 2 == 0)
-            for (int j = 0; j < GRID_SIZE; ++j)
-                nutrients[i][j] = 0.9f;
+    ScenarioParameters parameters;
+    return builder
+        .setDiffusionSpeed(parameters.diffusionSpeed)
+        .setDeathThreshold(parameters.deathThreshold)
+        .setDivideThreshold(parameters.divideThreshold)
+        .setDivisionCost(parameters.divisionCost)
+        .setConsumptionRate(options.consumptionRate.value_or(parameters.consumptionRate))
+        .setSimdLevel(options.simdLevel)
+        .setThreads(options.threads)
+        .setTileSize(options.tileSize)
+        .setDivisionMode(options.divisionMode)
+        .setNutrientSolver(options.nutrientSolver)
+        .setInstrumentation(options.statsPath.has_value())
+        .setFusedStep(options.fusedStep)
+        .setNutrientPrecision(options.nutrientPrecision)
+        .setSeed(*options.seed);
+}
 
-    for (int j = GRID_SIZE / 3; j < 2 * GRID_SIZE / 3; ++j)
-        cells[GRID_SIZE / 2][j] = CellState::Alive;
+CellularAutomata build_simulation(RunOptions& options)
+{
+    SimulationBuilder builder = scenario_builder(options);
+    configure_builder(builder, options);
+    return std::move(builder).build();
 }
 
-void sim_traveling_wave(auto& cells, auto& nutrients)
+int run_volume(RunOptions& options)
 {
-    cells = make_empty_cell_grid();
-    nutrients = make_uniform_nutrient_grid(0.1f);
+    if (!options.seed)
+        options.seed = (uint64_t(std::random_device{}()) << 32) | std::random_device{}();
 
-    for (int i = 0; i < GRID_SIZE; ++i)
-    {
-        float w = 0.5f * (1.f + std::sin(2.f * float(M_PI) * i / 40.f));
-        for (int j = 0; j < GRID_SIZE; ++j)
-            nutrients[i][j] = 0.1f + w * 0.9f;
-    }
+    Grid3D<CellState> cells(options.width, options.height, options.depth);
+    Grid3D<float> nutrients(options.width, options.height, options.depth);
+    generate_volume_scenario(options.simId, cells, nutrients, *options.seed, options.threads);
+
+    ScenarioParameters parameters;
+    SimulationBuilder3D builder(std::move(cells), std::move(nutrients));
+    builder
+        .setDiffusionSpeed(parameters.diffusionSpeed)
+        .setDeathThreshold(parameters.deathThreshold)
+        .setDivideThreshold(parameters.divideThreshold)
+        .setDivisionCost(parameters.divisionCost)
+        .setSimdLevel(options.simdLevel)
+        .setThreads(options.threads)
+        .setDivisionMode(options.divisionMode)
+        .setSeed(*options.seed);
+    CellularAutomata3D sim = std::move(builder).build();
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t epoch = 0; epoch < options.epochs; ++epoch)
+        sim.step();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    print_volume_summary(sim, elapsed.count());
+    return 0;
+}
+
+int run_decomposed(RunOptions& options)
+{
+    SimulationBuilder builder = scenario_builder(options);
+    configure_builder(builder, options);
+
+    DomainOptions domain;
+    domain.processes = options.processes;
+    domain.transport = options.transport;
+    DomainResult result = runDecomposed(builder, options.epochs, domain);
+
+    print_decomposed_summary(result, options);
+    return 0;
+}
+
+// Any policies but the defaults, compute only
+template <typename Neighborhood, typename Boundary, typename DivisionRule>
+int run_model(RunOptions& options)
+{
+    SimulationBuilder builder = scenario_builder(options);
+    configure_builder(builder, options);
+    auto sim = std::move(builder).build<Neighborhood, Boundary, DivisionRule>();
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t epoch = 0; epoch < options.epochs; ++epoch)
+        sim.step();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    print_summary(sim, elapsed.count());
+    return 0;
+}
 
-    for (int j = GRID_SIZE / 4; j < 3 * GRID_SIZE / 4; ++j)
-        cells[2][j] = CellState::Alive;
+template <typename Neighborhood, typename Boundary>
+int run_model(RunOptions& options)
+{
+    if (options.divisionRule == "richest")
+        return run_model<Neighborhood, Boundary, RichestNeighbor>(options);
+    return run_model<Neighborhood, Boundary, RandomNeighbor>(options);
 }
 
-void sim_ring(auto& cells, auto& nutrients)
+template <typename Neighborhood>
+int run_model(RunOptions& options)
 {
-    cells = make_empty_cell_grid();
-    nutrients = make_uniform_nutrient_grid(0.6f);
+    if (options.boundary == "no-flux")
+        return run_model<Neighborhood, NoFlux>(options);
+    if (options.boundary == "periodic")
+        return run_model<Neighborhood, Periodic>(options);
+    return run_model<Neighborhood, DirichletSource>(options);
+}
+
+CellularAutomata restore_simulation(const RunOptions& options)
+{
+    Checkpoint checkpoint(*options.restorePath);
+    NutrientPrecision stored = NutrientPrecision(checkpoint.getHeader().nutrientPrecision);
+    if (options.nutrientPrecisionSet && options.nutrientPrecision != stored)
+        throw std::runtime_error(*options.restorePath + " was written with " + nutrientPrecisionName(stored) + " nutrients");
+    return checkpoint.restore(engine_options(options), options.seed);
+}
 
-    int cx = GRID_SIZE / 2, cy = GRID_SIZE / 2;
-    for (int i = 0; i < GRID_SIZE; ++i)
-        for (int j = 0; j < GRID_SIZE; ++j)
+int run(RunOptions& options)
+{
+    CellularAutomata sim = options.restorePath
+        ? restore_simulation(options)
+        : build_simulation(options);
+
+    std::unique_ptr<FrameExporter> exporter;
+    if (options.exportPrefix && options.exportEvery)
+    {
+        options.exportOptions.prefix = *options.exportPrefix;
+        exporter = std::make_unique<FrameExporter>(sim.getWidth(), sim.getHeight(), options.exportOptions);
+    }
+
+    std::unique_ptr<StatsWriter> stats;
+    if (options.statsPath)
+        stats = std::make_unique<StatsWriter>(*options.statsPath, options.statsFormat);
+
+    // Called after every step
+    auto after_step = [&]()
+    {
+        if (stats)
+            stats->write(sim.getStepStats());
+        if (exporter && sim.getEpoch() % options.exportEvery == 0)
+            exporter->submit(sim);
+        if (options.checkpointPath && options.checkpointEvery && sim.getEpoch() % options.checkpointEvery == 0)
+            Checkpoint::save(sim, *options.checkpointPath);
+    };
+
+    auto start = std::chrono::steady_clock::now();
+
+    if (options.headless)
+    {
+        for (uint64_t epoch = 0; epoch < options.epochs; ++epoch)
         {
-            float d = std::hypot(i - cx, j - cy);
-            if (d > 20 && d < 24)
-                cells[i][j] = CellState::Alive;
+            sim.step();
+            after_step();
         }
+    }
+#ifdef CELLULAR_AUTOMATA_VIEWER
+    else
+    {
+        // The window stays on this thread, the simulation runs on a worker
+        Renderer renderer(sim.getWidth(), sim.getHeight(), options.renderOptions);
+        renderer.run([&]()
+        {
+            for (uint64_t epoch = 0; options.epochs == 0 || epoch < options.epochs; ++epoch)
+            {
+                std::cout << "Epoch: " << epoch << "\n";
+                sim.step();
+                after_step();
+                if (options.renderEvery && sim.getEpoch() % options.renderEvery == 0 && !renderer.publish(sim))
+                    break;
+            }
+        });
+
+        RenderStats stats = renderer.getStats();
+        std::cout << "Rendered:    " << stats.frames << " frames (" << stats.skipped << " skipped)\n";
+    }
+#endif
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    print_summary(sim, elapsed.count());
+
+    if (exporter)
+    {
+        exporter->flush();
+        ExportStats stats = exporter->getStats();
+        std::cout << "Exported:    " << stats.written << " frames\n"
+                  << "Dropped:     " << stats.dropped << " frames\n"
+                  << "Delayed:     " << stats.delayed << " frames (" << stats.delaySeconds << " s waiting)\n";
+    }
+
+    if (options.checkpointPath)
+        Checkpoint::save(sim, *options.checkpointPath);
+    return 0;
 }
 
 int main(int argc, char** argv)
 {
     //TODO: To improve selections
-    if (argc < 2)
+    RunOptions options;
+    try
     {
-        std::cout << "Usage: ./build/cellular_automata <0-5>\n";
+        if (!parse_options(argc, argv, options))
+        {
+            print_usage();
+            return 1;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << "\n";
         return 1;
     }
 
-    int simId = std::stoi(argv[1]);
+    if (options.depth)
+    {
+        // Volumes only have the compute path so far
+        if (!options.headless || options.processes || options.restorePath || options.cellsImage || options.checkpointPath
+            || options.exportPrefix || options.statsPath || options.activeTolerance || options.consumptionRate
+            || options.nutrientSolver.solver != NutrientSolver::Explicit || options.renderEvery
+            || options.nutrientPrecision != NutrientPrecision::Float32)
+        {
+            std::cerr << "--depth runs headless, with float32 explicit nutrients, no consumption and none of the output,\n"
+                      << "image, restore or decomposition options\n";
+            return 1;
+        }
+        if (options.width < 16 || options.height < 16 || options.depth < 16)
+        {
+            std::cerr << "Volumes must be at least 16x16x16\n";
+            return 1;
+        }
+    }
+    else if (!options.cellsImage && (options.width < 64 || options.height < 64))
+    {
+        std::cerr << "Grid must be at least 64x64\n";
+        return 1;
+    }
 
-    std::array<std::array<CellState, GRID_SIZE>, GRID_SIZE> cells;
-    std::array<std::array<float, GRID_SIZE>, GRID_SIZE> nutrients;
+    if (options.headless && options.epochs == 0)
+    {
+        std::cerr << "Headless runs need a fixed --epochs count\n";
+        return 1;
+    }
+
+    // Nothing would show the frames, headless runs write them with --export
+    if (options.headless && options.renderEvery)
+    {
+        std::cerr << "--render-every needs the window, headless runs write frames with --export and --export-every\n";
+        return 1;
+    }
 
-    switch (simId)
+#ifndef CELLULAR_AUTOMATA_VIEWER
+    if (!options.headless)
     {
-        case 0: sim_sparse_noise(cells, nutrients); break;
-        case 1: sim_radial_tumor(cells, nutrients); break;
-        case 2: sim_competing_colonies(cells, nutrients); break;
-        case 3: sim_stripes(cells, nutrients); break;
-        case 4: sim_traveling_wave(cells, nutrients); break;
-        case 5: sim_ring(cells, nutrients); break;
-        default:
-            std::cerr << "Invalid simulation ID\n";
+        std::cerr << "Built without the MiniFB viewer, use --headless\n";
+        return 1;
+    }
+#endif
+
+    if (options.processes)
+    {
+        // The bands only meet through their halos, nothing else sees the whole grid
+        if (!options.headless || options.restorePath || options.checkpointPath || options.exportPrefix || options.statsPath)
+        {
+            std::cerr << "--processes runs headless, without --restore, --checkpoint, --export or --stats\n";
+            return 1;
+        }
+        if (options.divisionMode != DivisionMode::Deterministic
+            || options.nutrientSolver.solver != NutrientSolver::Explicit
+            || options.activeTolerance || options.nutrientPrecision != NutrientPrecision::Float32)
+        {
+            std::cerr << "--processes needs --division deterministic, float32 explicit nutrients and no --active-tolerance\n";
             return 1;
+        }
     }
 
-    CellularAutomata sim =
-        SimulationBuilder(cells, nutrients)
-            .setDiffusionSpeed(0.05f)
-            .setDeathThreshold(0.18f)
-            .setDivideThreshold(0.55f)
-            .setDivisionCost(0.18f)
-            .build();
+    const bool defaultModel = options.neighborhood == "von-neumann" && options.boundary == "source" && options.divisionRule == "random";
+    if (!defaultModel)
+    {
+        // The viewer, checkpoints, export and the bands only take the default model
+        if (!options.headless || options.depth || options.processes || options.restorePath
+            || options.checkpointPath || options.exportPrefix || options.statsPath)
+        {
+            std::cerr << "--neighborhood, --boundary and --division-rule run headless, without --depth, --processes,\n"
+                      << "--restore, --checkpoint, --export or --stats\n";
+            return 1;
+        }
+    }
 
-    for (uint64_t epoch = 0;; ++epoch)
+    try
     {
-        std::cout << "Epoch: " << epoch << "\n";
-        sim.step();
+        if (options.depth)
+            return run_volume(options);
+        if (options.processes)
+            return run_decomposed(options);
+        if (!defaultModel)
+            return options.neighborhood == "moore" ? run_model<Moore>(options) : run_model<VonNeumann>(options);
+        return run(options);
     }
-}
\ No newline at end of file
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+}
@@ -0,0 +1,317 @@
+#include <nutrient_solver.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+NutrientSolver parseNutrientSolver(const std::string& name)
+{
+    if (name == "explicit")
+        return NutrientSolver::Explicit;
+    if (name == "implicit")
+        return NutrientSolver::Implicit;
+    if (name == "steady")
+        return NutrientSolver::SteadyState;
+    throw std::invalid_argument("Unknown nutrient solver: " + name);
+}
+
+const char* nutrientSolverName(NutrientSolver solver)
+{
+    switch (solver)
+    {
+        case NutrientSolver::Explicit:    return "explicit";
+        case NutrientSolver::Implicit:    return "implicit";
+        case NutrientSolver::SteadyState: return "steady";
+    }
+    return "unknown";
+}
+
+// Coarsening stops once a side is this short
+static constexpr size_t COARSEST_SIZE = 5;
+static constexpr size_t PRE_SWEEPS = 2;
+static constexpr size_t POST_SWEEPS = 2;
+static constexpr size_t COARSEST_SWEEPS = 64;
+// Inner rows per parallel task
+static constexpr size_t ROWS_PER_TASK = 32;
+
+// Couplings of the inner points of a line with the given point positions
+static void couplings(const std::vector<float>& position, std::vector<float>& before, std::vector<float>& after)
+{
+    before.assign(position.size(), 0.0f);
+    after.assign(position.size(), 0.0f);
+    for (size_t k = 1; k + 1 < position.size(); k++)
+    {
+        float h0 = position[k] - position[k - 1];
+        float h1 = position[k + 1] - position[k];
+        before[k] = 2.0f / (h0 * (h0 + h1));
+        after[k] = 2.0f / (h1 * (h0 + h1));
+    }
+}
+
+static std::vector<float> coarsen(const std::vector<float>& position)
+{
+    std::vector<float> coarse(position.size() / 2 + 1);
+    for (size_t k = 0; k < coarse.size(); k++)
+        coarse[k] = position[std::min(2 * k, position.size() - 1)];
+    return coarse;
+}
+
+MultigridSolver::MultigridSolver(size_t width, size_t height)
+    : iterate(width, height)
+{
+    // Coarse point I sits on fine point min(2I, size - 1), so both borders
+    // map onto borders whatever the size; with an even size the last coarse
+    // interval is shorter than the others
+    std::vector<float> x(width), y(height);
+    for (size_t j = 0; j < width; j++)
+        x[j] = float(j);
+    for (size_t i = 0; i < height; i++)
+        y[i] = float(i);
+
+    for (;;)
+    {
+        Level level{ x.size(), y.size(), {}, {}, {}, {}, {}, Grid<float>(x.size(), y.size()), Grid<float>(x.size(), y.size()), nullptr, {} };
+        couplings(x, level.west, level.east);
+        couplings(y, level.north, level.south);
+        if (!levels.empty())
+            level.u = Grid<float>(x.size(), y.size());
+        levels.push_back(std::move(level));
+
+        if (std::min(x.size(), y.size()) <= COARSEST_SIZE)
+            break;
+        x = coarsen(x);
+        y = coarsen(y);
+    }
+}
+
+void MultigridSolver::forRows(const Level& level, const std::function<void(size_t, size_t, size_t)>& rows)
+{
+    const size_t inner = level.height - 2;
+    const size_t chunks = (inner + ROWS_PER_TASK - 1) / ROWS_PER_TASK;
+    pool->parallelFor(chunks, [&](size_t chunk, size_t)
+    {
+        size_t begin = 1 + chunk * ROWS_PER_TASK;
+        rows(begin, std::min(begin + ROWS_PER_TASK, level.height - 1), chunk);
+    });
+}
+
+// Diffusive flux into a point. Written on differences, which are exact for
+// nearby floats, rather than as diagonal * u - neighbours: near the steady
+// state the latter cancels down to rounding noise, which the poorly
+// conditioned coarse levels then amplify.
+static inline float stencil(
+    float north, float south, float west, float east,
+    float up, float down, float left, float right, float center
+)
+{
+    return north * (up - center) + south * (down - center) + west * (left - center) + east * (right - center);
+}
+
+void MultigridSolver::smooth(Level& level, Grid<float>& u, size_t sweeps)
+{
+    for (size_t sweep = 0; sweep < sweeps; sweep++)
+    {
+        // Each colour only reads the other one, so rows are independent
+        for (size_t color = 0; color < 2; color++)
+        {
+            forRows(level, [&](size_t rowBegin, size_t rowEnd, size_t)
+            {
+                for (size_t i = rowBegin; i < rowEnd; i++)
+                {
+                    float* row = u[i];
+                    const float* up = u[i - 1];
+                    const float* down = u[i + 1];
+                    const float* f = level.f[i];
+                    const float* uptake = level.uptake ? (*level.uptake)[i] : nullptr;
+                    const float north = alpha * level.north[i];
+                    const float south = alpha * level.south[i];
+
+                    for (size_t j = 1 + ((i + 1 + color) & 1); j < level.width - 1; j += 2)
+                    {
+                        float west = alpha * level.west[j];
+                        float east = alpha * level.east[j];
+                        float sink = shift + (uptake ? uptake[j] : 0.0f);
+                        float u0 = row[j];
+                        float r = f[j] - sink * u0 + stencil(north, south, west, east, up[j], down[j], row[j - 1], row[j + 1], u0);
+                        row[j] = u0 + r / (sink + north + south + west + east);
+                    }
+                }
+            });
+        }
+    }
+}
+
+float MultigridSolver::residual(Level& level, const Grid<float>& u)
+{
+    std::vector<float> largest((level.height - 2 + ROWS_PER_TASK - 1) / ROWS_PER_TASK, 0.0f);
+
+    forRows(level, [&](size_t rowBegin, size_t rowEnd, size_t chunk)
+    {
+        float chunkLargest = 0.0f;
+        for (size_t i = rowBegin; i < rowEnd; i++)
+        {
+            const float* row = u[i];
+            const float* up = u[i - 1];
+            const float* down = u[i + 1];
+            const float* f = level.f[i];
+            const float* uptake = level.uptake ? (*level.uptake)[i] : nullptr;
+            const float north = alpha * level.north[i];
+            const float south = alpha * level.south[i];
+            float* r = level.r[i];
+
+            for (size_t j = 1; j < level.width - 1; j++)
+            {
+                float west = alpha * level.west[j];
+                float east = alpha * level.east[j];
+                float sink = shift + (uptake ? uptake[j] : 0.0f);
+                r[j] = f[j] - sink * row[j] + stencil(north, south, west, east, up[j], down[j], row[j - 1], row[j + 1], row[j]);
+                chunkLargest = std::max(chunkLargest, std::fabs(r[j]) / (sink + north + south + west + east));
+            }
+        }
+        largest[chunk] = chunkLargest;
+    });
+
+    return *std::max_element(largest.begin(), largest.end());
+}
+
+// Full weighting onto the inner coarse points; coarse borders stay 0
+static void fullWeighting(const Grid<float>& fine, Grid<float>& coarse)
+{
+    for (size_t I = 1; I + 1 < coarse.getHeight(); I++)
+    {
+        const float* up = fine[2 * I - 1];
+        const float* row = fine[2 * I];
+        const float* down = fine[2 * I + 1];
+        float* out = coarse[I];
+
+        for (size_t J = 1; J + 1 < coarse.getWidth(); J++)
+        {
+            size_t j = 2 * J;
+            out[J] = (4.0f * row[j]
+                + 2.0f * (up[j] + down[j] + row[j - 1] + row[j + 1])
+                + (up[j - 1] + up[j + 1] + down[j - 1] + down[j + 1])) / 16.0f;
+        }
+    }
+}
+
+void MultigridSolver::restrictResidual(const Level& fine, Level& coarse)
+{
+    fullWeighting(fine.r, coarse.f);
+}
+
+void MultigridSolver::prolongate(const Level& coarse, Level& fine, Grid<float>& u)
+{
+    // Bilinear: fine point i lies between coarse points i / 2 and (i + 1) / 2,
+    // which coincide for even i
+    forRows(fine, [&](size_t rowBegin, size_t rowEnd, size_t)
+    {
+        for (size_t i = rowBegin; i < rowEnd; i++)
+        {
+            const float* e0 = coarse.u[i / 2];
+            const float* e1 = coarse.u[(i + 1) / 2];
+            float* row = u[i];
+
+            for (size_t j = 1; j < fine.width - 1; j++)
+            {
+                size_t J0 = j / 2, J1 = (j + 1) / 2;
+                row[j] += 0.25f * ((e0[J0] + e0[J1]) + (e1[J0] + e1[J1]));
+            }
+        }
+    });
+}
+
+void MultigridSolver::cycle(size_t depth, Grid<float>& u)
+{
+    Level& level = levels[depth];
+    if (depth + 1 == levels.size())
+    {
+        smooth(level, u, COARSEST_SWEEPS);
+        return;
+    }
+
+    smooth(level, u, PRE_SWEEPS);
+    residual(level, u);
+
+    Level& coarse = levels[depth + 1];
+    restrictResidual(level, coarse);
+    coarse.u.fill(0.0f);
+    cycle(depth + 1, coarse.u);
+
+    prolongate(coarse, level, u);
+    smooth(level, u, POST_SWEEPS);
+}
+
+size_t MultigridSolver::solve(
+    Grid<float>& u,
+    const Grid<float>& previous,
+    const Grid<float>* uptake,
+    float diffusionSpeed,
+    const NutrientSolverOptions& options,
+    ThreadPool& pool,
+    float& change
+)
+{
+    this->pool = &pool;
+    shift = options.solver == NutrientSolver::Implicit ? 1.0f / options.timeStep : 0.0f;
+
+    alpha = diffusionSpeed / 4.0f;
+
+    levels[0].uptake = uptake;
+    for (size_t l = 1; l < levels.size(); l++)
+    {
+        if (uptake)
+        {
+            if (levels[l].coarseUptake.empty())
+                levels[l].coarseUptake = Grid<float>(levels[l].width, levels[l].height);
+            fullWeighting(*levels[l - 1].uptake, levels[l].coarseUptake);
+            levels[l].uptake = &levels[l].coarseUptake;
+        }
+        else
+            levels[l].uptake = nullptr;
+    }
+
+    // Right-hand side: the field at the start of the step
+    Level& finest = levels[0];
+    forRows(finest, [&](size_t rowBegin, size_t rowEnd, size_t)
+    {
+        for (size_t i = rowBegin; i < rowEnd; i++)
+            for (size_t j = 1; j < finest.width - 1; j++)
+                finest.f[i][j] = shift * previous[i][j];
+    });
+
+    // Nothing to do if a Jacobi sweep would barely move the field (e.g. the
+    // cells did not change since the last solve). Otherwise the residual says
+    // little about the error on large grids, so cycle until one V-cycle
+    // changes the field by less than the tolerance.
+    size_t cycles = 0;
+    change = residual(finest, u);
+    if (change <= options.tolerance)
+        return 0;
+
+    const size_t chunks = (finest.height - 2 + ROWS_PER_TASK - 1) / ROWS_PER_TASK;
+    std::vector<float> largest(chunks);
+    while (cycles < options.maxCycles)
+    {
+        forRows(finest, [&](size_t rowBegin, size_t rowEnd, size_t)
+        {
+            for (size_t i = rowBegin; i < rowEnd; i++)
+                std::copy(u[i], u[i] + finest.width, iterate[i]);
+        });
+
+        cycle(0, u);
+        cycles++;
+
+        forRows(finest, [&](size_t rowBegin, size_t rowEnd, size_t chunk)
+        {
+            float chunkChange = 0.0f;
+            for (size_t i = rowBegin; i < rowEnd; i++)
+                for (size_t j = 1; j < finest.width - 1; j++)
+                    chunkChange = std::max(chunkChange, std::fabs(u[i][j] - iterate[i][j]));
+            largest[chunk] = chunkChange;
+        });
+        change = *std::max_element(largest.begin(), largest.end());
+        if (change <= options.tolerance)
+            break;
+    }
+    return cycles;
+}
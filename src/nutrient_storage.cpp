@@ -0,0 +1,126 @@
+#include <nutrient_storage.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef CA_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+NutrientPrecision parseNutrientPrecision(const std::string& name)
+{
+    if (name == "float32")
+        return NutrientPrecision::Float32;
+    if (name == "fixed16")
+        return NutrientPrecision::Fixed16;
+    throw std::invalid_argument("Unknown nutrient precision: " + name);
+}
+
+const char* nutrientPrecisionName(NutrientPrecision precision)
+{
+    switch (precision)
+    {
+        case NutrientPrecision::Float32: return "float32";
+        case NutrientPrecision::Fixed16: return "fixed16";
+    }
+    return "unknown";
+}
+
+static void packScalar(const float* values, uint16_t* packed, size_t count)
+{
+    for (size_t j = 0; j < count; j++)
+        packed[j] = packNutrient(values[j]);
+}
+
+static void unpackScalar(const uint16_t* packed, float* values, size_t count)
+{
+    for (size_t j = 0; j < count; j++)
+        values[j] = unpackNutrient(packed[j]);
+}
+
+#ifdef CA_X86_KERNELS
+
+// Same clamps as packNutrient(): max returns its second operand on NaN
+CA_TARGET("avx2")
+static void packAvx2(const float* values, uint16_t* packed, size_t count)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 scale = _mm256_set1_ps(FIXED16_ONE);
+    const __m256 half = _mm256_set1_ps(0.5f);
+
+    size_t j = 0;
+    for (; j + 16 <= count; j += 16)
+    {
+        __m256 low = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(values + j), zero), one);
+        __m256 high = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(values + j + 8), zero), one);
+        __m256i lowFixed = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(low, scale), half));
+        __m256i highFixed = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(high, scale), half));
+        // packus interleaves 128-bit lanes, the permute puts them back in order
+        __m256i fixed = _mm256_permute4x64_epi64(_mm256_packus_epi32(lowFixed, highFixed), 0xd8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(packed + j), fixed);
+    }
+    packScalar(values + j, packed + j, count - j);
+}
+
+CA_TARGET("avx2")
+static void unpackAvx2(const uint16_t* packed, float* values, size_t count)
+{
+    const __m256 scale = _mm256_set1_ps(1.0f / FIXED16_ONE);
+
+    size_t j = 0;
+    for (; j + 8 <= count; j += 8)
+    {
+        __m256i fixed = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(packed + j)));
+        _mm256_storeu_ps(values + j, _mm256_mul_ps(_mm256_cvtepi32_ps(fixed), scale));
+    }
+    unpackScalar(packed + j, values + j, count - j);
+}
+
+#endif
+
+NutrientPackKernel nutrientPackKernel(SimdLevel level)
+{
+    switch (level)
+    {
+#ifdef CA_X86_KERNELS
+        // Conversions keep up with memory at 8 lanes, and every AVX-512
+        // CPU has AVX2
+        case SimdLevel::AVX512:
+        case SimdLevel::AVX2:   return packAvx2;
+#endif
+        default:                return packScalar;
+    }
+}
+
+NutrientUnpackKernel nutrientUnpackKernel(SimdLevel level)
+{
+    switch (level)
+    {
+#ifdef CA_X86_KERNELS
+        case SimdLevel::AVX512:
+        case SimdLevel::AVX2:   return unpackAvx2;
+#endif
+        default:                return unpackScalar;
+    }
+}
+
+NutrientSummary summarizePackedNutrients(const Grid<uint16_t>& grid, size_t rowBegin, size_t rowEnd, size_t colBegin, size_t colEnd)
+{
+    uint16_t low = grid[rowBegin][colBegin];
+    uint16_t high = low;
+    uint64_t sum = 0;
+
+    for (size_t i = rowBegin; i < rowEnd; i++)
+    {
+        const uint16_t* row = grid[i];
+        for (size_t j = colBegin; j < colEnd; j++)
+        {
+            low = std::min(low, row[j]);
+            high = std::max(high, row[j]);
+            sum += row[j];
+        }
+    }
+
+    return { unpackNutrient(low), unpackNutrient(high), double(sum) / FIXED16_ONE };
+}
@@ -0,0 +1,305 @@
+#include <cellular_automata.hpp>
+#include <scenarios.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Runs one scenario twice in lockstep, with float32 and with fixed16
+// nutrients, and reports how far the fixed16 run drifts: the cell counts,
+// the necrotic-core radius and the largest nutrient difference. With
+// --max-count-error or --max-radius-error it exits with code 2 when the
+// drift exceeds them, so a scenario can be checked before it is run at
+// fixed16.
+
+struct PrecisionOptions
+{
+    int scenario = 1;
+    size_t size = 512;
+    uint64_t epochs = 1000;
+    uint64_t reportEvery = 100;
+    uint64_t seed = 1;
+    SimdLevel simdLevel = detectSimdLevel();
+    size_t threads = 1;
+    DivisionMode divisionMode = DivisionMode::Deterministic;
+    float consumptionRate = ScenarioParameters().consumptionRate;
+    std::optional<double> maxCountError;
+    std::optional<double> maxRadiusError;
+    std::optional<std::string> csvPath;
+};
+
+// Fixed16 against float32 at one epoch
+struct Divergence
+{
+    uint64_t epoch = 0;
+    CellCounts reference;       // float32
+    CellCounts packed;          // fixed16
+    double referenceRadius = 0.0;
+    double packedRadius = 0.0;
+    double countError = 0.0;    // largest relative error of the three counts
+    double radiusError = 0.0;   // relative
+    float nutrientError = 0.0f; // largest absolute difference
+};
+
+void print_usage()
+{
+    std::cout << "Usage: ./build/cellular_automata_precision [0-5] [options]\n"
+              << "  --size N            grid edge (default 512)\n"
+              << "  --epochs N          epochs to run (default 1000)\n"
+              << "  --report-every N    compare the runs every N epochs (default 100)\n"
+              << "  --seed N            scenario and simulation seed (default 1)\n"
+              << "  --simd LEVEL        scalar, avx2 or avx512 (default: best supported)\n"
+              << "  --threads N         worker threads, 0 = all hardware threads (default 1)\n"
+              << "  --division MODE     sequential or deterministic (default deterministic)\n"
+              << "  --consumption X     nutrient each living cell draws per epoch (default 0)\n"
+              << "  --max-count-error X   largest relative Alive, Quiescent or Necrotic count\n"
+              << "                      difference accepted, exit code 2 beyond it\n"
+              << "  --max-radius-error X  same for the necrotic-core radius\n"
+              << "  --csv PATH          write every comparison as CSV\n";
+}
+
+bool parse_options(int argc, char** argv, PrecisionOptions& options)
+{
+    bool scenarioSet = false;
+    for (int a = 1; a < argc; ++a)
+    {
+        std::string arg = argv[a];
+
+        if (arg == "--size" && a + 1 < argc)
+            options.size = std::stoul(argv[++a]);
+        else if (arg == "--epochs" && a + 1 < argc)
+            options.epochs = std::stoull(argv[++a]);
+        else if (arg == "--report-every" && a + 1 < argc)
+            options.reportEvery = std::stoull(argv[++a]);
+        else if (arg == "--seed" && a + 1 < argc)
+            options.seed = std::stoull(argv[++a]);
+        else if (arg == "--simd" && a + 1 < argc)
+            options.simdLevel = parseSimdLevel(argv[++a]);
+        else if (arg == "--threads" && a + 1 < argc)
+            options.threads = std::stoul(argv[++a]);
+        else if (arg == "--division" && a + 1 < argc)
+        {
+            std::string mode = argv[++a];
+            if (mode == "sequential")
+                options.divisionMode = DivisionMode::Sequential;
+            else if (mode == "deterministic")
+                options.divisionMode = DivisionMode::Deterministic;
+            else
+                return false;
+        }
+        else if (arg == "--consumption" && a + 1 < argc)
+            options.consumptionRate = std::stof(argv[++a]);
+        else if (arg == "--max-count-error" && a + 1 < argc)
+            options.maxCountError = std::stod(argv[++a]);
+        else if (arg == "--max-radius-error" && a + 1 < argc)
+            options.maxRadiusError = std::stod(argv[++a]);
+        else if (arg == "--csv" && a + 1 < argc)
+            options.csvPath = argv[++a];
+        else if (arg.rfind("--", 0) == 0 || scenarioSet)
+            return false;
+        else
+        {
+            options.scenario = std::stoi(arg);
+            scenarioSet = true;
+        }
+    }
+    return options.scenario >= 0 && options.scenario < SCENARIO_COUNT
+        && options.size >= 64 && options.epochs > 0 && options.reportEvery > 0;
+}
+
+// Radius of a disk with the same spread as the Necrotic cells: the RMS
+// distance from their centroid is r / sqrt(2) for a filled disk. 0 without
+// Necrotic cells.
+double necrotic_radius(const Grid<CellState>& cells)
+{
+    double count = 0.0, sumI = 0.0, sumJ = 0.0, sumSquares = 0.0;
+    for (size_t i = 0; i < cells.getHeight(); ++i)
+    {
+        for (size_t j = 0; j < cells.getWidth(); ++j)
+        {
+            if (cells[i][j] != CellState::Necrotic)
+                continue;
+            count += 1.0;
+            sumI += double(i);
+            sumJ += double(j);
+            sumSquares += double(i) * double(i) + double(j) * double(j);
+        }
+    }
+    if (count == 0.0)
+        return 0.0;
+
+    double meanI = sumI / count, meanJ = sumJ / count;
+    double variance = sumSquares / count - meanI * meanI - meanJ * meanJ;
+    return std::sqrt(2.0 * std::max(variance, 0.0));
+}
+
+// |packed - reference| relative to the reference, counted from 1 so that
+// states the reference has not reached yet do not divide by zero
+double relative_error(double reference, double packed)
+{
+    return std::fabs(packed - reference) / std::max(reference, 1.0);
+}
+
+Divergence compare(const CellularAutomata& reference, const CellularAutomata& packed)
+{
+    Divergence divergence;
+    divergence.epoch = reference.getEpoch();
+    divergence.reference = reference.countCells();
+    divergence.packed = packed.countCells();
+    divergence.referenceRadius = necrotic_radius(reference.getCellGrid());
+    divergence.packedRadius = necrotic_radius(packed.getCellGrid());
+
+    divergence.countError = std::max({
+        relative_error(double(divergence.reference.alive), double(divergence.packed.alive)),
+        relative_error(double(divergence.reference.quiescent), double(divergence.packed.quiescent)),
+        relative_error(double(divergence.reference.necrotic), double(divergence.packed.necrotic)),
+    });
+    divergence.radiusError = relative_error(divergence.referenceRadius, divergence.packedRadius);
+
+    const Grid<float>& nutrientsA = reference.getNutrientGrid();
+    const Grid<float>& nutrientsB = packed.getNutrientGrid();
+    for (size_t i = 0; i < reference.getHeight(); ++i)
+        for (size_t j = 0; j < reference.getWidth(); ++j)
+            divergence.nutrientError = std::max(divergence.nutrientError, std::fabs(nutrientsA[i][j] - nutrientsB[i][j]));
+    return divergence;
+}
+
+void print_divergence(const Divergence& d)
+{
+    std::cout << std::setw(7) << d.epoch
+              << std::setw(10) << d.reference.alive << std::setw(10) << d.packed.alive
+              << std::setw(10) << d.reference.quiescent << std::setw(10) << d.packed.quiescent
+              << std::setw(10) << d.reference.necrotic << std::setw(10) << d.packed.necrotic
+              << std::fixed << std::setprecision(2)
+              << std::setw(9) << d.referenceRadius << std::setw(9) << d.packedRadius
+              << std::setprecision(3)
+              << std::setw(9) << 100.0 * d.countError << "%" << std::setw(8) << 100.0 * d.radiusError << "%"
+              << std::defaultfloat << std::setprecision(3)
+              << std::setw(11) << d.nutrientError << "\n";
+}
+
+void write_csv(const std::string& path, const std::vector<Divergence>& divergences)
+{
+    std::ofstream out(path, std::ios::trunc);
+    if (!out)
+        throw std::runtime_error("Unable to write " + path);
+
+    out << std::setprecision(9);
+    out << "epoch,alive_float32,alive_fixed16,quiescent_float32,quiescent_fixed16,necrotic_float32,necrotic_fixed16,"
+           "radius_float32,radius_fixed16,count_error,radius_error,max_nutrient_difference\n";
+    for (const Divergence& d : divergences)
+    {
+        out << d.epoch << ','
+            << d.reference.alive << ',' << d.packed.alive << ','
+            << d.reference.quiescent << ',' << d.packed.quiescent << ','
+            << d.reference.necrotic << ',' << d.packed.necrotic << ','
+            << d.referenceRadius << ',' << d.packedRadius << ','
+            << d.countError << ',' << d.radiusError << ',' << d.nutrientError << '\n';
+    }
+
+    if (!out.flush())
+        throw std::runtime_error("Unable to write " + path);
+}
+
+int main(int argc, char** argv)
+{
+    PrecisionOptions options;
+    try
+    {
+        if (!parse_options(argc, argv, options))
+        {
+            print_usage();
+            return 1;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    try
+    {
+        // One initial state, copied into both runs
+        Grid<CellState> cells(options.size, options.size);
+        Grid<float> nutrients(options.size, options.size);
+        generate_scenario(options.scenario, cells, nutrients, options.seed, options.threads);
+
+        ScenarioParameters parameters;
+        SimulationBuilder builder(cells, nutrients);
+        builder
+            .setDiffusionSpeed(parameters.diffusionSpeed)
+            .setDeathThreshold(parameters.deathThreshold)
+            .setDivideThreshold(parameters.divideThreshold)
+            .setDivisionCost(parameters.divisionCost)
+            .setConsumptionRate(options.consumptionRate)
+            .setSimdLevel(options.simdLevel)
+            .setThreads(options.threads)
+            .setDivisionMode(options.divisionMode)
+            .setSeed(options.seed);
+        CellularAutomata reference = builder.setNutrientPrecision(NutrientPrecision::Float32).build();
+        CellularAutomata packed = builder.setNutrientPrecision(NutrientPrecision::Fixed16).build();
+
+        std::cout << "Scenario:    " << scenario_name(options.scenario) << "\n"
+                  << "Grid:        " << options.size << "x" << options.size << "\n"
+                  << "Seed:        " << options.seed << "\n"
+                  << "Division:    " << (options.divisionMode == DivisionMode::Sequential ? "sequential" : "deterministic") << "\n"
+                  << "Consumption: " << options.consumptionRate << "\n\n"
+                  << "Pairs are float32, fixed16; errors are fixed16 against float32\n"
+                  << std::setw(7) << "epoch" << std::setw(20) << "alive" << std::setw(20) << "quiescent"
+                  << std::setw(20) << "necrotic" << std::setw(18) << "core radius"
+                  << std::setw(10) << "count" << std::setw(9) << "radius" << std::setw(11) << "max |dN|" << "\n";
+
+        std::vector<Divergence> divergences;
+        Divergence worst;
+        for (uint64_t epoch = 1; epoch <= options.epochs; ++epoch)
+        {
+            reference.step();
+            packed.step();
+            if (epoch % options.reportEvery != 0 && epoch != options.epochs)
+                continue;
+
+            Divergence divergence = compare(reference, packed);
+            print_divergence(divergence);
+            worst.countError = std::max(worst.countError, divergence.countError);
+            worst.radiusError = std::max(worst.radiusError, divergence.radiusError);
+            worst.nutrientError = std::max(worst.nutrientError, divergence.nutrientError);
+            divergences.push_back(divergence);
+        }
+
+        if (options.csvPath)
+            write_csv(*options.csvPath, divergences);
+
+        std::cout << "\nLargest count error:     " << 100.0 * worst.countError << "%\n"
+                  << "Largest radius error:    " << 100.0 * worst.radiusError << "%\n"
+                  << "Largest nutrient error:  " << worst.nutrientError << "\n";
+
+        // Accuracy guard
+        bool accepted = true;
+        if (options.maxCountError && worst.countError > *options.maxCountError)
+        {
+            std::cout << "Count error above " << 100.0 * *options.maxCountError << "%\n";
+            accepted = false;
+        }
+        if (options.maxRadiusError && worst.radiusError > *options.maxRadiusError)
+        {
+            std::cout << "Radius error above " << 100.0 * *options.maxRadiusError << "%\n";
+            accepted = false;
+        }
+        if (!accepted)
+            return 2;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
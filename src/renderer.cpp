@@ -0,0 +1,170 @@
+#include <renderer.hpp>
+
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+#include <MiniFB.h>
+
+// How often the window thread polls window events while no frame arrives
+static constexpr std::chrono::milliseconds EVENT_INTERVAL(16);
+
+static void onKeyboard(mfb_window* window, mfb_key key, mfb_key_mod, bool pressed)
+{
+    Renderer* renderer = static_cast<Renderer*>(mfb_get_user_data(window));
+    if (renderer && pressed && key == KB_KEY_N)
+        renderer->setNutrientOverlay(!renderer->hasNutrientOverlay());
+}
+
+Renderer::Renderer(size_t width, size_t height, const RenderOptions& options, const char* title)
+    : gridWidth(width),
+      gridHeight(height),
+      composer(width, height, options.maxWidth, options.maxHeight),
+      framebuffer(composer.getWidth() * composer.getHeight(), 0xff000000),
+      window(mfb_open_ex(title, unsigned(composer.getWidth()), unsigned(composer.getHeight()), WF_RESIZABLE)),
+      incoming{ Grid<CellState>(width, height), {}, false },
+      shown{ Grid<CellState>(width, height), {}, false },
+      overlay(options.nutrients)
+{
+    if (!window)
+        throw std::runtime_error("Unable to open the MiniFB window");
+    open = true;
+
+    mfb_set_user_data(window, this);
+    mfb_set_keyboard_callback(window, onKeyboard);
+}
+
+Renderer::~Renderer()
+{
+    if (window)
+        mfb_close(window);
+}
+
+void Renderer::run(const std::function<void()>& simulation)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = false;
+    }
+
+    std::exception_ptr failure;
+    std::thread worker([&]()
+    {
+        try
+        {
+            simulation();
+        }
+        catch (...)
+        {
+            failure = std::current_exception();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        changed.notify_all();
+    });
+
+    renderLoop();
+    worker.join();
+    if (failure)
+        std::rethrow_exception(failure);
+}
+
+void Renderer::renderLoop()
+{
+    while (window)
+    {
+        bool draw = false;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait_for(lock, EVENT_INTERVAL, [this] { return incomingReady || stopping; });
+            if (stopping)
+                break;
+            if (incomingReady)
+            {
+                // publish() may refill incoming while this one is drawn
+                std::swap(incoming, shown);
+                incomingReady = false;
+                incomingFree = true;
+                draw = true;
+            }
+        }
+
+        mfb_update_state state;
+        if (draw)
+        {
+            size_t rows = composer.compose(shown.cells, shown.withNutrients ? &shown.nutrients : nullptr, framebuffer.data());
+            state = mfb_update_ex(window, framebuffer.data(), unsigned(composer.getWidth()), unsigned(composer.getHeight()));
+
+            std::lock_guard<std::mutex> lock(mutex);
+            ++stats.frames;
+            stats.redrawnRows += rows;
+        }
+        else
+            state = mfb_update_events(window);
+
+        if (state < 0)
+        {
+            // The window closes itself on exit
+            window = nullptr;
+            std::lock_guard<std::mutex> lock(mutex);
+            open = false;
+        }
+    }
+}
+
+bool Renderer::publish(const CellularAutomata& sim)
+{
+    if (sim.getWidth() != gridWidth || sim.getHeight() != gridHeight)
+        throw std::invalid_argument("Simulation size does not match the renderer");
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!open)
+            return false;
+        if (!incomingFree)
+        {
+            ++stats.skipped;
+            return true;
+        }
+        incomingFree = false;
+    }
+
+    // The window thread leaves incoming alone until it is marked ready, and
+    // the grids keep their storage, so these are plain copies
+    incoming.cells = sim.getCellGrid();
+    incoming.withNutrients = overlay;
+    if (incoming.withNutrients)
+        incoming.nutrients = sim.getNutrientGrid();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        incomingReady = true;
+    }
+    changed.notify_all();
+    return true;
+}
+
+bool Renderer::isOpen() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return open;
+}
+
+RenderStats Renderer::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void Renderer::setNutrientOverlay(bool enabled)
+{
+    overlay = enabled;
+}
+
+bool Renderer::hasNutrientOverlay() const
+{
+    return overlay;
+}
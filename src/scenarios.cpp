@@ -0,0 +1,437 @@
+#include <scenarios.hpp>
+
+#include <frame.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Rows per task of the parallel generators
+constexpr size_t SCENARIO_BAND_ROWS = 32;
+
+// Counter of the scenario draws, one no simulation step reaches, so the
+// initial state is independent of the division draws made with the same seed
+constexpr uint64_t SCENARIO_EPOCH = ~uint64_t(0);
+
+// Runs fill(rowBegin, rowEnd) over bands of rows on the pool
+static void forEachBand(ThreadPool& pool, size_t rows, const std::function<void(size_t, size_t)>& fill)
+{
+    const size_t bands = (rows + SCENARIO_BAND_ROWS - 1) / SCENARIO_BAND_ROWS;
+    pool.parallelFor(bands, [&](size_t band, size_t)
+    {
+        fill(band * SCENARIO_BAND_ROWS, std::min(rows, (band + 1) * SCENARIO_BAND_ROWS));
+    });
+}
+
+// Each cell draws from its own Philox counter, so rows can be filled in any order
+void sim_sparse_noise(Grid<CellState>& cells, Grid<float>& nutrients, uint64_t seed, ThreadPool& pool)
+{
+    const size_t width = cells.getWidth(), height = cells.getHeight();
+    const Philox4x32 rng(seed);
+    const uint32_t threshold = uint32_t(0.002 * 4294967296.0);
+
+    forEachBand(pool, height, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            std::fill_n(cells[i], width, CellState::Empty);
+            std::fill_n(nutrients[i], width, 0.8f);
+            if (i == 0 || i == height - 1)
+                continue;
+            // One draw covers cells 4 * group to 4 * group + 3
+            for (size_t group = 0; 4 * group < width - 1; ++group)
+            {
+                Philox4x32::Counter draw = rng(SCENARIO_EPOCH, uint32_t(i), uint32_t(group));
+                for (size_t j = std::max<size_t>(4 * group, 1); j < std::min(4 * group + 4, width - 1); ++j)
+                    if (draw[j % 4] < threshold)
+                        cells[i][j] = CellState::Alive;
+            }
+        }
+    });
+}
+
+void sim_radial_tumor(Grid<CellState>& cells, Grid<float>& nutrients, uint64_t, ThreadPool& pool)
+{
+    const size_t width = cells.getWidth(), height = cells.getHeight();
+
+    int cx = int(height / 2), cy = int(width / 2);
+    float radius = std::min(width, height) / 2.f;
+    forEachBand(pool, height, [&](size_t begin, size_t end)
+    {
+        for (int i = int(begin); i < int(end); ++i)
+        {
+            std::fill_n(cells[i], width, CellState::Empty);
+            for (int j = 0; j < int(width); ++j)
+            {
+                // Squared distances are exact integers, so no std::hypot
+                int squared = (i - cx)*(i - cx) + (j - cy)*(j - cy);
+                float d = float(std::sqrt(double(squared)));
+                nutrients[i][j] = std::clamp(1.f - d / radius, 0.f, 1.f);
+                if (squared < 36) cells[i][j] = CellState::Alive;
+            }
+        }
+    });
+}
+
+void sim_competing_colonies(Grid<CellState>& cells, Grid<float>& nutrients, uint64_t seed, ThreadPool& pool)
+{
+    const size_t width = cells.getWidth(), height = cells.getHeight();
+    forEachBand(pool, height, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            std::fill_n(cells[i], width, CellState::Empty);
+            std::fill_n(nutrients[i], width, 0.7f);
+        }
+    });
+
+    // Twelve small colonies, not worth spreading over the pool
+    std::seed_seq seedSequence{ uint32_t(seed), uint32_t(seed >> 32) };
+    std::mt19937 gen(seedSequence);
+
+    // Keep colonies clear of the border even on small grids: a centre in
+    // [5, size - 6] keeps the radius-4 disk off the outer ring
+    int marginI = std::min(20, int(height / 2) - 5), marginJ = std::min(20, int(width / 2) - 5);
+    std::uniform_int_distribution<int> posI(std::max(5, marginI), std::min(int(height) - 6, int(height) - marginI));
+    std::uniform_int_distribution<int> posJ(std::max(5, marginJ), std::min(int(width) - 6, int(width) - marginJ));
+
+    for (int c = 0; c < 12; ++c)
+    {
+        int cx = posI(gen), cy = posJ(gen);
+        for (int i = cx - 4; i <= cx + 4; ++i)
+            for (int j = cy - 4; j <= cy + 4; ++j)
+                if ((i - cx)*(i - cx) + (j - cy)*(j - cy) <= 16)
+                    cells[i][j] = CellState::Alive;
+    }
+}
+
+void sim_stripes(Grid<CellState>& cells, Grid<float>& nutrients, uint64_t, ThreadPool& pool)
+{
+    const size_t width = cells.getWidth(), height = cells.getHeight();
+    forEachBand(pool, height, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            std::fill_n(cells[i], width, CellState::Empty);
+            std::fill_n(nutrients[i], width, (i / 16) % 2 == 0 ? 0.9f : 0.15f);
+        }
+    });
+
+    for (size_t j = width / 3; j < 2 * width / 3; ++j)
+        cells[height / 2][j] = CellState::Alive;
+}
+
+void sim_traveling_wave(Grid<CellState>& cells, Grid<float>& nutrients, uint64_t, ThreadPool& pool)
+{
+    const size_t width = cells.getWidth(), height = cells.getHeight();
+    forEachBand(pool, height, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            float w = 0.5f * (1.f + std::sin(2.f * float(M_PI) * i / 40.f));
+            std::fill_n(cells[i], width, CellState::Empty);
+            std::fill_n(nutrients[i], width, 0.1f + w * 0.9f);
+        }
+    });
+
+    for (size_t j = width / 4; j < 3 * width / 4; ++j)
+        cells[2][j] = CellState::Alive;
+}
+
+void sim_ring(Grid<CellState>& cells, Grid<float>& nutrients, uint64_t, ThreadPool& pool)
+{
+    const size_t width = cells.getWidth(), height = cells.getHeight();
+
+    // 20 < distance < 24, on squared integer distances
+    int cx = int(height / 2), cy = int(width / 2);
+    forEachBand(pool, height, [&](size_t begin, size_t end)
+    {
+        for (int i = int(begin); i < int(end); ++i)
+        {
+            std::fill_n(cells[i], width, CellState::Empty);
+            std::fill_n(nutrients[i], width, 0.6f);
+            for (int j = 0; j < int(width); ++j)
+            {
+                int squared = (i - cx)*(i - cx) + (j - cy)*(j - cy);
+                if (squared > 400 && squared < 576)
+                    cells[i][j] = CellState::Alive;
+            }
+        }
+    });
+}
+
+const char* scenario_name(int id)
+{
+    switch (id)
+    {
+        case 0: return "sparse_noise";
+        case 1: return "radial_tumor";
+        case 2: return "competing_colonies";
+        case 3: return "stripes";
+        case 4: return "traveling_wave";
+        case 5: return "ring";
+    }
+    return "unknown";
+}
+
+void generate_scenario(int id, Grid<CellState>& cells, Grid<float>& nutrients, uint64_t seed, size_t threads)
+{
+    ThreadPool pool(threads);
+    generate_scenario(id, cells, nutrients, seed, pool);
+}
+
+void generate_scenario(int id, Grid<CellState>& cells, Grid<float>& nutrients, uint64_t seed, ThreadPool& pool)
+{
+    if (cells.getWidth() < SCENARIO_MIN_SIZE || cells.getHeight() < SCENARIO_MIN_SIZE)
+        throw std::invalid_argument("Scenarios need grids of at least " + std::to_string(SCENARIO_MIN_SIZE) + " cells a side");
+
+    switch (id)
+    {
+        case 0: sim_sparse_noise(cells, nutrients, seed, pool); break;
+        case 1: sim_radial_tumor(cells, nutrients, seed, pool); break;
+        case 2: sim_competing_colonies(cells, nutrients, seed, pool); break;
+        case 3: sim_stripes(cells, nutrients, seed, pool); break;
+        case 4: sim_traveling_wave(cells, nutrients, seed, pool); break;
+        case 5: sim_ring(cells, nutrients, seed, pool); break;
+        default:
+            throw std::invalid_argument("Invalid simulation ID");
+    }
+}
+
+// Runs fill(brick) over the bricks of a volume on the pool
+template <typename T>
+static void forEachBrick(ThreadPool& pool, const Grid3D<T>& grid, const std::function<void(const typename Grid3D<T>::Brick&)>& fill)
+{
+    pool.parallelFor(grid.getBrickCount(), [&](size_t index, size_t)
+    {
+        fill(grid.brick(index));
+    });
+}
+
+void sim_sparse_noise_3d(Grid3D<CellState>& cells, Grid3D<float>& nutrients, uint64_t seed, ThreadPool& pool)
+{
+    const size_t width = cells.getWidth(), height = cells.getHeight(), depth = cells.getDepth();
+    const Philox4x32 rng(seed);
+    const uint32_t threshold = uint32_t(0.0005 * 4294967296.0);
+
+    forEachBrick(pool, cells, [&](const Grid3D<CellState>::Brick& brick)
+    {
+        for (size_t z = brick.zBegin; z < brick.zEnd; ++z)
+            for (size_t y = brick.yBegin; y < brick.yEnd; ++y)
+            {
+                CellState* cellRow = cells.row(y, z);
+                std::fill_n(cellRow, width, CellState::Empty);
+                std::fill_n(nutrients.row(y, z), width, 0.8f);
+                if (z == 0 || z == depth - 1 || y == 0 || y == height - 1)
+                    continue;
+                for (size_t group = 0; 4 * group < width - 1; ++group)
+                {
+                    Philox4x32::Counter draw = rng(SCENARIO_EPOCH, uint32_t(group), uint32_t(y), uint32_t(z));
+                    for (size_t x = std::max<size_t>(4 * group, 1); x < std::min(4 * group + 4, width - 1); ++x)
+                        if (draw[x % 4] < threshold)
+                            cellRow[x] = CellState::Alive;
+                }
+            }
+    });
+}
+
+// 3D counterpart of sim_radial_tumor
+void sim_spheroid(Grid3D<CellState>& cells, Grid3D<float>& nutrients, uint64_t, ThreadPool& pool)
+{
+    const size_t width = cells.getWidth(), height = cells.getHeight(), depth = cells.getDepth();
+
+    int cx = int(width / 2), cy = int(height / 2), cz = int(depth / 2);
+    float radius = std::min({ width, height, depth }) / 2.f;
+    forEachBrick(pool, cells, [&](const Grid3D<CellState>::Brick& brick)
+    {
+        for (int z = int(brick.zBegin); z < int(brick.zEnd); ++z)
+            for (int y = int(brick.yBegin); y < int(brick.yEnd); ++y)
+            {
+                CellState* cellRow = cells.row(y, z);
+                float* nutrientRow = nutrients.row(y, z);
+                std::fill_n(cellRow, width, CellState::Empty);
+                for (int x = 0; x < int(width); ++x)
+                {
+                    float d = std::sqrt(float((x - cx)*(x - cx) + (y - cy)*(y - cy) + (z - cz)*(z - cz)));
+                    nutrientRow[x] = std::clamp(1.f - d / radius, 0.f, 1.f);
+                    if (d < 6) cellRow[x] = CellState::Alive;
+                }
+            }
+    });
+}
+
+// Binary PGM (P5) or PPM (P6) image, 8 or 16 bits per channel
+struct NetpbmImage
+{
+    size_t width = 0;
+    size_t height = 0;
+    size_t channels = 0;
+    uint32_t maxValue = 0;
+    std::vector<uint8_t> bytes;   // whole file
+    size_t offset = 0;            // of the first sample
+
+    // Sample c of pixel (i, j), in [0, maxValue]
+    uint32_t sample(size_t i, size_t j, size_t c) const
+    {
+        const size_t index = (i * width + j) * channels + c;
+        if (maxValue < 256)
+            return bytes[offset + index];
+        return uint32_t(bytes[offset + 2 * index]) << 8 | bytes[offset + 2 * index + 1];
+    }
+};
+
+static NetpbmImage readNetpbm(const std::string& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        throw std::runtime_error("Unable to open " + path);
+
+    NetpbmImage image;
+    image.bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    const std::vector<uint8_t>& bytes = image.bytes;
+
+    // Header: magic, width, height and maxval, separated by whitespace and comments
+    size_t at = 0;
+    auto token = [&]()
+    {
+        while (at < bytes.size() && (std::isspace(bytes[at]) || bytes[at] == '#'))
+        {
+            if (bytes[at] == '#')
+                while (at < bytes.size() && bytes[at] != '\n')
+                    at++;
+            else
+                at++;
+        }
+        std::string value;
+        while (at < bytes.size() && !std::isspace(bytes[at]) && bytes[at] != '#')
+            value += char(bytes[at++]);
+        return value;
+    };
+
+    const std::string magic = token();
+    if (magic != "P5" && magic != "P6")
+        throw std::runtime_error(path + " is not a binary PGM or PPM image");
+    image.channels = magic == "P6" ? 3 : 1;
+    try
+    {
+        image.width = std::stoul(token());
+        image.height = std::stoul(token());
+        image.maxValue = uint32_t(std::stoul(token()));
+    }
+    catch (const std::logic_error&)
+    {
+        throw std::runtime_error(path + " has a malformed header");
+    }
+    if (image.width == 0 || image.height == 0 || image.maxValue == 0 || image.maxValue > 65535)
+        throw std::runtime_error(path + " has a malformed header");
+
+    // A single whitespace byte separates the header from the samples
+    image.offset = at + 1;
+    const size_t sampleBytes = image.maxValue < 256 ? 1 : 2;
+    if (image.offset + image.width * image.height * image.channels * sampleBytes > bytes.size())
+        throw std::runtime_error(path + " is truncated");
+    return image;
+}
+
+// State drawn in c, for a pixel exactly in one of the cellColor() colours
+static std::optional<CellState> stateOfColor(uint32_t c)
+{
+    for (CellState state : { CellState::Empty, CellState::Alive, CellState::Quiescent, CellState::Necrotic })
+        if ((cellColor(state) & 0xffffff) == c)
+            return state;
+    return std::nullopt;
+}
+
+void load_scenario_images(
+    const std::string& cellPath,
+    const std::string& nutrientPath,
+    Grid<CellState>& cells,
+    Grid<float>& nutrients,
+    size_t threads
+)
+{
+    const NetpbmImage cellImage = readNetpbm(cellPath);
+    NetpbmImage nutrientImage;
+    if (!nutrientPath.empty())
+    {
+        nutrientImage = readNetpbm(nutrientPath);
+        if (nutrientImage.channels != 1)
+            throw std::runtime_error(nutrientPath + " must be a greyscale PGM image");
+        if (nutrientImage.width != cellImage.width || nutrientImage.height != cellImage.height)
+            throw std::runtime_error(nutrientPath + " does not have the size of " + cellPath);
+    }
+
+    const size_t width = cellImage.width, height = cellImage.height;
+    cells = Grid<CellState>(width, height);
+    nutrients = Grid<float>(width, height);
+
+    ThreadPool pool(threads);
+    forEachBand(pool, height, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            for (size_t j = 0; j < width; ++j)
+            {
+                // Exported cell frames map back to their states, any other
+                // pixel is a cell when brighter than mid grey
+                if (cellImage.maxValue == 255 && cellImage.channels == 3)
+                {
+                    uint32_t c = cellImage.sample(i, j, 0) << 16 | cellImage.sample(i, j, 1) << 8 | cellImage.sample(i, j, 2);
+                    if (std::optional<CellState> state = stateOfColor(c))
+                    {
+                        cells[i][j] = *state;
+                        continue;
+                    }
+                }
+                uint32_t brightness = 0;
+                for (size_t c = 0; c < cellImage.channels; ++c)
+                    brightness = std::max(brightness, cellImage.sample(i, j, c));
+                cells[i][j] = 2 * brightness > cellImage.maxValue ? CellState::Alive : CellState::Empty;
+            }
+
+            // The outer ring is the nutrient border, it never holds cells
+            if (i == 0 || i == height - 1)
+                std::fill_n(cells[i], width, CellState::Empty);
+            cells[i][0] = cells[i][width - 1] = CellState::Empty;
+
+            if (nutrientPath.empty())
+                std::fill_n(nutrients[i], width, MAX_NUTRIENT);
+            else
+                for (size_t j = 0; j < width; ++j)
+                    nutrients[i][j] = MAX_NUTRIENT * float(nutrientImage.sample(i, j, 0)) / float(nutrientImage.maxValue);
+        }
+    });
+}
+
+const char* volume_scenario_name(int id)
+{
+    switch (id)
+    {
+        case 0: return "sparse_noise_3d";
+        case 1: return "spheroid";
+    }
+    return "unknown";
+}
+
+void generate_volume_scenario(int id, Grid3D<CellState>& cells, Grid3D<float>& nutrients, uint64_t seed, size_t threads)
+{
+    if (cells.getWidth() < SCENARIO_MIN_SIZE || cells.getHeight() < SCENARIO_MIN_SIZE || cells.getDepth() < SCENARIO_MIN_SIZE)
+        throw std::invalid_argument("Scenarios need grids of at least " + std::to_string(SCENARIO_MIN_SIZE) + " cells a side");
+
+    ThreadPool pool(threads);
+    switch (id)
+    {
+        case 0: sim_sparse_noise_3d(cells, nutrients, seed, pool); break;
+        case 1: sim_spheroid(cells, nutrients, seed, pool); break;
+        default:
+            throw std::invalid_argument("Scenario " + std::to_string(id) + " has no volume version");
+    }
+}
@@ -0,0 +1,58 @@
+#include <simd.hpp>
+
+#include <stdexcept>
+
+#if defined(_MSC_VER) && defined(CA_X86_KERNELS)
+#include <intrin.h>
+#endif
+
+SimdLevel detectSimdLevel()
+{
+#if defined(CA_X86_KERNELS) && defined(__GNUC__)
+    __builtin_cpu_init();
+    // The cell kernels need byte-wide AVX-512 (BW) on top of the foundation
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+        return SimdLevel::AVX512;
+    if (__builtin_cpu_supports("avx2"))
+        return SimdLevel::AVX2;
+#elif defined(CA_X86_KERNELS) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return SimdLevel::Scalar;
+
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!osxsave)
+        return SimdLevel::Scalar;
+
+    unsigned long long xcr0 = _xgetbv(0);
+    __cpuidex(info, 7, 0);
+    bool ymm = (xcr0 & 0x6) == 0x6;
+    bool zmm = (xcr0 & 0xe6) == 0xe6;
+    if (zmm && (info[1] & (1 << 16)) && (info[1] & (1 << 30)))
+        return SimdLevel::AVX512;
+    if (ymm && (info[1] & (1 << 5)))
+        return SimdLevel::AVX2;
+#endif
+    return SimdLevel::Scalar;
+}
+
+const char* simdLevelName(SimdLevel level)
+{
+    switch (level)
+    {
+        case SimdLevel::Scalar: return "scalar";
+        case SimdLevel::AVX2:   return "avx2";
+        case SimdLevel::AVX512: return "avx512";
+    }
+    return "unknown";
+}
+
+SimdLevel parseSimdLevel(const std::string& name)
+{
+    if (name == "scalar") return SimdLevel::Scalar;
+    if (name == "avx2")   return SimdLevel::AVX2;
+    if (name == "avx512") return SimdLevel::AVX512;
+    throw std::invalid_argument("Unknown SIMD level: " + name);
+}
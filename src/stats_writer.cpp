@@ -0,0 +1,59 @@
+#include <stats_writer.hpp>
+
+#include <stdexcept>
+
+StatsFormat parseStatsFormat(const std::string& name)
+{
+    if (name == "csv")
+        return StatsFormat::CSV;
+    if (name == "jsonl")
+        return StatsFormat::JSONL;
+    throw std::invalid_argument("Unknown stats format: " + name);
+}
+
+StatsWriter::StatsWriter(const std::string& path, StatsFormat format)
+    : out(path, std::ios::trunc),
+      format(format)
+{
+    if (!out)
+        throw std::runtime_error("Unable to write statistics to " + path);
+
+    out.precision(9);
+    if (format == StatsFormat::CSV)
+        out << "epoch,diffuse_seconds,update_seconds,divide_seconds,alive,quiescent,necrotic,"
+               "divisions,blocked_divisions,nutrient_min,nutrient_mean,nutrient_max,solver_cycles,solver_change\n";
+}
+
+void StatsWriter::write(const StepStats& stats)
+{
+    switch (format)
+    {
+        case StatsFormat::CSV:
+            out << stats.epoch << ','
+                << stats.diffuseSeconds << ',' << stats.updateSeconds << ',' << stats.divideSeconds << ','
+                << stats.counts.alive << ',' << stats.counts.quiescent << ',' << stats.counts.necrotic << ','
+                << stats.divisions << ',' << stats.blockedDivisions << ','
+                << stats.nutrientMin << ',' << stats.nutrientMean << ',' << stats.nutrientMax << ','
+                << stats.solverCycles << ',' << stats.solverChange << '\n';
+            break;
+        case StatsFormat::JSONL:
+            out << "{\"epoch\": " << stats.epoch
+                << ", \"diffuse_seconds\": " << stats.diffuseSeconds
+                << ", \"update_seconds\": " << stats.updateSeconds
+                << ", \"divide_seconds\": " << stats.divideSeconds
+                << ", \"alive\": " << stats.counts.alive
+                << ", \"quiescent\": " << stats.counts.quiescent
+                << ", \"necrotic\": " << stats.counts.necrotic
+                << ", \"divisions\": " << stats.divisions
+                << ", \"blocked_divisions\": " << stats.blockedDivisions
+                << ", \"nutrient_min\": " << stats.nutrientMin
+                << ", \"nutrient_mean\": " << stats.nutrientMean
+                << ", \"nutrient_max\": " << stats.nutrientMax
+                << ", \"solver_cycles\": " << stats.solverCycles
+                << ", \"solver_change\": " << stats.solverChange << "}\n";
+            break;
+    }
+
+    if (!out)
+        throw std::runtime_error("Unable to write statistics");
+}
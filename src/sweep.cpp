@@ -0,0 +1,124 @@
+#include <ensemble.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Runs every combination of a sweep specification (see SweepSpec) as
+// independent simulations spread over all cores, and writes one CSV row per run.
+
+struct SweepOptions
+{
+    std::string specPath;
+    std::string outputPath = "sweep_results.csv";
+    size_t threads = 0;
+    SimdLevel simdLevel = detectSimdLevel();
+};
+
+void print_usage()
+{
+    std::cout << "Usage: ./build/cellular_automata_sweep SPEC [options]\n"
+              << "  --output PATH       results file (default sweep_results.csv)\n"
+              << "  --threads N         concurrent runs, 0 = all hardware threads (default 0)\n"
+              << "  --simd LEVEL        scalar, avx2 or avx512 (default: best supported)\n";
+}
+
+bool parse_options(int argc, char** argv, SweepOptions& options)
+{
+    for (int a = 1; a < argc; ++a)
+    {
+        std::string arg = argv[a];
+
+        if (arg == "--output" && a + 1 < argc)
+            options.outputPath = argv[++a];
+        else if (arg == "--threads" && a + 1 < argc)
+            options.threads = std::stoul(argv[++a]);
+        else if (arg == "--simd" && a + 1 < argc)
+            options.simdLevel = parseSimdLevel(argv[++a]);
+        else if (arg.rfind("--", 0) == 0 || !options.specPath.empty())
+            return false;
+        else
+            options.specPath = arg;
+    }
+    return !options.specPath.empty();
+}
+
+void write_results(const std::string& path, const std::vector<EnsembleJob>& jobs, const std::vector<EnsembleResult>& results)
+{
+    std::ofstream out(path, std::ios::trunc);
+    if (!out)
+        throw std::runtime_error("Unable to write " + path);
+
+    out << "run,scenario,width,height,division,diffusion_speed,death_threshold,divide_threshold,division_cost,"
+           "seed,epochs,alive,quiescent,necrotic,divisions,nutrient_mean,seconds\n";
+    for (size_t r = 0; r < jobs.size(); ++r)
+    {
+        const EnsembleJob& job = jobs[r];
+        const EnsembleResult& result = results[r];
+        out << r << ',' << scenario_name(job.scenario) << ',' << job.width << ',' << job.height << ','
+            << (job.divisionMode == DivisionMode::Sequential ? "sequential" : "deterministic") << ','
+            << job.parameters.diffusionSpeed << ',' << job.parameters.deathThreshold << ','
+            << job.parameters.divideThreshold << ',' << job.parameters.divisionCost << ','
+            << job.seed << ',' << job.epochs << ','
+            << result.counts.alive << ',' << result.counts.quiescent << ',' << result.counts.necrotic << ','
+            << result.divisions << ',' << result.nutrientMean << ',' << result.seconds << '\n';
+    }
+
+    if (!out.flush())
+        throw std::runtime_error("Unable to write " + path);
+}
+
+int main(int argc, char** argv)
+{
+    SweepOptions options;
+    try
+    {
+        if (!parse_options(argc, argv, options))
+        {
+            print_usage();
+            return 1;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    try
+    {
+        std::vector<EnsembleJob> jobs = SweepSpec::load(options.specPath).expand();
+        Ensemble ensemble(options.threads, options.simdLevel);
+
+        std::cout << "Runs:        " << jobs.size() << "\n"
+                  << "Threads:     " << ensemble.getThreadCount() << "\n";
+
+        // Progress roughly every 5%
+        size_t finished = 0;
+        const size_t reportEvery = std::max<size_t>(1, jobs.size() / 20);
+        auto start = std::chrono::steady_clock::now();
+
+        std::vector<EnsembleResult> results = ensemble.run(jobs, [&](size_t, const EnsembleResult&)
+        {
+            if (++finished % reportEvery == 0 || finished == jobs.size())
+                std::cout << "Finished " << finished << "/" << jobs.size() << "\n";
+        });
+
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        write_results(options.outputPath, jobs, results);
+
+        std::cout << "Wall time:   " << elapsed.count() << " s\n"
+                  << "Runs/s:      " << jobs.size() / elapsed.count() << "\n"
+                  << "Results:     " << options.outputPath << "\n";
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
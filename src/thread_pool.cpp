@@ -0,0 +1,157 @@
+#include <thread_pool.hpp>
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t threads)
+    : threadCount(threads ? threads : std::max(1u, std::thread::hardware_concurrency())),
+      queues(new WorkQueue[threadCount])
+{
+    workers.reserve(threadCount - 1);
+    for (size_t w = 1; w < threadCount; w++)
+        workers.emplace_back(&ThreadPool::workerLoop, this, w);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (auto& worker : workers)
+        worker.join();
+}
+
+size_t ThreadPool::getThreadCount() const
+{
+    return threadCount;
+}
+
+void ThreadPool::parallelFor(size_t count, const Task& task)
+{
+    if (count == 0)
+        return;
+
+    // Nothing to share, skip the hand-off entirely
+    if (threadCount == 1 || count == 1)
+    {
+        for (size_t i = 0; i < count; i++)
+            task(i, 0);
+        return;
+    }
+
+    // Contiguous initial ranges keep neighbouring tiles on the same worker
+    for (size_t w = 0; w < threadCount; w++)
+    {
+        std::lock_guard<std::mutex> guard(queues[w].lock);
+        queues[w].begin = count * w / threadCount;
+        queues[w].end = count * (w + 1) / threadCount;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        this->task = &task;
+        error = nullptr;
+        busyWorkers = threadCount - 1;
+        generation++;
+    }
+    wake.notify_all();
+
+    runTasks(0);
+
+    std::exception_ptr failure;
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        finished.wait(guard, [this] { return busyWorkers == 0; });
+        this->task = nullptr;
+        failure = error;
+    }
+
+    if (failure)
+        std::rethrow_exception(failure);
+}
+
+void ThreadPool::workerLoop(size_t worker)
+{
+    uint64_t seen = 0;
+
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            wake.wait(guard, [&] { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+        }
+
+        runTasks(worker);
+
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            busyWorkers--;
+        }
+        finished.notify_one();
+    }
+}
+
+void ThreadPool::runTasks(size_t worker)
+{
+    size_t index;
+    while (takeTask(worker, index) || stealTask(worker, index))
+    {
+        try
+        {
+            (*task)(index, worker);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            if (!error)
+                error = std::current_exception();
+        }
+    }
+}
+
+bool ThreadPool::takeTask(size_t worker, size_t& index)
+{
+    WorkQueue& queue = queues[worker];
+    std::lock_guard<std::mutex> guard(queue.lock);
+
+    if (queue.begin == queue.end)
+        return false;
+
+    index = queue.begin++;
+    return true;
+}
+
+bool ThreadPool::stealTask(size_t worker, size_t& index)
+{
+    for (size_t offset = 1; offset < threadCount; offset++)
+    {
+        WorkQueue& victim = queues[(worker + offset) % threadCount];
+        size_t begin, end;
+        {
+            std::lock_guard<std::mutex> guard(victim.lock);
+            size_t remaining = victim.end - victim.begin;
+            if (remaining == 0)
+                continue;
+
+            // Take the back half, the victim keeps working from the front
+            end = victim.end;
+            begin = victim.end - (remaining + 1) / 2;
+            victim.end = begin;
+        }
+
+        index = begin;
+        if (begin + 1 < end)
+        {
+            std::lock_guard<std::mutex> guard(queues[worker].lock);
+            queues[worker].begin = begin + 1;
+            queues[worker].end = end;
+        }
+        return true;
+    }
+    return false;
+}